@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace DirectMusic {
+    /// A call stack which allocated memory while rendering
+    struct AllocationSite {
+        /// Functions of the call stack, innermost first
+        std::vector<std::string> frames;
+
+        /// Number of allocations made from this call stack, and their total size
+        std::uint64_t count = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    /** \brief Detects the memory allocations made by the audio thread
+     * Allocating memory can block the audio thread for an unbounded time, so once a
+     * segment is playing `PlayingContext::renderBlock` is meant not to allocate at all.
+     * When the library is built with the DMUSIC_ALLOCATION_CHECK option, it replaces
+     * the global `operator new` and `delete` (and routes the allocations of the
+     * synthesizer through them), and records the allocations made by a thread while
+     * it is inside a `RealtimeScope`, i.e. while rendering. Call stacks are recorded
+     * where the platform provides them; executables need to export their symbols
+     * (`-rdynamic`) for these to be named.
+     *
+     * This is meant for debugging: built without the option, nothing is recorded.
+     */
+    class AllocationCheck {
+    public:
+        /// Returns true if allocations are recorded, i.e. the library was built with
+        /// DMUSIC_ALLOCATION_CHECK
+        static bool isAvailable() noexcept;
+
+        /// Starts recording the allocations made while rendering, forgetting those
+        /// recorded before. If `abortOnAllocation` is true, the first one prints its
+        /// call stack and aborts the process instead (real-time safety mode).
+        static void start(bool abortOnAllocation = false);
+
+        static void stop() noexcept;
+
+        /// Number of allocations made while rendering since recording was started
+        static std::uint64_t getCount() noexcept;
+
+        /// Number of allocations made by any thread since the process started
+        static std::uint64_t getTotalCount() noexcept;
+
+        /// Returns the call stacks which allocated while rendering, the most frequent first
+        static std::vector<AllocationSite> getSites();
+
+        /// Marks the calling thread as rendering, until `leaveRealtime` is called
+        static void enterRealtime() noexcept;
+        static void leaveRealtime() noexcept;
+    };
+
+    /// Marks the calling thread as rendering while the scope lasts. Scopes can be nested.
+    class RealtimeScope {
+    public:
+        RealtimeScope() noexcept { AllocationCheck::enterRealtime(); }
+        ~RealtimeScope() { AllocationCheck::leaveRealtime(); }
+
+        RealtimeScope(const RealtimeScope&) = delete;
+        RealtimeScope& operator=(const RealtimeScope&) = delete;
+    };
+}
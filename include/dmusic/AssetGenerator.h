@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Common.h"
+
+namespace DirectMusic {
+    class AssetStore;
+
+    /// Settings of a generated instrument collection (DLS)
+    struct CollectionSettings {
+        /// Identifier the collection's GUID is made from (see `AssetGenerator::makeGuid`)
+        std::uint32_t id = 1;
+
+        /// Number of instruments, with programs 0 to `instruments - 1` in bank 0.
+        /// Each one has a single region covering the whole key and velocity range.
+        std::uint32_t instruments = 8;
+
+        /// Number of waves in the wave pool, which the instruments use in turn
+        std::uint32_t waves = 1;
+
+        /// Length of every wave in frames
+        std::uint32_t waveFrames = 4410;
+
+        /// Sampling rate of the waves
+        std::uint32_t sampleRate = 44100;
+
+        /// Format of the waves: 8 or 16 bits PCM, or 32 bits IEEE float
+        std::uint16_t bitsPerSample = 16;
+
+        /// True if the waves loop as a whole, false if they play once
+        bool looped = true;
+    };
+
+    /// Settings of a generated style, whose parts play on performance channels 0 to `parts - 1`
+    struct StyleSettings {
+        /// Identifier the style's GUID is made from
+        std::uint32_t id = 2;
+
+        /// Number of parts, each playing its own instrument of the collection
+        std::uint32_t parts = 8;
+
+        /// Number of patterns, all in the groove range 1 to 100 so that they are picked at random
+        std::uint32_t patterns = 1;
+
+        /// Length of every pattern in measures of 4/4
+        std::uint16_t patternMeasures = 1;
+
+        /// Number of note onsets per part and measure, evenly spread
+        std::uint32_t notesPerMeasure = 16;
+
+        /// Number of notes played at each onset
+        std::uint32_t chordSize = 3;
+
+        /// Number of expression curves per part and measure
+        std::uint32_t curvesPerMeasure = 0;
+
+        /// If true, notes are chord tones transposed by the chord track of the segment,
+        /// which must then have one. If false, they are fixed MIDI notes.
+        bool chordRelative = false;
+
+        double tempo = 120;
+
+        /// Collection the band of the style refers to, and its number of instruments
+        std::string collectionFile = "generated.dls";
+        std::uint32_t collectionId = 1;
+        std::uint32_t collectionInstruments = 8;
+    };
+
+    /// Settings of a generated segment, which plays a style
+    struct SegmentSettings {
+        /// Identifier the segment's GUID is made from
+        std::uint32_t id = 4;
+
+        /// Length of the segment in measures of 4/4
+        std::uint32_t measures = 64;
+
+        /// Style the segment plays
+        std::string styleFile = "generated.sty";
+        std::uint32_t styleId = 2;
+
+        /// Groove level set at the start of the segment
+        std::uint8_t grooveLevel = 1;
+
+        /// Number of chord changes, evenly spread
+        std::uint32_t chordChanges = 0;
+
+        /// Number of tempo changes, evenly spread
+        std::uint32_t tempoChanges = 0;
+
+        /// Number of band changes, evenly spread. Each one assigns other instruments
+        /// of the collection to performance channels 0 to `bandParts - 1`, cycling
+        /// through its `collectionInstruments` instruments.
+        std::uint32_t bandChanges = 0;
+        std::uint32_t bandParts = 8;
+        std::string collectionFile = "generated.dls";
+        std::uint32_t collectionId = 1;
+        std::uint32_t collectionInstruments = 8;
+    };
+
+    /** \brief Generates valid DirectMusic files of any size
+     * The files are made of the same RIFF chunks as the ones written by DirectMusic
+     * Producer, with deterministic content: generating them twice with the same
+     * settings gives the same bytes. This allows measuring the library without
+     * the assets of a game.
+     */
+    class AssetGenerator {
+    public:
+        /// Returns a DLS file
+        static std::vector<std::uint8_t> generateCollection(const CollectionSettings& settings = CollectionSettings());
+
+        /// Returns a style file
+        static std::vector<std::uint8_t> generateStyle(const StyleSettings& settings = StyleSettings());
+
+        /// Returns a segment file
+        static std::vector<std::uint8_t> generateSegment(const SegmentSettings& settings = SegmentSettings());
+
+        /// Returns the GUID of generated objects with the given identifier
+        static GUID makeGuid(std::uint32_t id);
+
+        /// Returns a store loading the given files, e.g. generated ones, from memory by name
+        static std::shared_ptr<AssetStore> createStore(std::map<std::string, std::vector<std::uint8_t>> files);
+    };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Common.h"
+#include "Forms.h"
+#include "MemoryUsage.h"
+#include "dls/DownloadableSound.h"
+
+namespace DirectMusic {
+    using AssetLoader = std::function<std::vector<std::uint8_t>(const std::string&)>;
+
+    /** \brief Cache of the styles and instrument collections loaded by playing contexts
+     * Several contexts can share a store (e.g. to render several segments at once),
+     * so that each file is only loaded and converted once. All methods can be called
+     * from several threads at once.
+     */
+    class AssetStore {
+    public:
+        /// Creates a store loading files from the file system
+        AssetStore();
+
+        /// Creates a store loading files with the given loader
+        explicit AssetStore(AssetLoader loader);
+
+        ~AssetStore();
+
+        /// Overrides the loader. It may be called from several threads at once.
+        void setLoader(AssetLoader loader);
+
+        /// Returns the content of a file, or nothing if it can't be read
+        std::vector<std::uint8_t> load(const std::string& file) const;
+
+        /// Loads a style file, or returns it from the cache
+        std::shared_ptr<StyleForm> loadStyle(const GUID& guid, const std::string& file);
+
+        /// Loads an instrument collection, or returns it from the cache
+        std::shared_ptr<DirectMusic::DLS::DownloadableSound> loadInstrumentCollection(const GUID& guid, const GUID& bandGuid, const std::string& file);
+
+        /// Returns the bytes held by the cached collections and styles (the other fields are 0).
+        /// If `assets` is not null, one entry per cached asset is appended to it.
+        MemoryUsage getMemoryUsage(std::vector<AssetMemoryUsage>* assets = nullptr) const;
+
+    private:
+        mutable std::mutex m_mutex;
+        AssetLoader m_loader;
+        std::map<GUID, std::shared_ptr<DirectMusic::DLS::DownloadableSound>> m_bands;
+        std::unordered_map<std::pair<GUID, std::string>, std::shared_ptr<StyleForm>> m_styles;
+        std::size_t m_collectionBytes = 0, m_styleBytes = 0;
+    };
+}
@@ -2,20 +2,48 @@
 
 #include <cstdint>
 #include <functional>
+#include <future>
+#include <mutex>
 #include <unordered_map>
 #include "dls/DownloadableSound.h"
 #include "InstrumentPlayer.h"
 #include "PlayingContext.h"
+#include "Scheduler.h"
 
 class TinySoundFont;
+struct tsf_voice_budget;
 
 namespace DirectMusic {
+    /// Settings shared by all the players created by a DlsPlayer factory
+    struct DlsPlayerSettings {
+        /// Maximum number of voices a single performance channel can play at once
+        std::uint32_t channelVoices = 64;
+
+        /// Maximum number of voices all the performance channels can play at once.
+        /// Notes beyond these limits steal a voice (the quietest releasing one, or the oldest).
+        std::uint32_t totalVoices = 256;
+
+        /// Level in decibels below which a releasing voice is considered inaudible and stopped
+        float silenceThreshold = -90.0f;
+
+        /// Scheduler decoding the samples of instrument collections in parallel
+        /// (if null, that of the context creating the player)
+        std::shared_ptr<Scheduler> scheduler;
+    };
+
     class DlsPlayer : public InstrumentPlayer {
     private:
         int m_preset;
+        // Declared first so that it outlives the synthesizer which counts against it
+        std::shared_ptr<tsf_voice_budget> m_voiceBudget;
         std::shared_ptr<TinySoundFont> m_soundfont;
+        std::shared_ptr<TinySoundFont> m_bank; //< Converted collection m_soundfont is a copy of
+        const DirectMusic::DLS::DownloadableSound* m_bankCollection; //< Key of m_bank in m_soundfonts
+        std::size_t m_trackedBytes = 0; //< Bytes counted in the process-wide memory usage
 
-        static std::unordered_map<DirectMusic::DLS::DownloadableSound, std::shared_ptr<TinySoundFont>> m_soundfonts;
+        // Collections converted by any player, shared by all of them
+        static std::unordered_map<DirectMusic::DLS::DownloadableSound, std::shared_future<std::shared_ptr<TinySoundFont>>> m_soundfonts;
+        static std::mutex m_soundfontsMutex;
 
         DlsPlayer(std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patch,
             DirectMusic::DLS::DownloadableSound& dls,
@@ -23,9 +51,16 @@ namespace DirectMusic {
             std::uint32_t sampleRate,
             std::uint32_t channels,
             float volume,
-            float pan);
+            float pan,
+            const DlsPlayerSettings& settings,
+            const std::shared_ptr<tsf_voice_budget>& voiceBudget);
+
+        /// Updates the process-wide memory usage after the synthesizer may have allocated
+        void trackMemoryUsage() noexcept;
 
     public:
+        ~DlsPlayer();
+
         virtual std::uint32_t renderBlock(std::int16_t *buffer, std::uint32_t count, bool mix) noexcept;
 
         /// Instructs the synthesizer to start playing a note
@@ -51,7 +86,15 @@ namespace DirectMusic {
         /// Sends a "pitch bend" message
         virtual void pitchBend(std::int16_t val);
 
-        static PlayerFactory createFactory();
-        static GMPlayerFactory createGMFactory(DLS::DownloadableSound& dls);
+        virtual bool isIdle() const noexcept;
+
+        virtual PlayerStats getStats() const noexcept;
+        virtual std::uint32_t getActiveVoices() const noexcept;
+        virtual PlayerMemoryUsage getMemoryUsage() const noexcept;
+
+        virtual bool canRenderConcurrently() const noexcept { return true; }
+
+        static PlayerFactory createFactory(const DlsPlayerSettings& settings = DlsPlayerSettings());
+        static GMPlayerFactory createGMFactory(DLS::DownloadableSound& dls, const DlsPlayerSettings& settings = DlsPlayerSettings());
     };
 }
\ No newline at end of file
@@ -73,9 +73,9 @@ namespace DirectMusic {
         const DMUS_IO_REFERENCE& getHeader() const { return m_header; }
         const GUID& getGuid() const { return m_guid; }
         //const FILETIME& getDate() const { return m_date; }
-        const std::string getName() const { return m_name; }
-        const std::string getFile() const { return m_file; }
-        const std::string getCategory() const { return m_category; }
+        const std::string& getName() const { return m_name; }
+        const std::string& getFile() const { return m_file; }
+        const std::string& getCategory() const { return m_category; }
         const DMUS_IO_VERSION& getVersion() const { return m_version; }
 
     private:
@@ -201,7 +201,7 @@ namespace DirectMusic {
         const std::vector<PartReference>& getPartReferences() const { return m_partrefs; }
 
         /// Only used in Pattern Tracks
-        const std::vector<StylePart> getParts() const { return m_parts; }
+        const std::vector<StylePart>& getParts() const { return m_parts; }
 
     private:
         DMUS_IO_PATTERN m_header;
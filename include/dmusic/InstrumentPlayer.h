@@ -1,10 +1,34 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include "Midi.h"
 #include "dls/DownloadableSound.h"
 
 namespace DirectMusic {
+    /// Counters accumulated by an InstrumentPlayer since its creation
+    struct PlayerStats {
+        /// Number of note-on messages which were resolved to regions
+        std::uint64_t noteOns = 0;
+
+        /// Number of regions whose key range matched a note-on
+        std::uint64_t regionLookups = 0;
+
+        /// Number of regions which actually started a voice
+        std::uint64_t regionMatches = 0;
+    };
+
+    /// Memory held by an InstrumentPlayer
+    struct PlayerMemoryUsage {
+        /// Bytes held by the player alone
+        std::size_t bytes = 0;
+
+        /// Bytes of the data shared with other players, e.g. the synthesizer bank converted
+        /// from an instrument collection, and an address identifying that data
+        std::size_t sharedBytes = 0;
+        const void* sharedData = nullptr;
+    };
+
     /** \brief Interface for objects that can respond to MIDI data and render audio
      * This class is provided as a mean to abstract message passing from the
      * actual audio rendering.
@@ -53,6 +77,27 @@ namespace DirectMusic {
         /// Sends a "pitch bend" message
         virtual void pitchBend(std::int16_t val) = 0;
 
+        /// Returns true if rendering would currently produce nothing but silence,
+        /// i.e. no voice is playing. Idle players are not rendered at all.
+        virtual bool isIdle() const noexcept { return false; }
+
+        /// Returns the counters accumulated so far. Players which do not
+        /// keep track of them return all zeroes.
+        virtual PlayerStats getStats() const noexcept { return PlayerStats(); }
+
+        /// Returns the number of voices currently playing, or 0 if the player
+        /// does not keep track of them
+        virtual std::uint32_t getActiveVoices() const noexcept { return 0; }
+
+        /// Returns the memory held by the player. Players which do not keep
+        /// track of it return all zeroes.
+        virtual PlayerMemoryUsage getMemoryUsage() const noexcept { return PlayerMemoryUsage(); }
+
+        /// Returns true if `renderBlock` can run on another thread at the same time
+        /// as the `renderBlock` of other players, i.e. the player shares no mutable
+        /// state with them. Other players are always rendered on the calling thread.
+        virtual bool canRenderConcurrently() const noexcept { return false; }
+
     protected:
         DirectMusic::DLS::DownloadableSound& m_dls;
         const int m_sampleRate;
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "Common.h"
+
+namespace DirectMusic {
+    class StyleForm;
+    namespace DLS {
+        class DownloadableSound;
+    }
+
+    /** \brief Bytes held by the library, by kind of object
+     * The sizes are estimated from the objects' contents (container capacities,
+     * struct sizes), not measured from the allocator, so they leave out the
+     * allocator's own overhead. They are meant for setting budgets and checking
+     * that memory is given back, not for exact bookkeeping.
+     */
+    struct MemoryUsage {
+        /// Parsed instrument collections (DownloadableSound) cached by asset stores
+        std::size_t collections = 0;
+
+        /// Parsed styles (StyleForm) cached by asset stores
+        std::size_t styles = 0;
+
+        /// Prepared segments (SegmentInfo), with their patterns and messages
+        std::size_t segments = 0;
+
+        /// Instrument collections converted for the synthesizer: sample pool, regions
+        /// and the copy of the collection keeping track of the conversion
+        std::size_t synthBanks = 0;
+
+        /// Instrument players: presets, voices and render buffers of their synthesizer
+        std::size_t players = 0;
+
+        /// Messages waiting in the queues of playing contexts
+        std::size_t messageQueues = 0;
+
+        std::size_t total() const noexcept {
+            return collections + styles + segments + synthBanks + players + messageQueues;
+        }
+    };
+
+    enum class AssetType {
+        Collection,
+        Style
+    };
+
+    /// Bytes held by one asset cached by an AssetStore
+    struct AssetMemoryUsage {
+        AssetType type = AssetType::Collection;
+        GUID guid;
+
+        /// Name tag of the asset, if it has one
+        std::string name;
+
+        std::size_t bytes = 0;
+    };
+
+    /// Returns the bytes held by a parsed instrument collection, wave data included
+    std::size_t estimateMemoryUsage(const DLS::DownloadableSound& dls);
+
+    /// Returns the bytes held by a parsed style
+    std::size_t estimateMemoryUsage(const StyleForm& style);
+
+    /// Returns the bytes held by the library in the whole process: the assets cached
+    /// by all the asset stores, the segments prepared by any context and not released
+    /// yet, the converted synthesizer banks, the players alive and the message queues
+    /// of all the playing contexts. Players are counted as of their last note or render.
+    /// This can be called from any thread; it briefly locks the queue of every context.
+    MemoryUsage getProcessMemoryUsage();
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include "Midi.h"
@@ -11,7 +12,6 @@ namespace DirectMusic {
     enum class SegmentTiming;
 
     enum class MusicMessageType {
-        TempoChange,
         BandChange,
         GrooveLevel,
         ChordMessage,
@@ -33,10 +33,13 @@ namespace DirectMusic {
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) = 0;
         virtual MusicMessageType getMessageType() const = 0;
 
+        /// Returns the bytes held by the message, not counting the players it refers to.
+        /// Messages larger than this class or holding memory of their own override it.
+        virtual std::size_t getMemoryUsage() const { return sizeof(*this); }
+
     protected:
         std::uint32_t m_messageTime;
 
-        void changeTempo(PlayingContext& ctx, double tempo);
         std::shared_ptr<InstrumentPlayer> createInstrument(PlayingContext& ctx,
             std::uint8_t bank_lo, std::uint8_t bank_hi, std::uint8_t patch,
             const GUID& bandGuid, DirectMusic::DLS::DownloadableSound& dls,
@@ -52,6 +55,9 @@ namespace DirectMusic {
         void enqueueNextSegment(PlayingContext& ctx);
         bool isNextSegmentAvailable(PlayingContext& ctx);
         SegmentTiming getNextSegmentTiming(PlayingContext& ctx);
+
+        /// Returns a number from 0 to `bound` - 1 drawn from the context's generator
+        std::uint32_t random(PlayingContext& ctx, std::uint32_t bound);
     };
 
     struct MusicMessageComparer {
@@ -6,6 +6,7 @@
 #include <unordered_map>
 #include <queue>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
 #include <utility>
 #include <fstream>
@@ -16,6 +17,12 @@
 #include "Forms.h"
 #include "dls/DownloadableSound.h"
 #include "MusicMessage.h"
+#include "Scheduler.h"
+#include "AssetStore.h"
+#include "RenderStats.h"
+#include "MemoryUsage.h"
+#include "Random.h"
+#include "TempoMap.h"
 
 namespace DirectMusic {
     using PlayerFactory = std::function<std::shared_ptr<InstrumentPlayer>(
@@ -38,6 +45,26 @@ namespace DirectMusic {
     using GuidStringPair = std::pair<GUID, std::string>;
 
     class SegmentInfo;
+    class RenderProfiler;
+
+    /// Layout of an output buffer which can have more channels than the context renders
+    struct OutputLayout {
+        /// Number of channels of the buffer
+        std::uint32_t channels = 2;
+
+        /// True if the buffer holds each channel after the other (planar),
+        /// false if their samples are interleaved
+        bool planar = false;
+
+        /// Output channel receiving each rendered channel, e.g. { 0, 1 } for the front left
+        /// and right speakers. Output channels which receive nothing are silent.
+        std::vector<std::uint32_t> channelMap = { 0, 1 };
+
+        /// Copies `frames` frames of interleaved audio with `sourceChannels` channels to `output`,
+        /// a buffer of `outputFrames` frames in this layout, starting at its frame `offset`
+        void copyFrames(const std::int16_t *source, std::uint32_t sourceChannels, std::uint32_t frames,
+            std::int16_t *output, std::uint32_t offset, std::uint32_t outputFrames) const noexcept;
+    };
 
     enum class SegmentTiming {
         Grid,     //< Aligns the segment to play at a grid boundary
@@ -51,6 +78,7 @@ namespace DirectMusic {
     class PlayingContext {
         friend class MusicMessage;
         friend class SegmentInfo;
+        friend MemoryUsage getProcessMemoryUsage();
 
     private:
         struct Pattern {
@@ -58,27 +86,40 @@ namespace DirectMusic {
             std::vector<std::pair<DMUS_IO_PARTREF, StylePart>> parts;
         };
 
-        bool getRandomPattern(const SegmentInfo& segm, std::uint8_t grooveLevel, Pattern* output) const;
+        /// Points `output` to one of the patterns of the segment suitable for the groove level, chosen at random
+        bool getRandomPattern(const SegmentInfo& segm, std::uint8_t grooveLevel, const Pattern** output);
 
         PlayerFactory m_instrumentFactory;
         GMPlayerFactory  m_gminstrumentFactory; //< Used to instantiate instruments that come from GM patches
         std::uint32_t m_sampleRate, m_audioChannels;
-        std::function<std::vector<std::uint8_t>(const std::string&)> m_loader;
+        std::shared_ptr<AssetStore> m_assets;
         std::map<std::uint32_t, std::shared_ptr<InstrumentPlayer>> m_performanceChannels;
         std::uint32_t m_musicTime;
-        double m_tempo;
         std::uint8_t m_grooveLevel;
         std::uint32_t m_chord;
         std::vector<DMUS_IO_SUBCHORD> m_subchords;
-        DMUS_IO_TIMESIG m_signature;
         std::mutex m_queueMutex;
         MessageQueue m_messageQueue, m_patternMessageQueue;
+        Random m_random; //< Makes the random choices of the music, guarded by m_queueMutex
         std::shared_ptr<SegmentInfo> m_primarySegment = nullptr, m_nextSegment = nullptr;
-        std::uint32_t m_currentSegmentStart;
+        std::uint32_t m_currentSegmentStart = 0; //< Music time the primary segment was enqueued at
+        std::uint64_t m_segmentFrames = 0; //< Frames rendered since m_currentSegmentStart
         SegmentTiming m_nextSegmentTiming;
 
-        std::map<GUID, std::shared_ptr<DirectMusic::DLS::DownloadableSound>> m_bands;
-        std::unordered_map<GuidStringPair, std::shared_ptr<StyleForm>> m_styles;
+        std::shared_ptr<Scheduler> m_scheduler; //< Null until set or needed, see getScheduler
+        bool m_parallelRender = false;
+        std::vector<std::int16_t> m_quantum; //< Last rendered quantum, the output FIFO
+        std::uint32_t m_quantumPosition; //< Samples of m_quantum already handed out
+        std::vector<InstrumentPlayer*> m_renderPlayers;
+        std::vector<std::uint32_t> m_renderChannelIds; //< Performance channels of m_renderPlayers
+        std::vector<std::uint64_t> m_renderTimes; //< Time spent rendering each of m_renderPlayers, when profiling
+        std::vector<std::int16_t> m_renderScratch; //< One block per player of m_renderPlayers
+
+        std::mutex m_prefetchMutex; //< Guards m_pendingPrefetches
+        std::condition_variable m_prefetchDone;
+        std::uint32_t m_pendingPrefetches = 0;
+
+        std::unique_ptr<RenderProfiler> m_profiler;
 
         template<typename T>
         static std::shared_ptr<T> genObjFromChunkData(const std::vector<std::uint8_t>& data) {
@@ -87,67 +128,148 @@ namespace DirectMusic {
             return std::make_shared<T>(c);
         }
 
+        /// Queues the messages of a segment starting from the current music time,
+        /// which the segment's tempo map is then applied from
         void enqueueSegment(const std::shared_ptr<SegmentInfo>& segment);
 
+        /// Returns the queue holding the message to run next, or null if both are empty
+        MessageQueue* getNextQueue() noexcept;
+
+        /// Returns the tempo map of the primary segment, or the default one if there is none
+        const TempoMap& getTempoMap() const noexcept;
+
+        /// Returns the first frame, counted like m_segmentFrames, not before the given music time
+        std::uint64_t getSegmentFrame(std::uint32_t musicTime) const noexcept;
+
+        /// Moves the music time `frames` frames forward
+        void advanceFrames(std::uint32_t frames) noexcept;
+
+        /// Loads the styles and instrument collections the segment refers to which
+        /// are not cached yet, in parallel on the scheduler
+        void preload(const SegmentForm& segment);
+
+        /// Advances the music time in one step past the silent quanta that come next, up to
+        /// `maxQuanta` of them, as rendering them would. A quantum is silent if no player is
+        /// playing and no message nor segment transition falls in it. Returns the number
+        /// of quanta skipped.
+        std::uint32_t skipSilentQuanta(std::uint32_t maxQuanta) noexcept;
+
+        /// Renders one quantum, i.e. `count` = QuantumFrames * m_audioChannels samples
+        void renderQuantum(std::int16_t *data, std::uint32_t count, float volume) noexcept;
+
         void renderAudio(std::int16_t *data, std::uint32_t count, float volume) noexcept;
 
+        /// Mixes `count` samples of every non-idle performance channel into `data`,
+        /// or fills it with silence if all of them are idle
+        void renderChannels(std::int16_t *data, std::uint32_t count) noexcept;
+
+        /// Same as `renderChannels`, with the players rendered on the render pool. Returns
+        /// false without rendering anything if its buffers are too small for the channels
+        /// playing, as they never grow on the audio thread.
+        bool renderChannelsParallel(std::int16_t *data, std::uint32_t count) noexcept;
+
+        /// Sizes the buffers of `renderChannelsParallel` for `channels` performance channels
+        void reserveParallelRender(std::size_t channels);
+
+        /// Returns the bytes held by the messages waiting in the queues
+        std::size_t getQueueMemoryUsage();
+
     public:
 
         static const std::uint32_t PulsesPerQuarterNote = 768;
 
+        /// Number of frames the audio is rendered by, whatever the size of the blocks
+        /// requested from `renderBlock`: these are served from the last rendered quantum.
+        /// This keeps the work per quantum and the timing of the music independent
+        /// from the host's buffer size. A multiple of the synthesizer's 64-frame blocks.
+        static const std::uint32_t QuantumFrames = 128;
+
         /// Creates a new playing context with the specified sampling rate and
         /// number of audio channels (normally 1 (mono) or 2 (stereo))
         PlayingContext(std::uint32_t sampleRate,
             std::uint32_t audioChannels,
             PlayerFactory instrumentFactory,
-            GMPlayerFactory gminstrumentFactory = nullptr)
-            : m_sampleRate(sampleRate),
-            m_audioChannels(audioChannels),
-            m_instrumentFactory(instrumentFactory),
-            m_gminstrumentFactory(gminstrumentFactory),
-            m_musicTime(0),
-            m_grooveLevel(1),
-            m_tempo(100),
-            m_primarySegment(nullptr)
-        {
-            m_loader = [](const std::string& file) -> std::vector<std::uint8_t> {
-                std::ifstream inputStream(file, std::ios::binary | std::ios::ate);
-                if (!inputStream.is_open()) {
-                    return std::vector<std::uint8_t>();
-                }
-                std::vector<std::uint8_t> buffer(inputStream.tellg());
-                inputStream.seekg(0);
-                inputStream.read((char*)buffer.data(), buffer.size());
-                inputStream.close();
-                return buffer;
-            };
-
-            m_signature.bBeat = 4;
-            m_signature.bBeatsPerMeasure = 4;
-            m_signature.wGridsPerBeat = 4;
-        }
+            GMPlayerFactory gminstrumentFactory = nullptr);
+
+        ~PlayingContext();
 
-        /// Renders the following audio block
+        /// Runs the work spread over several threads (parallel rendering, loading) on
+        /// the given scheduler, or on the library's default pool if it is null (the default).
+        /// The default pool is only created once the context needs it, so hosts setting their
+        /// own scheduler before loading anything never start the library's threads.
+        void setScheduler(const std::shared_ptr<Scheduler>& scheduler);
+
+        /// Returns the scheduler set, or the default pool, creating it if needed
+        std::shared_ptr<Scheduler> getScheduler();
+
+        /// Renders the performance channels in parallel on the scheduler instead of only
+        /// on the thread calling `renderBlock` (the default). The audio is the same either way.
+        void setParallelRendering(bool parallel);
+
+        /// Shorthand for rendering in parallel on a new pool of `threads` threads,
+        /// or serially with the default scheduler if `threads` is 0 or 1
+        void setRenderThreads(std::uint32_t threads);
+
+        /// Restarts the random choices of the music (the patterns and variations played,
+        /// and the groove levels and velocities picked within their ranges) from the given
+        /// seed, which is Random::DefaultSeed for a new context. Playing the same segments
+        /// after setting the same seed renders the same audio.
+        void setSeed(std::uint64_t seed);
+
+        std::uint64_t getSeed();
+
+        /// Renders the following audio block of `count` samples (all channels included).
+        /// Silent spans (rests, the tail after the end of a segment) cost next to nothing,
+        /// so offline rendering of sparse segments is much faster than real time.
         void renderBlock(std::int16_t *data, std::uint32_t count, float volume = 1) noexcept;
 
+        /// Renders the following `frames` frames into a buffer with the given layout,
+        /// e.g. the stereo output of the context into the front speakers of a surround device
+        void renderBlock(std::int16_t *data, std::uint32_t frames, const OutputLayout& layout, float volume = 1) noexcept;
+
         /// Prepares a segment for being played
         std::shared_ptr<SegmentInfo> prepareSegment(const SegmentForm& segment);
 
+        /// Starts loading the styles and instrument collections a segment refers to
+        /// in the background, so that preparing it later does not wait for them
+        void prefetchSegment(const std::shared_ptr<SegmentForm>& segment);
+
         /// Begins the playback of a segment
         void playSegment(const SegmentForm& segment, SegmentTiming timing = SegmentTiming::Immediate);
         void playSegment(std::shared_ptr<SegmentInfo> segment, SegmentTiming timing = SegmentTiming::Immediate);
+
+        /// Moves the playback of the primary segment to the given music time, in pulses from
+        /// its start, wrapping around past its end. The messages before that time are run
+        /// without rendering any audio and without their notes, so this is about as fast
+        /// as starting the segment, e.g. to resume the music after loading a saved game.
+        /// The notes playing are released. A segment passed to `playSegment` with
+        /// SegmentTiming::Immediate is started by the seek, even if it has not rendered
+        /// yet. Does nothing if no segment is playing.
+        void seek(std::uint32_t musicTime);
+
+        /// Returns the music time from the start of the primary segment, which `seek` takes
+        std::uint32_t getSegmentTime();
         /*
         void playTransition(const SegmentForm& segment,
                             DMUS_COMMANDT_TYPES command,
                             DMUS_COMPOSEF_FLAGS flags,
                             std::shared_ptr<ChordmapForm> chordmap = nullptr);*/
 
-        /// Overrides the default loader with a custom one
-        void provideLoader(std::function<std::vector<std::uint8_t>(const std::string&)> l) { m_loader = l; };
+        /// Overrides the default loader with a custom one.
+        /// The loader may be called from several threads at once.
+        /// It is the loader of the asset store, shared with the contexts using the same store.
+        void provideLoader(std::function<std::vector<std::uint8_t>(const std::string&)> l) { m_assets->setLoader(std::move(l)); };
+
+        /// Loads the styles and instrument collections from the given store, e.g. one
+        /// shared by several contexts rendering at once, or from a new one if it is null.
+        /// Meant to be called before playing anything.
+        void setAssetStore(const std::shared_ptr<AssetStore>& assets);
+
+        const std::shared_ptr<AssetStore>& getAssetStore() const { return m_assets; }
 
         /// Loads a segment file
         std::shared_ptr<SegmentForm> loadSegment(const std::string& file) const {
-            std::vector<std::uint8_t> data = m_loader(file);
+            std::vector<std::uint8_t> data = m_assets->load(file);
             return genObjFromChunkData<SegmentForm>(data);
         }
 
@@ -159,6 +281,29 @@ namespace DirectMusic {
 
         double getTime() const { return m_musicTime; }
 
+        /// Sums the counters of the instruments currently assigned to the performance channels.
+        /// Sampling this twice gives e.g. the number of region lookups per second.
+        PlayerStats getPlayerStats();
+
+        /// Collects the render statistics returned by `getRenderStats`. This is off by
+        /// default, as it reads the clock for every player in every sub-block.
+        void setProfiling(bool enabled);
+
+        /// Returns the render statistics as of the end of the last rendered block. This
+        /// can be called from any thread and never makes the rendering thread wait.
+        RenderStats getRenderStats() const;
+
+        /// Clears the render statistics once the block being rendered is done.
+        /// This can be called from any thread.
+        void resetRenderStats();
+
+        /// Returns the bytes held by what the context uses: the assets of its store (which
+        /// may be shared with other contexts), the playing and next segments, the players
+        /// they and the performance channels use, the synthesizer banks of these players
+        /// and the message queues. If `assets` is not null, one entry per asset of the
+        /// store is appended to it.
+        MemoryUsage getMemoryUsage(std::vector<AssetMemoryUsage>* assets = nullptr);
+
         int getSampleRate() const { return m_sampleRate; }
         int getAudioChannels() const { return m_audioChannels; }
     };
@@ -167,6 +312,14 @@ namespace DirectMusic {
         friend class PlayingContext;
 
     public:
+        ~SegmentInfo();
+
+        /// Returns the bytes held by the prepared segment, its patterns and messages
+        std::size_t getMemoryUsage() const { return memoryUsage; }
+
+        /// Returns the tempo and time signature changes of the segment
+        const TempoMap& getTempoMap() const { return tempoMap; }
+
         inline bool operator ==(const SegmentInfo& b) const {
             return guid == b.guid && unfo == b.unfo;
         }
@@ -180,10 +333,12 @@ namespace DirectMusic {
         std::uint32_t numLoops;
         std::vector<PlayingContext::Pattern> patterns;
         std::vector<std::shared_ptr<MusicMessage>> messages;
-        double initialTempo;
-        DMUS_IO_TIMESIG initialSignature;
+        double initialTempo = TempoMap::DefaultTempo;
+        DMUS_IO_TIMESIG initialSignature = TempoMap::getDefaultSignature();
+        TempoMap tempoMap;
         std::uint32_t length;
         GUID guid;
         Riff::Unfo unfo;
+        std::size_t memoryUsage = 0;
     };
 }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+namespace DirectMusic {
+    /** \brief Seedable pseudo-random number generator (PCG32)
+     * Every PlayingContext owns one for the random choices of the music (patterns,
+     * variations, groove levels and velocities), so that contexts don't share any
+     * state and a render only depends on its seed.
+     */
+    class Random {
+    public:
+        static const std::uint64_t DefaultSeed = 1;
+
+        explicit Random(std::uint64_t seed = DefaultSeed) noexcept { setSeed(seed); }
+
+        /// Restarts the sequence from the given seed
+        void setSeed(std::uint64_t seed) noexcept {
+            m_seed = seed;
+            m_state = 0;
+            next();
+            m_state += seed;
+            next();
+        }
+
+        /// Returns the seed the sequence was last started from
+        std::uint64_t getSeed() const noexcept { return m_seed; }
+
+        /// Returns the following number of the sequence
+        std::uint32_t next() noexcept {
+            std::uint64_t state = m_state;
+            m_state = state * 6364136223846793005ULL + Increment;
+            std::uint32_t xorshifted = (std::uint32_t)(((state >> 18) ^ state) >> 27);
+            std::uint32_t rotation = (std::uint32_t)(state >> 59);
+            return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+        }
+
+        /// Returns a number from 0 to `bound` - 1. `bound` must not be 0.
+        std::uint32_t next(std::uint32_t bound) noexcept {
+            return (std::uint32_t)(((std::uint64_t)next() * bound) >> 32);
+        }
+
+    private:
+        static const std::uint64_t Increment = 1442695040888963407ULL;
+
+        std::uint64_t m_seed;
+        std::uint64_t m_state;
+    };
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "PlayingContext.h"
+
+namespace DirectMusic {
+    /** \brief Renders a playing context ahead of time on a background thread
+     * The audio callback only copies already rendered samples out of a lock-free
+     * ring buffer, so that a spike in the rendering (e.g. on a pattern boundary)
+     * causes no glitch as long as it is shorter than the audio buffered ahead.
+     * This costs as much latency. The thread renders a quantum at a time, whenever
+     * less than the latency minus a quantum is buffered, so that it never gets
+     * ahead of the position the commands are posted for.
+     */
+    class RenderAheadBuffer {
+    public:
+        /// Starts rendering `context` about `aheadMilliseconds` ahead of what is read,
+        /// and at least two quanta ahead. The context must outlive this object.
+        RenderAheadBuffer(PlayingContext& context, std::uint32_t aheadMilliseconds);
+
+        /// Stops the rendering thread
+        ~RenderAheadBuffer();
+
+        RenderAheadBuffer(const RenderAheadBuffer&) = delete;
+        RenderAheadBuffer& operator=(const RenderAheadBuffer&) = delete;
+
+        /// Copies the next `count` samples (all channels included) to `data`. Meant to be
+        /// called from the audio callback: it never blocks nor allocates. Samples which
+        /// are not rendered yet are replaced with silence and counted as an underrun.
+        void read(std::int16_t *data, std::uint32_t count) noexcept;
+
+        /// Same as `read`, for `frames` frames in a buffer with the given layout
+        void read(std::int16_t *data, std::uint32_t frames, const OutputLayout& layout) noexcept;
+
+        /// Runs `command` on the rendering thread once the audio rendered reaches what will
+        /// be read in `getLatency()` samples from now. The delay between posting a command
+        /// and hearing its effect is therefore constant, however full the buffer is.
+        /// A command which throws is counted by `getFailedCommandCount`.
+        /// Calling the context directly works as well, with a delay between 0 and the latency.
+        void post(std::function<void(PlayingContext&)> command);
+
+        /// Returns the number of samples rendered ahead of what is read
+        std::uint32_t getLatency() const noexcept { return m_aheadSamples; }
+
+        /// Returns the number of `read` calls which could not be fully served
+        std::uint64_t getUnderrunCount() const noexcept { return m_underruns.load(std::memory_order_relaxed); }
+
+        /// Returns the number of posted commands which threw an exception
+        std::uint64_t getFailedCommandCount() const noexcept { return m_failedCommands.load(std::memory_order_relaxed); }
+
+        /// Returns the number of samples rendered so far. A command sees the position it runs at.
+        std::uint64_t getRenderedCount() const noexcept { return m_writePosition.load(std::memory_order_acquire); }
+
+    private:
+        struct Command {
+            std::uint64_t position; //< Write position at which the command runs
+            std::function<void(PlayingContext&)> function;
+        };
+
+        void renderLoop();
+
+        PlayingContext& m_context;
+        const std::uint32_t m_channels;
+        const std::uint32_t m_aheadSamples;
+
+        std::vector<std::int16_t> m_ring; //< Its size is a power of two
+        std::atomic<std::uint64_t> m_readPosition, m_writePosition;
+        std::atomic<std::uint64_t> m_underruns;
+        std::atomic<std::uint64_t> m_failedCommands;
+
+        std::mutex m_commandMutex;
+        std::deque<Command> m_commands;
+
+        std::atomic<bool> m_stop;
+        std::thread m_thread;
+    };
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace DirectMusic {
+    /// Distribution of the values of a measure. The percentile is approximated from
+    /// logarithmic buckets and is within 25% of the actual value.
+    struct HistogramSummary {
+        std::uint64_t count = 0;
+        std::uint64_t min = 0;
+        double mean = 0;
+        std::uint64_t max = 0;
+        std::uint64_t p99 = 0;
+    };
+
+    /// Time spent rendering one performance channel
+    struct ChannelRenderStats {
+        std::uint32_t channel = 0;
+
+        /// Number of times the player of the channel was rendered
+        std::uint64_t renders = 0;
+
+        std::uint64_t totalNanoseconds = 0;
+        std::uint64_t maxNanoseconds = 0;
+    };
+
+    /// Statistics collected by a PlayingContext while rendering, since profiling
+    /// was enabled or the statistics were last reset
+    struct RenderStats {
+        /// Number of performance channels whose render time is kept
+        static const std::uint32_t MaxChannels = 64;
+
+        /// Number of calls to `renderBlock`
+        std::uint64_t blocks = 0;
+
+        /// Number of quanta actually rendered
+        std::uint64_t quanta = 0;
+
+        /// Number of quanta skipped because they were silent
+        std::uint64_t silentQuanta = 0;
+
+        /// Number of messages (notes, tempo or band changes...) executed
+        std::uint64_t eventsDispatched = 0;
+
+        /// Number of times a quantum was split into smaller blocks to execute a message
+        std::uint64_t subBlockSplits = 0;
+
+        /// Number of patterns generated from the styles
+        std::uint64_t patternGenerations = 0;
+
+        /// Time spent in `renderBlock`, per call (ns)
+        HistogramSummary blockTime;
+
+        /// Time spent rendering a quantum (ns)
+        HistogramSummary quantumTime;
+
+        /// Time spent rendering the player of one performance channel, per sub-block (ns)
+        HistogramSummary channelTime;
+
+        /// Number of voices playing at the end of each quantum
+        HistogramSummary activeVoices;
+
+        /// Number of messages executed per quantum
+        HistogramSummary eventsPerQuantum;
+
+        /// Number of splits per quantum
+        HistogramSummary splitsPerQuantum;
+
+        /// Number of messages waiting in the queues at the end of each quantum
+        HistogramSummary queueDepth;
+
+        /// Per performance channel, in the order they were first rendered.
+        /// Only the first `MaxChannels` ones are kept.
+        std::vector<ChannelRenderStats> channels;
+    };
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace DirectMusic {
+    /** \brief Interface to the threads the library spreads its work over
+     * Hosts which already run a job system can implement it to keep the
+     * library from starting threads of its own; otherwise the library uses
+     * an internal thread pool.
+     */
+    class Scheduler {
+    public:
+        virtual ~Scheduler() = default;
+
+        /// Returns the number of threads `parallelFor` can use at once,
+        /// including the calling one
+        virtual std::uint32_t getConcurrency() const noexcept = 0;
+
+        /// Calls `task(i)` for every `i` in [0, count) and returns once all of them returned.
+        /// The calls may run concurrently and in any order, they never throw.
+        /// This is called from the audio thread when rendering in parallel, and may be
+        /// called from several threads at once.
+        virtual void parallelFor(std::size_t count, const std::function<void(std::size_t)>& task) noexcept = 0;
+
+        /// Runs `task` later on some thread. The task never throws.
+        virtual void async(std::function<void()> task) = 0;
+
+        /// Creates a pool of `threads` threads (the one calling `parallelFor` included)
+        static std::shared_ptr<Scheduler> createThreadPool(std::uint32_t threads);
+
+        /// Returns the pool shared by everything the host did not give a scheduler to,
+        /// with one thread per hardware thread. It is created on first use.
+        static std::shared_ptr<Scheduler> getDefault();
+
+        /// Returns the scheduler of the innermost `SchedulerScope` of the calling thread,
+        /// or the default one if there is none
+        static Scheduler& getCurrent();
+    };
+
+    /// Makes `Scheduler::getCurrent` return the given scheduler on the calling thread while
+    /// the scope lasts. A context sets its own while creating players, so that the players
+    /// convert their collections on it. Scopes can be nested.
+    class SchedulerScope {
+    public:
+        explicit SchedulerScope(Scheduler& scheduler) noexcept;
+        ~SchedulerScope();
+
+        SchedulerScope(const SchedulerScope&) = delete;
+        SchedulerScope& operator=(const SchedulerScope&) = delete;
+
+    private:
+        Scheduler* m_previous;
+    };
+}
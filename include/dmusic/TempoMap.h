@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Structs.h"
+
+namespace DirectMusic {
+    /** \brief Tempo and time signature changes of a segment
+     * Converts between music time, in pulses from the start of the segment, and
+     * seconds. The tempo changes are compiled into points holding the time they
+     * happen at in both units, so that either conversion is a binary search and a
+     * linear interpolation, exact wherever it is made in the segment instead of
+     * adding up the length of every rendered block. Past the last change the
+     * last tempo and time signature go on indefinitely.
+     */
+    class TempoMap {
+    public:
+        /// Tempo of the music until a segment sets one, in quarter notes per minute
+        static constexpr double DefaultTempo = 100;
+
+        /// Time signature of the music until a segment sets one: 4/4, with 4 grids per beat
+        static DMUS_IO_TIMESIG getDefaultSignature() noexcept;
+
+        /// Creates the map of music in the default tempo and time signature
+        TempoMap();
+
+        /// Compiles the changes of a tempo and a time signature track, which apply on top
+        /// of the given initial tempo and signature. The items need not be sorted, and
+        /// those before 0 take effect at 0.
+        TempoMap(double initialTempo, const DMUS_IO_TIMESIG& initialSignature,
+            const std::vector<DMUS_IO_TEMPO_ITEM>& tempos,
+            const std::vector<DMUS_IO_TIMESIGNATURE_ITEM>& signatures);
+
+        /// Returns the seconds elapsed from the start of the segment to the given music time
+        double getSeconds(double musicTime) const noexcept;
+
+        /// Returns the music time reached the given seconds after the start of the segment
+        double getMusicTime(double seconds) const noexcept;
+
+        /// Returns the tempo at the given music time, in quarter notes per minute
+        double getTempo(double musicTime) const noexcept;
+
+        /// Returns the time signature in effect at the given music time
+        DMUS_IO_TIMESIG getSignature(std::uint32_t musicTime) const noexcept;
+
+        /// Returns the music time of the first beat after `musicTime`. Beats and measures are
+        /// counted from the last time signature change, which always begins a measure.
+        std::uint32_t getNextBeat(std::uint32_t musicTime) const noexcept;
+
+        /// Returns the music time of the first measure after `musicTime`
+        std::uint32_t getNextMeasure(std::uint32_t musicTime) const noexcept;
+
+        /// Returns the bytes the map allocates, besides its own size
+        std::size_t getMemoryUsage() const noexcept;
+
+    private:
+        struct TempoPoint {
+            double musicTime;
+            double seconds; //< Seconds from the start of the segment to `musicTime`
+            double secondsPerPulse;
+        };
+
+        struct SignaturePoint {
+            std::uint32_t musicTime;
+            DMUS_IO_TIMESIG signature;
+        };
+
+        const TempoPoint& findTempo(double musicTime) const noexcept;
+        const SignaturePoint& findSignature(std::uint32_t musicTime) const noexcept;
+        std::uint32_t getNextDivision(std::uint32_t musicTime, bool measure) const noexcept;
+
+        std::vector<TempoPoint> m_tempos; //< Sorted by time, the first one at 0
+        std::vector<SignaturePoint> m_signatures; //< Sorted by time, the first one at 0
+    };
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#if DMUSIC_TRACE
+#   define DMUSIC_TRACE_CONCAT_(a, b) a##b
+#   define DMUSIC_TRACE_CONCAT(a, b) DMUSIC_TRACE_CONCAT_(a, b)
+/// Records an instant event. `name` must be a string literal.
+#   define TRACE(name) DirectMusic::Tracer::get().record(DirectMusic::TraceEventType::Instant, "dmusic", name);
+/// Records an instant event along with a number
+#   define TRACE_VALUE(name, value) DirectMusic::Tracer::get().record(DirectMusic::TraceEventType::Instant, "dmusic", name, (double)(value), true);
+/// Records the beginning and the end of the enclosing scope
+#   define TRACE_SCOPE(category, name) DirectMusic::TraceScope DMUSIC_TRACE_CONCAT(traceScope, __LINE__)(category, name);
+#   if DMUSIC_TRACE_VERBOSE
+#       define TRACE_VERBOSE(name) TRACE(name)
+#       define TRACE_VERBOSE_VALUE(name, value) TRACE_VALUE(name, value)
+#   else
+#       define TRACE_VERBOSE(name)
+#       define TRACE_VERBOSE_VALUE(name, value)
+#   endif
+#else
+#define TRACE(name)
+#define TRACE_VALUE(name, value)
+#define TRACE_SCOPE(category, name)
+#define TRACE_VERBOSE(name)
+#define TRACE_VERBOSE_VALUE(name, value)
+#endif
+
+namespace DirectMusic {
+    enum class TraceEventType : std::uint8_t {
+        Instant,
+        Begin,
+        End
+    };
+
+    /// An event of the trace. The names point to string literals.
+    struct TraceEvent {
+        /// Time since the trace was started, in nanoseconds
+        std::uint64_t timestamp;
+        const char* category;
+        const char* name;
+        double value;
+        /// Small number identifying the thread which recorded the event
+        std::uint32_t thread;
+        TraceEventType type;
+        bool hasValue;
+    };
+
+    /** \brief Records what the library does, from any thread, for later inspection
+     * The events (render blocks, message executions, loads...) are written into a
+     * preallocated lock-free ring buffer, so that recording them from the audio thread
+     * neither locks nor allocates. A background thread moves them out of the ring while
+     * tracing. If the ring is full, events are dropped rather than waited for.
+     *
+     * Events are only recorded if the library was built with the DMUSIC_TRACE option.
+     */
+    class Tracer {
+    public:
+        /// Returns the tracer of the process
+        static Tracer& get();
+
+        /// Returns true if the library records events, i.e. it was built with DMUSIC_TRACE
+        static bool isAvailable() noexcept;
+
+        ~Tracer();
+
+        /// Starts recording events. The ring is allocated by the first call, with room for
+        /// `capacity` events (rounded up to a power of two); later calls keep it.
+        void start(std::size_t capacity = 65536);
+
+        /// Stops recording events, once those recorded so far are collected
+        void stop();
+
+        bool isRecording() const noexcept { return m_recording.load(std::memory_order_relaxed); }
+
+        /// Records an event if tracing is started. Never blocks nor allocates.
+        void record(TraceEventType type, const char* category, const char* name, double value = 0, bool hasValue = false) noexcept;
+
+        /// Returns the events collected so far and forgets them
+        std::vector<TraceEvent> takeEvents();
+
+        /// Number of events dropped because the ring was full
+        std::uint64_t getDroppedCount() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+        /// Writes events in the Chrome trace event format (JSON), which can be
+        /// opened with chrome://tracing or https://ui.perfetto.dev
+        static void writeChromeTrace(std::ostream& output, const std::vector<TraceEvent>& events);
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            TraceEvent event;
+        };
+
+        Tracer();
+
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        /// Moves the events of the ring to m_events. Called by one thread at a time.
+        void drain();
+        void drainLoop();
+
+        std::unique_ptr<Cell[]> m_ring;
+        std::size_t m_mask = 0;
+        std::atomic<std::size_t> m_writePosition;
+        std::size_t m_readPosition = 0;
+
+        std::atomic<bool> m_recording;
+        std::atomic<std::uint64_t> m_dropped;
+        std::uint64_t m_epoch = 0; //< Clock value of the start, in nanoseconds
+
+        std::mutex m_mutex; //< Guards m_events and the start and stop of the drain thread
+        std::vector<TraceEvent> m_events;
+        std::thread m_drainThread;
+        std::atomic<bool> m_stopDrain;
+    };
+
+    /// Records a Begin event when created and an End event when destroyed
+    class TraceScope {
+    public:
+        TraceScope(const char* category, const char* name) noexcept
+            : m_category(category)
+            , m_name(name) {
+            Tracer::get().record(TraceEventType::Begin, m_category, m_name);
+        }
+
+        ~TraceScope() {
+            Tracer::get().record(TraceEventType::End, m_category, m_name);
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+        const char* m_category;
+        const char* m_name;
+    };
+}
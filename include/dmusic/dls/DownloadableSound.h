@@ -47,6 +47,7 @@ namespace DirectMusic {
             const std::vector<Instrument>& getInstruments() const { return m_instruments; }
             const std::vector<std::uint32_t>& getPoolOffsets() const { return m_poolOffsets; }
             std::vector<Wave>& getWavePool() { return m_wavePool; }
+            const std::vector<Wave>& getWavePool() const { return m_wavePool; }
             const DirectMusic::Riff::Info& getInfo() const { return m_info; }
             const GUID& getGuid() const { return m_dlsid; }
 
@@ -30,8 +30,8 @@ namespace DirectMusic {
             const RegionHeader& getRegionHeader() const { return m_rgnHeader; }
             const WaveLink& getWaveLink() const { return m_waveLink; }
             const Wavesample& getWavesample() const { return m_wavesample; }
-            const std::vector<Articulator> getArticulators() const { return m_articulators; }
-            const std::vector<WavesampleLoop> getWavesampleLoops() const { return m_loops; }
+            const std::vector<Articulator>& getArticulators() const { return m_articulators; }
+            const std::vector<WavesampleLoop>& getWavesampleLoops() const { return m_loops; }
         private:
             RegionHeader m_rgnHeader;
             WaveLink m_waveLink;
@@ -0,0 +1,266 @@
+#include <dmusic/AllocationCheck.h>
+#include "AllocationHooks.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if DMUSIC_ALLOCATION_CHECK && (defined(__GLIBC__) || defined(__APPLE__))
+#include <cxxabi.h>
+#include <execinfo.h>
+#define DMUSIC_BACKTRACE 1
+#endif
+
+using namespace DirectMusic;
+
+#if DMUSIC_ALLOCATION_CHECK
+static const std::size_t MaxSites = 256;
+static const int MaxFrames = 24;
+
+struct Site {
+    void* frames[MaxFrames];
+    int depth;
+    std::uint64_t count, bytes;
+};
+
+// Sites are recorded into a fixed table, as the hook must not allocate itself
+static Site s_sites[MaxSites];
+static std::size_t s_siteCount = 0;
+static std::atomic_flag s_sitesLock = ATOMIC_FLAG_INIT;
+
+static std::atomic<bool> s_recording(false);
+static std::atomic<bool> s_abort(false);
+static std::atomic<std::uint64_t> s_count(0);
+static std::atomic<std::uint64_t> s_totalCount(0);
+
+static thread_local int t_realtimeDepth = 0;
+static thread_local bool t_inHook = false;
+
+static void onAllocation(std::size_t size) noexcept {
+    s_totalCount.fetch_add(1, std::memory_order_relaxed);
+    if (t_realtimeDepth == 0 || t_inHook || !s_recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    t_inHook = true;
+    s_count.fetch_add(1, std::memory_order_relaxed);
+
+    Site site;
+    site.depth = 0;
+#if DMUSIC_BACKTRACE
+    site.depth = backtrace(site.frames, MaxFrames);
+#endif
+
+    if (s_abort.load(std::memory_order_relaxed)) {
+        std::fputs("libdmusic: memory allocated while rendering\n", stderr);
+#if DMUSIC_BACKTRACE
+        backtrace_symbols_fd(site.frames, site.depth, 2);
+#endif
+        std::abort();
+    }
+
+    while (s_sitesLock.test_and_set(std::memory_order_acquire)) {}
+    Site* existing = nullptr;
+    for (std::size_t i = 0; i < s_siteCount; i++) {
+        if (s_sites[i].depth == site.depth && std::memcmp(s_sites[i].frames, site.frames, site.depth * sizeof(void*)) == 0) {
+            existing = &s_sites[i];
+            break;
+        }
+    }
+    if (existing == nullptr && s_siteCount < MaxSites) {
+        existing = &s_sites[s_siteCount++];
+        *existing = site;
+        existing->count = 0;
+        existing->bytes = 0;
+    }
+    if (existing != nullptr) {
+        existing->count++;
+        existing->bytes += size;
+    }
+    s_sitesLock.clear(std::memory_order_release);
+
+    t_inHook = false;
+}
+
+#if DMUSIC_BACKTRACE
+// Turns "binary(_ZN4name+0x10) [0x1234]" into "name+0x10 (binary)"
+static std::string describeFrame(const char* symbol) {
+    std::string text(symbol);
+    std::size_t open = text.find('('), plus = text.find('+', open), close = text.find(')', open);
+    if (open == std::string::npos || plus == std::string::npos || close == std::string::npos || plus == open + 1) {
+        return text;
+    }
+
+    std::string mangled = text.substr(open + 1, plus - open - 1);
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+    std::string name = status == 0 && demangled != nullptr ? demangled : mangled;
+    std::free(demangled);
+    return name + text.substr(plus, close - plus) + " (" + text.substr(0, open) + ")";
+}
+
+// Frames of the hook itself, which are left out of the reports
+static bool isHookFrame(const std::string& frame) {
+    return frame.compare(0, 13, "operator new(") == 0 || frame.compare(0, 15, "operator new[](") == 0
+        || frame.find("DirectMusic::checked") == 0;
+}
+#endif
+
+bool AllocationCheck::isAvailable() noexcept {
+    return true;
+}
+
+void AllocationCheck::start(bool abortOnAllocation) {
+#if DMUSIC_BACKTRACE
+    // The first call loads the unwinder, which allocates
+    void* frames[1];
+    backtrace(frames, 1);
+#endif
+    while (s_sitesLock.test_and_set(std::memory_order_acquire)) {}
+    s_siteCount = 0;
+    s_sitesLock.clear(std::memory_order_release);
+
+    s_count.store(0, std::memory_order_relaxed);
+    s_abort.store(abortOnAllocation, std::memory_order_relaxed);
+    s_recording.store(true, std::memory_order_release);
+}
+
+void AllocationCheck::stop() noexcept {
+    s_recording.store(false, std::memory_order_release);
+}
+
+std::uint64_t AllocationCheck::getCount() noexcept {
+    return s_count.load(std::memory_order_relaxed);
+}
+
+std::uint64_t AllocationCheck::getTotalCount() noexcept {
+    return s_totalCount.load(std::memory_order_relaxed);
+}
+
+std::vector<AllocationSite> AllocationCheck::getSites() {
+    std::vector<Site> sites;
+    while (s_sitesLock.test_and_set(std::memory_order_acquire)) {}
+    sites.assign(s_sites, s_sites + s_siteCount);
+    s_sitesLock.clear(std::memory_order_release);
+
+    std::vector<AllocationSite> result;
+    for (const auto& site : sites) {
+        AllocationSite entry;
+        entry.count = site.count;
+        entry.bytes = site.bytes;
+#if DMUSIC_BACKTRACE
+        char** symbols = backtrace_symbols(site.frames, site.depth);
+        if (symbols != nullptr) {
+            for (int i = 0; i < site.depth; i++) {
+                entry.frames.push_back(describeFrame(symbols[i]));
+            }
+            std::free(symbols);
+        }
+
+        auto lastHookFrame = std::find_if(entry.frames.rbegin(), entry.frames.rend(), isHookFrame);
+        if (lastHookFrame != entry.frames.rend()) {
+            entry.frames.erase(entry.frames.begin(), lastHookFrame.base());
+        }
+#endif
+        result.push_back(entry);
+    }
+
+    std::sort(result.begin(), result.end(), [](const AllocationSite& a, const AllocationSite& b) {
+        return a.count > b.count;
+    });
+    return result;
+}
+
+void AllocationCheck::enterRealtime() noexcept {
+    t_realtimeDepth++;
+}
+
+void AllocationCheck::leaveRealtime() noexcept {
+    t_realtimeDepth--;
+}
+
+void* DirectMusic::checkedMalloc(std::size_t size) noexcept {
+    onAllocation(size);
+    return std::malloc(size);
+}
+
+void* DirectMusic::checkedRealloc(void* ptr, std::size_t size) noexcept {
+    onAllocation(size);
+    return std::realloc(ptr, size);
+}
+
+static void* allocate(std::size_t size) {
+    onAllocation(size);
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    onAllocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    onAllocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+#else
+bool AllocationCheck::isAvailable() noexcept {
+    return false;
+}
+
+void AllocationCheck::start(bool) {}
+void AllocationCheck::stop() noexcept {}
+
+std::uint64_t AllocationCheck::getCount() noexcept {
+    return 0;
+}
+
+std::uint64_t AllocationCheck::getTotalCount() noexcept {
+    return 0;
+}
+
+std::vector<AllocationSite> AllocationCheck::getSites() {
+    return std::vector<AllocationSite>();
+}
+
+void AllocationCheck::enterRealtime() noexcept {}
+void AllocationCheck::leaveRealtime() noexcept {}
+#endif
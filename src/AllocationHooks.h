@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+namespace DirectMusic {
+    // malloc and realloc, recorded by the allocation check like operator new.
+    // Only defined when the library is built with DMUSIC_ALLOCATION_CHECK.
+    void* checkedMalloc(std::size_t size) noexcept;
+    void* checkedRealloc(void* ptr, std::size_t size) noexcept;
+}
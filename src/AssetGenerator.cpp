@@ -0,0 +1,432 @@
+#include <dmusic/AssetGenerator.h>
+#include <dmusic/AssetStore.h>
+#include <dmusic/Structs.h>
+#include <dmusic/Enums.h>
+#include <dmusic/Midi.h>
+#include <dmusic/PlayingContext.h>
+#include <dmusic/dls/DlsCommon.h>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+
+using namespace DirectMusic;
+using namespace DirectMusic::DLS;
+
+using Bytes = std::vector<std::uint8_t>;
+
+static const std::uint32_t GridsPerBeat = 4;
+static const std::uint32_t MeasureLength = PlayingContext::PulsesPerQuarterNote * 4;
+static const std::uint32_t GridLength = PlayingContext::PulsesPerQuarterNote / GridsPerBeat;
+
+// The structures are packed and read with their own layout, so their bytes are
+// exactly what is stored in the files
+template<typename T>
+static Bytes bytes(const T& value) {
+    Bytes data(sizeof(T));
+    std::memcpy(data.data(), &value, sizeof(T));
+    return data;
+}
+
+// The structures have no default values
+template<typename T>
+static T zeroed() {
+    T value;
+    std::memset((void*)&value, 0, sizeof(T));
+    return value;
+}
+
+static void append(Bytes& data, const Bytes& part) {
+    data.insert(data.end(), part.begin(), part.end());
+}
+
+static Bytes chunk(const char* id, const Bytes& data) {
+    std::uint32_t size = (std::uint32_t)data.size();
+    Bytes output(id, id + 4);
+    append(output, bytes(size));
+    append(output, data);
+    if (size % 2 == 1) {
+        output.push_back(0);
+    }
+    return output;
+}
+
+// A RIFF or LIST chunk
+static Bytes list(const char* id, const char* listId, std::initializer_list<Bytes> subchunks) {
+    Bytes data(listId, listId + 4);
+    for (const auto& subchunk : subchunks) {
+        append(data, subchunk);
+    }
+    return chunk(id, data);
+}
+
+static Bytes utf16(const std::string& text) {
+    Bytes data;
+    for (char c : text) {
+        data.push_back((std::uint8_t)c);
+        data.push_back(0);
+    }
+    data.push_back(0);
+    data.push_back(0);
+    return data;
+}
+
+// A chunk made of the size of T followed by the items
+template<typename T>
+static Bytes structArray(const std::vector<T>& items) {
+    Bytes data = bytes((std::uint32_t)sizeof(T));
+    for (const auto& item : items) {
+        append(data, bytes(item));
+    }
+    return data;
+}
+
+static Bytes reference(const GUID& guid, const std::string& file) {
+    return list("LIST", "DMRF", {
+        chunk("refh", bytes(zeroed<DMUS_IO_REFERENCE>())),
+        chunk("guid", bytes(guid)),
+        chunk("file", utf16(file))
+    });
+}
+
+static DMUS_IO_TIMESIG commonTime() {
+    auto timeSig = zeroed<DMUS_IO_TIMESIG>();
+    timeSig.bBeatsPerMeasure = 4;
+    timeSig.bBeat = 4;
+    timeSig.wGridsPerBeat = GridsPerBeat;
+    return timeSig;
+}
+
+// A band assigning the instruments `first` to `first + parts - 1` (modulo `instruments`)
+// of a collection to performance channels 0 to `parts - 1`
+static Bytes band(const GUID& guid, std::uint32_t parts, std::uint32_t first, std::uint32_t instruments,
+    const GUID& collectionGuid, const std::string& collectionFile) {
+    Bytes bandInstruments;
+    for (std::uint32_t p = 0; p < parts; p++) {
+        auto instrument = zeroed<DMUS_IO_INSTRUMENT>();
+        instrument.dwPatch = instruments > 0 ? (first + p) % instruments : 0;
+        instrument.dwPChannel = p;
+        instrument.bVolume = 100;
+        instrument.bPan = (std::uint8_t)(p * 127 / (parts > 1 ? parts - 1 : 1));
+        append(bandInstruments, list("LIST", "lbin", { chunk("bins", bytes(instrument)), reference(collectionGuid, collectionFile) }));
+    }
+
+    Bytes instrumentList(4);
+    std::memcpy(instrumentList.data(), "lbil", 4);
+    append(instrumentList, bandInstruments);
+    return list("RIFF", "DMBD", { chunk("guid", bytes(guid)), chunk("LIST", instrumentList) });
+}
+
+GUID AssetGenerator::makeGuid(std::uint32_t id) {
+    GUID guid;
+    guid.Data1 = id;
+    guid.Data2 = 0xD115;
+    guid.Data3 = 0xBE7C;
+    guid.Data4 = 0x0123456789ABCDEFull;
+    return guid;
+}
+
+std::shared_ptr<AssetStore> AssetGenerator::createStore(std::map<std::string, Bytes> files) {
+    auto shared = std::make_shared<const std::map<std::string, Bytes>>(std::move(files));
+    return std::make_shared<AssetStore>([shared](const std::string& file) {
+        auto it = shared->find(file);
+        return it != shared->end() ? it->second : Bytes();
+    });
+}
+
+std::vector<std::uint8_t> AssetGenerator::generateCollection(const CollectionSettings& settings) {
+    if (settings.bitsPerSample != 8 && settings.bitsPerSample != 16 && settings.bitsPerSample != 32) {
+        throw std::invalid_argument("Invalid number of bits per sample");
+    }
+    if (settings.waves == 0 || settings.waveFrames < 2) {
+        throw std::invalid_argument("Invalid wave pool");
+    }
+
+    auto wavesample = zeroed<Wavesample>();
+    wavesample.cbSize = sizeof(Wavesample);
+    wavesample.usUnityNote = 57;
+    wavesample.cSampleLoops = settings.looped ? 1 : 0;
+    auto loop = zeroed<WavesampleLoop>();
+    loop.cbSize = sizeof(WavesampleLoop);
+    loop.ulLoopLength = settings.waveFrames;
+    Bytes wsmpData = bytes(wavesample);
+    if (settings.looped) {
+        append(wsmpData, bytes(loop));
+    }
+    Bytes wsmp = chunk("wsmp", wsmpData);
+
+    auto format = zeroed<WaveFormatEx>();
+    format.wFormatTag = settings.bitsPerSample == 32 ? WaveFormatTag::IEEE_FLOAT : WaveFormatTag::PCM;
+    format.wChannels = 1;
+    format.dwSamplesPerSec = settings.sampleRate;
+    format.wBlockAlign = settings.bitsPerSample / 8;
+    format.dwAvgBytesPerSec = settings.sampleRate * format.wBlockAlign;
+    format.wBitsPerSample = settings.bitsPerSample;
+
+    // Every wave is a few periods of a sine with its own harmonics, near A3 (220 Hz)
+    Bytes wavePool(4);
+    std::memcpy(wavePool.data(), "wvpl", 4);
+    for (std::uint32_t w = 0; w < settings.waves; w++) {
+        Bytes data;
+        double frequency = 220.0 * settings.sampleRate / 44100;
+        for (std::uint32_t i = 0; i < settings.waveFrames; i++) {
+            double phase = 2 * 3.14159265358979 * frequency * i / settings.sampleRate;
+            double value = 0.4 * std::sin(phase) + 0.1 * std::sin(phase * (2 + w % 4));
+            if (settings.bitsPerSample == 8) {
+                data.push_back((std::uint8_t)(128 + value * 127));
+            } else if (settings.bitsPerSample == 16) {
+                append(data, bytes((std::int16_t)(value * 32767)));
+            } else {
+                append(data, bytes((float)value));
+            }
+        }
+        append(wavePool, list("LIST", "wave", { chunk("fmt ", bytes(format)), wsmp, chunk("data", data) }));
+    }
+
+    Bytes instruments(4);
+    std::memcpy(instruments.data(), "lins", 4);
+    for (std::uint32_t i = 0; i < settings.instruments; i++) {
+        auto header = zeroed<InstrumentHeader>();
+        header.cRegions = 1;
+        header.Locale.ulInstrument = i;
+
+        auto region = zeroed<RegionHeader>();
+        region.RangeKey.usHigh = 127;
+        region.RangeVelocity.usHigh = 127;
+
+        auto waveLink = zeroed<WaveLink>();
+        waveLink.ulTableIndex = i % settings.waves;
+
+        append(instruments, list("LIST", "ins ", {
+            chunk("insh", bytes(header)),
+            list("LIST", "lrgn", {
+                list("LIST", "rgn ", { chunk("rgnh", bytes(region)), wsmp, chunk("wlnk", bytes(waveLink)) })
+            })
+        }));
+    }
+
+    return list("RIFF", "DLS ", {
+        chunk("colh", bytes(settings.instruments)),
+        chunk("dlid", bytes(makeGuid(settings.id))),
+        chunk("LIST", instruments),
+        chunk("LIST", wavePool)
+    });
+}
+
+// Intervals of the notes of a fixed chord from its lowest one
+static const std::uint32_t ChordIntervals[] = { 0, 4, 7, 12, 16, 19, 24, 28, 31, 36 };
+
+std::vector<std::uint8_t> AssetGenerator::generateStyle(const StyleSettings& settings) {
+    if (settings.notesPerMeasure > MeasureLength || settings.curvesPerMeasure > MeasureLength) {
+        throw std::invalid_argument("Too many events per measure");
+    }
+
+    const DMUS_IO_TIMESIG timeSig = commonTime();
+    const std::uint32_t onsets = settings.patternMeasures * settings.notesPerMeasure;
+    const std::uint32_t curves = settings.patternMeasures * settings.curvesPerMeasure;
+    const DMUS_PLAYMODE_FLAGS playMode = settings.chordRelative
+        ? (DMUS_PLAYMODE_FLAGS)(DMUS_PLAYMODE_CHORD_ROOT | DMUS_PLAYMODE_CHORD_INTERVALS)
+        : DMUS_PLAYMODE_FIXED;
+
+    auto header = zeroed<DMUS_IO_STYLE>();
+    header.timeSig = timeSig;
+    header.dblTempo = settings.tempo;
+
+    Bytes style(4);
+    std::memcpy(style.data(), "DMST", 4);
+    append(style, chunk("styh", bytes(header)));
+    append(style, chunk("guid", bytes(makeGuid(settings.id))));
+
+    // Every pattern has its own parts
+    for (std::uint32_t t = 0; t < settings.patterns; t++) {
+        Bytes partRefs;
+        for (std::uint32_t p = 0; p < settings.parts; p++) {
+            auto part = zeroed<DMUS_IO_STYLEPART>();
+            part.timeSig = timeSig;
+            part.dwVariationChoices[0] = 0x0FFFFFFF;
+            part.guidPartID = makeGuid(0x10000 + t * settings.parts + p);
+            part.wNbrMeasures = settings.patternMeasures;
+            part.bPlayModeFlags = playMode;
+
+            std::vector<DMUS_IO_STYLENOTE> notes;
+            for (std::uint32_t k = 0; k < onsets; k++) {
+                std::uint32_t time = k * MeasureLength / settings.notesPerMeasure;
+                for (std::uint32_t n = 0; n < settings.chordSize; n++) {
+                    auto note = zeroed<DMUS_IO_STYLENOTE>();
+                    note.mtGridStart = time / GridLength;
+                    note.nTimeOffset = (std::int16_t)(time % GridLength);
+                    note.dwVariation = 0xFFFFFFFF;
+                    note.mtDuration = std::max<std::uint32_t>(MeasureLength / settings.notesPerMeasure, 1);
+                    note.bVelocity = (std::uint8_t)(80 + (k * 7 + n) % 40);
+                    note.bPlayModeFlags = playMode;
+                    if (settings.chordRelative) {
+                        // Octave in the first nibble, chord tone in the second
+                        note.wMusicValue = (std::uint16_t)(((3 + n / 3) << 12) | ((n % 3) << 8));
+                    } else {
+                        std::uint32_t root = 36 + (p * 5 + k * 7 + t * 2) % 24;
+                        std::uint32_t interval = ChordIntervals[n % 10] + 36 * (n / 10);
+                        note.wMusicValue = (std::uint16_t)std::min<std::uint32_t>(root + interval, 127);
+                    }
+                    notes.push_back(note);
+                }
+            }
+
+            std::vector<DMUS_IO_STYLECURVE> partCurves;
+            for (std::uint32_t c = 0; c < curves; c++) {
+                std::uint32_t time = c * MeasureLength / settings.curvesPerMeasure;
+                auto curve = zeroed<DMUS_IO_STYLECURVE>();
+                curve.mtGridStart = time / GridLength;
+                curve.nTimeOffset = (std::uint16_t)(time % GridLength);
+                curve.dwVariation = 0xFFFFFFFF;
+                curve.mtDuration = MeasureLength / settings.curvesPerMeasure;
+                curve.nStartValue = 127;
+                curve.nEndValue = 64;
+                curve.bEventType = DMUS_CURVET_CCCURVE;
+                curve.bCurveShape = (std::uint8_t)(c % 5);
+                curve.bCCData = (std::uint8_t)DirectMusic::Midi::Control::ExpressionCtl;
+                partCurves.push_back(curve);
+            }
+
+            append(style, list("LIST", "part", {
+                chunk("prth", bytes(part)),
+                chunk("note", structArray(notes)),
+                chunk("crve", structArray(partCurves))
+            }));
+
+            auto partRef = zeroed<DMUS_IO_PARTREF>();
+            partRef.guidPartID = part.guidPartID;
+            partRef.wLogicalPartID = (std::uint16_t)p;
+            partRef.dwPChannel = p;
+            append(partRefs, list("LIST", "pref", { chunk("prfc", bytes(partRef)) }));
+        }
+
+        auto pattern = zeroed<DMUS_IO_PATTERN>();
+        pattern.timeSig = timeSig;
+        pattern.bGrooveBottom = 1;
+        pattern.bGrooveTop = 100;
+        pattern.bDestGrooveBottom = 1;
+        pattern.bDestGrooveTop = 100;
+        pattern.wNbrMeasures = settings.patternMeasures;
+
+        Bytes patternData(4);
+        std::memcpy(patternData.data(), "pttn", 4);
+        append(patternData, chunk("ptnh", bytes(pattern)));
+        append(patternData, partRefs);
+        append(style, chunk("LIST", patternData));
+    }
+
+    append(style, band(makeGuid(0x20000 + settings.id), settings.parts, 0, settings.collectionInstruments,
+        makeGuid(settings.collectionId), settings.collectionFile));
+
+    return chunk("RIFF", style);
+}
+
+std::vector<std::uint8_t> AssetGenerator::generateSegment(const SegmentSettings& settings) {
+    const std::uint32_t length = settings.measures * MeasureLength;
+
+    auto header = zeroed<DMUS_IO_SEGMENT_HEADER>();
+    header.mtLength = length;
+
+    Bytes tracks(4);
+    std::memcpy(tracks.data(), "trkl", 4);
+
+    // Style track
+    auto styleHeader = zeroed<DMUS_IO_TRACK_HEADER>();
+    std::memcpy(styleHeader.fccType, "sttr", 4);
+    append(tracks, list("RIFF", "DMTK", {
+        chunk("trkh", bytes(styleHeader)),
+        list("LIST", "sttr", {
+            list("LIST", "strf", {
+                chunk("stmp", bytes(std::uint16_t(0))),
+                reference(makeGuid(settings.styleId), settings.styleFile)
+            })
+        })
+    }));
+
+    // Command track, setting the groove level which starts the patterns
+    auto commandHeader = zeroed<DMUS_IO_TRACK_HEADER>();
+    std::memcpy(commandHeader.ckid, "cmnd", 4);
+    auto command = zeroed<DMUS_IO_COMMAND>();
+    command.bCommand = DMUS_COMMANDT_TYPES::DMUS_COMMANDT_GROOVE;
+    command.bGrooveLevel = settings.grooveLevel;
+    append(tracks, list("RIFF", "DMTK", {
+        chunk("trkh", bytes(commandHeader)),
+        chunk("cmnd", structArray(std::vector<DMUS_IO_COMMAND>{ command }))
+    }));
+
+    if (settings.chordChanges > 0) {
+        auto chordHeader = zeroed<DMUS_IO_TRACK_HEADER>();
+        std::memcpy(chordHeader.fccType, "cord", 4);
+
+        Bytes chords(4);
+        std::memcpy(chords.data(), "cord", 4);
+        // The root of the chords: C, with the default subchord
+        append(chords, chunk("crdh", bytes(std::uint32_t(0x0C000000))));
+        for (std::uint32_t i = 0; i < settings.chordChanges; i++) {
+            auto chord = zeroed<DMUS_IO_CHORD>();
+            chord.mtTime = i * length / settings.chordChanges;
+            chord.wMeasure = (std::uint16_t)(chord.mtTime / MeasureLength);
+
+            // Alternates between major and minor triads
+            auto subchord = zeroed<DMUS_IO_SUBCHORD>();
+            subchord.dwChordPattern = i % 2 == 0 ? 0x00000091 : 0x00000089;
+            subchord.dwScalePattern = 0x00AB5AB5;
+            subchord.dwInversionPoints = 0xFFFFFFFF;
+            subchord.dwLevels = 1;
+            subchord.bChordRoot = 12;
+
+            Bytes data = bytes((std::uint32_t)sizeof(DMUS_IO_CHORD));
+            append(data, bytes(chord));
+            append(data, bytes(std::uint32_t(1)));
+            append(data, bytes((std::uint32_t)sizeof(DMUS_IO_SUBCHORD)));
+            append(data, bytes(subchord));
+            append(chords, chunk("crdb", data));
+        }
+
+        append(tracks, list("RIFF", "DMTK", { chunk("trkh", bytes(chordHeader)), chunk("LIST", chords) }));
+    }
+
+    if (settings.tempoChanges > 0) {
+        auto tempoHeader = zeroed<DMUS_IO_TRACK_HEADER>();
+        std::memcpy(tempoHeader.ckid, "tetr", 4);
+
+        std::vector<DMUS_IO_TEMPO_ITEM> items;
+        for (std::uint32_t i = 0; i < settings.tempoChanges; i++) {
+            auto item = zeroed<DMUS_IO_TEMPO_ITEM>();
+            item.lTime = i * length / settings.tempoChanges;
+            item.dblTempo = 90 + 30 * (i % 3);
+            items.push_back(item);
+        }
+
+        append(tracks, list("RIFF", "DMTK", { chunk("trkh", bytes(tempoHeader)), chunk("tetr", structArray(items)) }));
+    }
+
+    if (settings.bandChanges > 0) {
+        auto bandHeader = zeroed<DMUS_IO_TRACK_HEADER>();
+        std::memcpy(bandHeader.fccType, "DMBT", 4);
+
+        Bytes bands(4);
+        std::memcpy(bands.data(), "lbdl", 4);
+        for (std::uint32_t i = 0; i < settings.bandChanges; i++) {
+            auto item = zeroed<DMUS_IO_BAND_ITEM_HEADER2>();
+            item.lBandTimeLogical = i * length / settings.bandChanges;
+            item.lBandTimePhysical = item.lBandTimeLogical;
+            append(bands, list("LIST", "lbnd", {
+                chunk("bd2h", bytes(item)),
+                band(makeGuid(0x30000 + settings.id * 0x100 + i), settings.bandParts, i, settings.collectionInstruments,
+                    makeGuid(settings.collectionId), settings.collectionFile)
+            }));
+        }
+
+        append(tracks, list("RIFF", "DMTK", {
+            chunk("trkh", bytes(bandHeader)),
+            list("RIFF", "DMBT", { chunk("bdth", bytes(zeroed<DMUS_IO_BAND_TRACK_HEADER>())), chunk("LIST", bands) })
+        }));
+    }
+
+    return list("RIFF", "DMSG", {
+        chunk("segh", bytes(header)),
+        chunk("guid", bytes(makeGuid(settings.id))),
+        chunk("LIST", tracks)
+    });
+}
@@ -0,0 +1,139 @@
+#include <dmusic/AssetStore.h>
+#include <dmusic/Trace.h>
+#include "MemoryAccounting.h"
+#include <fstream>
+#include <stdexcept>
+
+using namespace DirectMusic;
+
+template<typename T>
+static std::shared_ptr<T> genObjFromChunkData(const std::vector<std::uint8_t>& data) {
+    if (data.empty()) return nullptr;
+    DirectMusic::Riff::Chunk c(data.data());
+    return std::make_shared<T>(c);
+}
+
+static std::vector<std::uint8_t> loadFile(const std::string& file) {
+    std::ifstream inputStream(file, std::ios::binary | std::ios::ate);
+    if (!inputStream.is_open()) {
+        return std::vector<std::uint8_t>();
+    }
+    std::vector<std::uint8_t> buffer(inputStream.tellg());
+    inputStream.seekg(0);
+    inputStream.read((char*)buffer.data(), buffer.size());
+    inputStream.close();
+    return buffer;
+}
+
+AssetStore::AssetStore()
+    : m_loader(loadFile) {}
+
+AssetStore::AssetStore(AssetLoader loader)
+    : m_loader(std::move(loader)) {}
+
+AssetStore::~AssetStore() {
+    trackMemory(MemoryCategory::Collections, -(std::int64_t)m_collectionBytes);
+    trackMemory(MemoryCategory::Styles, -(std::int64_t)m_styleBytes);
+}
+
+void AssetStore::setLoader(AssetLoader loader) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_loader = std::move(loader);
+}
+
+std::vector<std::uint8_t> AssetStore::load(const std::string& file) const {
+    AssetLoader loader;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        loader = m_loader;
+    }
+    return loader(file);
+}
+
+std::shared_ptr<DirectMusic::DLS::DownloadableSound> AssetStore::loadInstrumentCollection(const GUID& guid, const GUID& bandGuid, const std::string& file) {
+    std::shared_ptr<DirectMusic::DLS::DownloadableSound> band = nullptr;
+    GUID id = guid ^ bandGuid;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_bands.find(id) != m_bands.end()) {
+            TRACE("Band found in cache");
+            return m_bands.at(id);
+        }
+    }
+
+    // Loaded without holding the lock, so that several loads can run at once
+    TRACE_SCOPE("load", "Load collection");
+    std::vector<std::uint8_t> data = load(file);
+    band = genObjFromChunkData<DirectMusic::DLS::DownloadableSound>(data);
+
+    if (band == nullptr) {
+        throw std::runtime_error("Couldn't load band: " + file);
+    }
+
+    std::size_t bytes = estimateMemoryUsage(*band);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_bands.emplace(id, band);
+    if (entry.second) {
+        m_collectionBytes += bytes;
+        trackMemory(MemoryCategory::Collections, (std::int64_t)bytes);
+    }
+    return entry.first->second;
+}
+
+std::shared_ptr<StyleForm> AssetStore::loadStyle(const GUID& guid, const std::string& file) {
+    std::shared_ptr<StyleForm> style = nullptr;
+    auto key = std::make_pair(guid, file);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_styles.find(key) != m_styles.end()) {
+            TRACE("Style found in cache");
+            return m_styles.at(key);
+        }
+    }
+
+    TRACE_SCOPE("load", "Load style");
+    std::vector<std::uint8_t> data = load(file);
+    style = genObjFromChunkData<StyleForm>(data);
+
+    if (style == nullptr) {
+        throw std::runtime_error("Couldn't load style: " + file);
+    }
+
+    std::size_t bytes = estimateMemoryUsage(*style);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_styles.emplace(key, style);
+    if (entry.second) {
+        m_styleBytes += bytes;
+        trackMemory(MemoryCategory::Styles, (std::int64_t)bytes);
+    }
+    return entry.first->second;
+}
+
+MemoryUsage AssetStore::getMemoryUsage(std::vector<AssetMemoryUsage>* assets) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MemoryUsage usage;
+    usage.collections = m_collectionBytes;
+    usage.styles = m_styleBytes;
+
+    if (assets != nullptr) {
+        for (const auto& band : m_bands) {
+            AssetMemoryUsage asset;
+            asset.type = AssetType::Collection;
+            asset.guid = band.second->getGuid();
+            asset.name = band.second->getInfo().getName();
+            asset.bytes = estimateMemoryUsage(*band.second);
+            assets->push_back(asset);
+        }
+        for (const auto& style : m_styles) {
+            AssetMemoryUsage asset;
+            asset.type = AssetType::Style;
+            asset.guid = style.second->getGuid();
+            asset.name = style.second->getInfo().getName();
+            asset.bytes = estimateMemoryUsage(*style.second);
+            assets->push_back(asset);
+        }
+    }
+    return usage;
+}
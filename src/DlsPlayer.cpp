@@ -1,17 +1,33 @@
 #include <dmusic/DlsPlayer.h>
+#include <dmusic/PlayingContext.h>
+#include <dmusic/Trace.h>
 #include <exception>
 #include <memory>
 #include <cmath>
 #include <sstream>
+#include <future>
+#include <mutex>
 #include <sf2cute.hpp>
 #include "decode.h"
+#include "MemoryAccounting.h"
+#if DMUSIC_FAST_MATH
+#define TSF_FASTMATH
+#endif
+#if DMUSIC_ALLOCATION_CHECK
+#include <cstdlib>
+#include "AllocationHooks.h"
+#define TSF_MALLOC DirectMusic::checkedMalloc
+#define TSF_REALLOC DirectMusic::checkedRealloc
+#define TSF_FREE free
+#endif
 #define TSF_IMPLEMENTATION
 #include "../utils/common/tsf.hxx"
 using namespace DirectMusic;
 using namespace DirectMusic::DLS;
 using namespace sf2cute;
 
-std::unordered_map<DownloadableSound, std::shared_ptr<TinySoundFont>> DlsPlayer::m_soundfonts;
+std::unordered_map<DownloadableSound, std::shared_future<std::shared_ptr<TinySoundFont>>> DlsPlayer::m_soundfonts;
+std::mutex DlsPlayer::m_soundfontsMutex;
 
 static double dwordTimecentsToSeconds(std::int32_t tc) {
     return exp2((double)tc / (1200.0 * 65536.0));
@@ -57,21 +73,37 @@ static void insertArticulator(const DLS::Articulator& articulator, std::vector<S
     }
 }
 
-static std::shared_ptr<TinySoundFont> convertCollection(DirectMusic::DLS::DownloadableSound& dls) {
+static std::shared_ptr<TinySoundFont> convertCollection(DirectMusic::DLS::DownloadableSound& dls, Scheduler& scheduler) {
+    TRACE_SCOPE("load", "Convert collection");
     std::vector<SFSample> samples;
     SoundFont sf2;
 
     auto& wavePool = dls.getWavePool();
 
-    while(!wavePool.empty()) {
+    // DLS lev. 1 only supports PCM16 samples, but
+    // we need to load encoded samples as well, so
+    // we make libsndfile take care of that
+    std::vector<std::vector<std::int16_t>> decoded(wavePool.size());
+    std::exception_ptr decodeError = nullptr;
+    std::mutex decodeErrorMutex;
+    scheduler.parallelFor(wavePool.size(), [&](std::size_t i) {
+        try {
+            decoded[i] = decode(wavePool[i]);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(decodeErrorMutex);
+            decodeError = std::current_exception();
+        }
+    });
+
+    if (decodeError != nullptr) {
+        std::rethrow_exception(decodeError);
+    }
+
+    for (std::size_t i = 0; !wavePool.empty(); i++) {
         auto& wav = wavePool[0];
         std::string name = wav.getInfo().getName();
         auto fmt = wav.getWaveformat();
-
-        // DLS lev. 1 only supports PCM16 samples, but
-        // we need to load encoded samples as well, so
-        // we make libsndfile take care of that
-        std::vector<std::int16_t> audioData = decode(wav);
+        std::vector<std::int16_t> audioData = std::move(decoded[i]);
 
         if (audioData.empty()) {
             throw std::runtime_error("Invalid sample format for " + name);
@@ -99,7 +131,7 @@ static std::shared_ptr<TinySoundFont> convertCollection(DirectMusic::DLS::Downlo
         fineTune = wavsmpl.sFineTune;
 
         samples.push_back(SFSample(name,
-            audioData,
+            std::move(audioData),
             startLoop, endLoop,
             fmt.dwSamplesPerSec,
             midiNote,
@@ -177,7 +209,12 @@ static std::shared_ptr<TinySoundFont> convertCollection(DirectMusic::DLS::Downlo
 }
 
 static float gainToDecibels(float gain) {
+#if DMUSIC_FAST_MATH
+    // 10 * log10(2) * log2(gain)
+    return 3.01029996f * tsf_fast_log2f(gain);
+#else
     return 10 * log10(gain);
+#endif
 }
 
 DlsPlayer::DlsPlayer(std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patch,
@@ -186,27 +223,63 @@ DlsPlayer::DlsPlayer(std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patc
     std::uint32_t sampleRate,
     std::uint32_t channels,
     float volume,
-    float pan)
+    float pan,
+    const DlsPlayerSettings& settings,
+    const std::shared_ptr<tsf_voice_budget>& voiceBudget)
     : InstrumentPlayer(bankLo, bankHi, patch, dls, sampleRate, channels, volume, pan)
+    , m_voiceBudget(voiceBudget)
     , m_soundfont(nullptr) {
     if (channels > 2) {
         throw std::runtime_error("Invalid number of channels");
     }
-    std::shared_ptr<TinySoundFont> soundfont;
-    if (m_soundfonts.find(dls) == m_soundfonts.end()) {
-        soundfont = convertCollection(dls);
-        TSFOutputMode outputMode = m_channels == 1 ? TSF_MONO : TSF_STEREO_INTERLEAVED;
-        soundfont->setOutput(outputMode, sampleRate);
-
-        m_soundfonts[dls] = soundfont;
-    } else {
-        soundfont = std::make_shared<TinySoundFont>(*m_soundfonts[dls]);
+    // Players of several contexts may be created at once: the first one converts the
+    // collection outside the lock, the others wait for it instead of converting it again
+    std::promise<std::shared_ptr<TinySoundFont>> conversion;
+    std::shared_future<std::shared_ptr<TinySoundFont>> cached;
+    bool convert = false;
+    {
+        std::lock_guard<std::mutex> lock(m_soundfontsMutex);
+        auto it = m_soundfonts.find(dls);
+        if (it == m_soundfonts.end()) {
+            it = m_soundfonts.emplace(dls, conversion.get_future().share()).first;
+            convert = true;
+        }
+        cached = it->second;
+        m_bankCollection = &it->first;
     }
 
+    if (convert) {
+        try {
+            auto bank = convertCollection(dls, settings.scheduler != nullptr ? *settings.scheduler : Scheduler::getCurrent());
+
+            // The cache also keeps the copy of the collection it is looked up by
+            std::size_t shared;
+            std::size_t bytes = bank->getMemoryUsage(&shared) + shared + estimateMemoryUsage(*m_bankCollection);
+            trackMemory(MemoryCategory::SynthBanks, (std::int64_t)bytes);
+            conversion.set_value(bank);
+        } catch (...) {
+            conversion.set_exception(std::current_exception());
+            // Let a later player try again
+            std::lock_guard<std::mutex> lock(m_soundfontsMutex);
+            m_soundfonts.erase(dls);
+        }
+    }
+
+    // The cached instance never plays itself, so that the voice limits
+    // and output settings set below only ever apply to this player's own copy
+    m_bank = cached.get();
+    auto soundfont = std::make_shared<TinySoundFont>(*m_bank);
+    soundfont->setOutput(m_channels == 1 ? TSF_MONO : TSF_STEREO_INTERLEAVED, sampleRate);
+    // The context renders quanta at most, so that rendering them never allocates
+    soundfont->reserveOutput(PlayingContext::QuantumFrames);
+
     std::uint32_t bank = (bankHi << 16) + bankLo;
 
     m_pan = pan < -1 ? -1 : pan > 1 ? 1 : pan;
     m_soundfont = soundfont;
+    m_soundfont->setMaxVoices(settings.channelVoices);
+    m_soundfont->setVoiceBudget(m_voiceBudget.get());
+    m_soundfont->setSilenceThreshold(settings.silenceThreshold);
 
     m_preset = m_soundfont->getPresetIndex(0, patch);
     if(m_preset < 0) {
@@ -218,16 +291,32 @@ DlsPlayer::DlsPlayer(std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patc
 
     m_soundfont->setPresetPanning(m_preset, volFactorLeft, volFactorRight);
     m_soundfont->setPresetGain(m_preset, gainToDecibels(m_volume));
+    trackMemoryUsage();
+}
+
+DlsPlayer::~DlsPlayer() {
+    trackMemory(MemoryCategory::Players, -(std::int64_t)m_trackedBytes);
+}
+
+void DlsPlayer::trackMemoryUsage() noexcept {
+    // Only the voices (when they are not limited) and the render buffer ever grow
+    std::size_t bytes = sizeof(*this) + m_soundfont->getMemoryUsage();
+    if (bytes != m_trackedBytes) {
+        trackMemory(MemoryCategory::Players, (std::int64_t)bytes - (std::int64_t)m_trackedBytes);
+        m_trackedBytes = bytes;
+    }
 }
 
 std::uint32_t DlsPlayer::renderBlock(std::int16_t *buffer, std::uint32_t count, bool mix) noexcept {
     m_soundfont->renderSamples(buffer, count / m_channels, mix);
+    trackMemoryUsage();
     return count;
 }
 
 /// Instructs the synthesizer to start playing a note
 void DlsPlayer::noteOn(std::uint8_t note, std::uint8_t velocity) {
     m_soundfont->noteOn(m_preset, note, velocity / 255.0f);
+    trackMemoryUsage();
 }
 
 /// Instructs the synthesizer to stop playing a note
@@ -259,22 +348,58 @@ void DlsPlayer::programChange(std::uint8_t program) {}
 /// Sends a "pitch bend" message
 void DlsPlayer::pitchBend(std::int16_t val) {}
 
-PlayerFactory DlsPlayer::createFactory() {
-    return [](std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patch,
+bool DlsPlayer::isIdle() const noexcept {
+    return m_soundfont->getActiveVoiceCount() == 0;
+}
+
+std::uint32_t DlsPlayer::getActiveVoices() const noexcept {
+    return (std::uint32_t)m_soundfont->getActiveVoiceCount();
+}
+
+PlayerMemoryUsage DlsPlayer::getMemoryUsage() const noexcept {
+    PlayerMemoryUsage usage;
+    usage.bytes = sizeof(*this) + m_soundfont->getMemoryUsage();
+
+    std::size_t shared;
+    usage.sharedBytes = m_bank->getMemoryUsage(&shared) + shared + estimateMemoryUsage(*m_bankCollection);
+    usage.sharedData = m_bank.get();
+    return usage;
+}
+
+PlayerStats DlsPlayer::getStats() const noexcept {
+    tsf_stats synthStats = m_soundfont->getStats();
+    PlayerStats stats;
+    stats.noteOns = synthStats.noteOns;
+    stats.regionLookups = synthStats.regionLookups;
+    stats.regionMatches = synthStats.regionMatches;
+    return stats;
+}
+
+static std::shared_ptr<tsf_voice_budget> createVoiceBudget(const DlsPlayerSettings& settings) {
+    auto budget = std::make_shared<tsf_voice_budget>();
+    budget->maxVoices = static_cast<int>(settings.totalVoices);
+    budget->playingVoices = 0;
+    return budget;
+}
+
+PlayerFactory DlsPlayer::createFactory(const DlsPlayerSettings& settings) {
+    auto budget = createVoiceBudget(settings);
+    return [settings, budget](std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patch,
         const GUID& bandGuid, DownloadableSound& dls, std::uint32_t sampleRate, std::uint32_t chans, float vol, float pan) -> std::shared_ptr<InstrumentPlayer> {
 
         return std::shared_ptr<DlsPlayer>{
-            new DlsPlayer(bankLo, bankHi, patch, dls, bandGuid, sampleRate, chans, vol, pan)
+            new DlsPlayer(bankLo, bankHi, patch, dls, bandGuid, sampleRate, chans, vol, pan, settings, budget)
         };
     };
 }
 
-GMPlayerFactory DlsPlayer::createGMFactory(DownloadableSound& dls) {
-    return [&](std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patch,
+GMPlayerFactory DlsPlayer::createGMFactory(DownloadableSound& dls, const DlsPlayerSettings& settings) {
+    auto budget = createVoiceBudget(settings);
+    return [&dls, settings, budget](std::uint8_t bankLo, std::uint8_t bankHi, std::uint8_t patch,
         std::uint32_t sampleRate, std::uint32_t chans, float vol, float pan) -> std::shared_ptr<InstrumentPlayer> {
 
         return std::shared_ptr<DlsPlayer>{
-            new DlsPlayer(bankLo, bankHi, patch, dls, GUID(), sampleRate, chans, vol, pan)
+            new DlsPlayer(bankLo, bankHi, patch, dls, GUID(), sampleRate, chans, vol, pan, settings, budget)
         };
     };
 }
\ No newline at end of file
@@ -16,6 +16,8 @@ namespace DirectMusic {
             return count;
         };
 
+        virtual bool isIdle() const noexcept { return true; }
+
         /// Instructs the synthesizer to start playing a note
         virtual void noteOn(std::uint8_t note, std::uint8_t velocity) {};
 
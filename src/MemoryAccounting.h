@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <dmusic/MemoryUsage.h>
+#include <dmusic/Forms.h>
+#include <dmusic/Riff.h>
+
+namespace DirectMusic {
+    class PlayingContext;
+
+    enum class MemoryCategory {
+        Collections,
+        Styles,
+        Segments,
+        SynthBanks,
+        Players
+    };
+
+    /// Adds `bytes` (negative when memory is given back) to the process-wide usage of a category
+    void trackMemory(MemoryCategory category, std::int64_t bytes) noexcept;
+
+    /// Makes `getProcessMemoryUsage` count the message queues of a context while it is alive
+    void registerContext(PlayingContext* context);
+    void unregisterContext(PlayingContext* context);
+
+    /// Estimated size of the control block std::make_shared allocates along with an object
+    static const std::size_t SharedControlBytes = sizeof(void*) + 2 * sizeof(int);
+
+    /// Estimated size of a node of a std::map, besides its value
+    static const std::size_t MapNodeBytes = 4 * sizeof(void*);
+
+    // The heapBytes functions return the bytes an object allocates, besides its own size
+
+    inline std::size_t heapBytes(const std::string& string) noexcept {
+        // Short strings are stored in the object itself
+        const char* data = string.data();
+        const char* object = reinterpret_cast<const char*>(&string);
+        return data >= object && data < object + sizeof(string) ? 0 : string.capacity() + 1;
+    }
+
+    template<typename T>
+    std::size_t heapBytes(const std::vector<T>& vector) noexcept {
+        return vector.capacity() * sizeof(T);
+    }
+
+    std::size_t heapBytes(const Riff::Info& info) noexcept;
+    std::size_t heapBytes(const Riff::Unfo& unfo) noexcept;
+    std::size_t heapBytes(const StylePart& part) noexcept;
+}
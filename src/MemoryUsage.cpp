@@ -0,0 +1,151 @@
+#include "MemoryAccounting.h"
+#include <dmusic/PlayingContext.h>
+#include <dmusic/dls/DownloadableSound.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+using namespace DirectMusic;
+
+static const std::size_t Categories = 5;
+
+static std::atomic<std::int64_t> s_trackedBytes[Categories];
+static std::mutex s_contextsMutex;
+static std::vector<PlayingContext*> s_contexts;
+
+void DirectMusic::trackMemory(MemoryCategory category, std::int64_t bytes) noexcept {
+    s_trackedBytes[(std::size_t)category].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void DirectMusic::registerContext(PlayingContext* context) {
+    std::lock_guard<std::mutex> lock(s_contextsMutex);
+    s_contexts.push_back(context);
+}
+
+void DirectMusic::unregisterContext(PlayingContext* context) {
+    std::lock_guard<std::mutex> lock(s_contextsMutex);
+    s_contexts.erase(std::remove(s_contexts.begin(), s_contexts.end(), context), s_contexts.end());
+}
+
+template<typename T>
+static std::size_t tagBytes(const T& tags) noexcept {
+    return heapBytes(tags.getArchivalLocation()) + heapBytes(tags.getArtist()) + heapBytes(tags.getCommission())
+        + heapBytes(tags.getComments()) + heapBytes(tags.getCopyright()) + heapBytes(tags.getCreationDate())
+        + heapBytes(tags.getEngineer()) + heapBytes(tags.getGenre()) + heapBytes(tags.getKeywords())
+        + heapBytes(tags.getMedium()) + heapBytes(tags.getName()) + heapBytes(tags.getProduct())
+        + heapBytes(tags.getSubject()) + heapBytes(tags.getSoftware()) + heapBytes(tags.getSource())
+        + heapBytes(tags.getSourceForm()) + heapBytes(tags.getTechnician());
+}
+
+std::size_t DirectMusic::heapBytes(const Riff::Info& info) noexcept {
+    return tagBytes(info);
+}
+
+std::size_t DirectMusic::heapBytes(const Riff::Unfo& unfo) noexcept {
+    return tagBytes(unfo);
+}
+
+std::size_t DirectMusic::heapBytes(const StylePart& part) noexcept {
+    return heapBytes(part.getInfo()) + heapBytes(part.getNotes()) + heapBytes(part.getCurves())
+        + heapBytes(part.getMarkers()) + heapBytes(part.getResolutions()) + heapBytes(part.getAnticipations());
+}
+
+static std::size_t articulatorBytes(const std::vector<DLS::Articulator>& articulators) noexcept {
+    std::size_t bytes = heapBytes(articulators);
+    for (const auto& articulator : articulators) {
+        bytes += heapBytes(articulator.getConnectionBlocks());
+    }
+    return bytes;
+}
+
+static std::size_t instrumentBytes(const DLS::Instrument& instrument) noexcept {
+    std::size_t bytes = heapBytes(instrument.getRegions()) + articulatorBytes(instrument.getArticulators())
+        + heapBytes(instrument.getInfo());
+    for (const auto& region : instrument.getRegions()) {
+        bytes += articulatorBytes(region.getArticulators()) + heapBytes(region.getWavesampleLoops());
+    }
+    return bytes;
+}
+
+static std::size_t referenceBytes(const ReferenceList& reference) noexcept {
+    return heapBytes(reference.getName()) + heapBytes(reference.getFile())
+        + heapBytes(reference.getCategory());
+}
+
+static std::size_t bandBytes(const BandForm& band) noexcept {
+    std::size_t bytes = heapBytes(band.getInfo()) + heapBytes(band.getInstruments());
+    for (const auto& instrument : band.getInstruments()) {
+        if (instrument.getReference() != nullptr) {
+            bytes += sizeof(ReferenceList) + SharedControlBytes + referenceBytes(*instrument.getReference());
+        }
+    }
+    return bytes;
+}
+
+static std::size_t patternBytes(const Pattern& pattern) noexcept {
+    std::size_t bytes = heapBytes(pattern.getInfo()) + heapBytes(pattern.getRhythms())
+        + heapBytes(pattern.getPartReferences()) + heapBytes(pattern.getParts());
+    if (pattern.getMotifSettings() != nullptr) {
+        bytes += sizeof(DMUS_IO_MOTIFSETTINGS) + SharedControlBytes;
+    }
+    if (pattern.getBand() != nullptr) {
+        bytes += sizeof(BandForm) + SharedControlBytes + bandBytes(*pattern.getBand());
+    }
+    for (const auto& reference : pattern.getPartReferences()) {
+        bytes += heapBytes(reference.second);
+    }
+    for (const auto& part : pattern.getParts()) {
+        bytes += heapBytes(part);
+    }
+    return bytes;
+}
+
+std::size_t DirectMusic::estimateMemoryUsage(const DLS::DownloadableSound& dls) {
+    std::size_t bytes = sizeof(dls) + heapBytes(dls.getInstruments()) + heapBytes(dls.getPoolOffsets())
+        + heapBytes(dls.getWavePool()) + heapBytes(dls.getInfo());
+    for (const auto& instrument : dls.getInstruments()) {
+        bytes += instrumentBytes(instrument);
+    }
+    for (const auto& wave : dls.getWavePool()) {
+        bytes += heapBytes(wave.getInfo()) + heapBytes(wave.getWavedata()) + heapBytes(wave.getWavesampleLoops());
+    }
+    return bytes;
+}
+
+std::size_t DirectMusic::estimateMemoryUsage(const StyleForm& style) {
+    std::size_t bytes = sizeof(style) + heapBytes(style.getInfo()) + heapBytes(style.getParts())
+        + heapBytes(style.getPatterns()) + heapBytes(style.getBands()) + heapBytes(style.getChordmapReferences());
+    for (const auto& part : style.getParts()) {
+        bytes += heapBytes(part);
+    }
+    for (const auto& pattern : style.getPatterns()) {
+        bytes += patternBytes(pattern);
+    }
+    for (const auto& band : style.getBands()) {
+        bytes += bandBytes(band);
+    }
+    for (const auto& reference : style.getChordmapReferences()) {
+        bytes += referenceBytes(reference);
+    }
+    return bytes;
+}
+
+static std::size_t trackedBytes(MemoryCategory category) noexcept {
+    std::int64_t bytes = s_trackedBytes[(std::size_t)category].load(std::memory_order_relaxed);
+    return bytes > 0 ? (std::size_t)bytes : 0;
+}
+
+MemoryUsage DirectMusic::getProcessMemoryUsage() {
+    MemoryUsage usage;
+    usage.collections = trackedBytes(MemoryCategory::Collections);
+    usage.styles = trackedBytes(MemoryCategory::Styles);
+    usage.segments = trackedBytes(MemoryCategory::Segments);
+    usage.synthBanks = trackedBytes(MemoryCategory::SynthBanks);
+    usage.players = trackedBytes(MemoryCategory::Players);
+
+    std::lock_guard<std::mutex> lock(s_contextsMutex);
+    for (PlayingContext* context : s_contexts) {
+        usage.messageQueues += context->getQueueMemoryUsage();
+    }
+    return usage;
+}
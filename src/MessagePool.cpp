@@ -0,0 +1,81 @@
+#include "MessagePool.h"
+#include <new>
+
+using namespace DirectMusic;
+
+static const std::size_t Granularity = 16;
+static const std::size_t SizeClasses = MessagePool::MaxBlockSize / Granularity;
+
+// A freed block holds the pointer to the next free block of its size
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// Trivially destructible, so that it stays usable while the thread's other
+// thread_local objects are destroyed (which may free messages)
+struct ThreadCache {
+    FreeBlock* blocks[SizeClasses];
+    std::size_t counts[SizeClasses];
+    bool released; //< Set once the thread is exiting, blocks are then freed right away
+};
+
+static thread_local ThreadCache t_cache = {};
+
+// Gives the cached blocks of a thread back to the system when it exits
+struct ThreadCacheRelease {
+    ~ThreadCacheRelease() {
+        for (std::size_t i = 0; i < SizeClasses; i++) {
+            while (t_cache.blocks[i] != nullptr) {
+                FreeBlock* block = t_cache.blocks[i];
+                t_cache.blocks[i] = block->next;
+                ::operator delete(block);
+            }
+            t_cache.counts[i] = 0;
+        }
+        t_cache.released = true;
+    }
+};
+
+static ThreadCache& getCache() noexcept {
+    static thread_local ThreadCacheRelease release;
+    (void)release;
+    return t_cache;
+}
+
+static std::size_t getSizeClass(std::size_t bytes) noexcept {
+    return bytes == 0 ? 0 : (bytes - 1) / Granularity;
+}
+
+void* MessagePool::allocate(std::size_t bytes) {
+    if (bytes > MaxBlockSize) {
+        return ::operator new(bytes);
+    }
+
+    std::size_t sizeClass = getSizeClass(bytes);
+    ThreadCache& cache = getCache();
+    FreeBlock* block = cache.blocks[sizeClass];
+    if (block != nullptr) {
+        cache.blocks[sizeClass] = block->next;
+        cache.counts[sizeClass]--;
+        return block;
+    }
+    return ::operator new((sizeClass + 1) * Granularity);
+}
+
+void MessagePool::deallocate(void* ptr, std::size_t bytes) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+
+    std::size_t sizeClass = getSizeClass(bytes);
+    ThreadCache& cache = getCache();
+    if (bytes > MaxBlockSize || cache.released || cache.counts[sizeClass] >= MaxCachedBlocks) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = cache.blocks[sizeClass];
+    cache.blocks[sizeClass] = block;
+    cache.counts[sizeClass]++;
+}
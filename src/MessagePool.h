@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace DirectMusic {
+    /** \brief Recycles the memory of the music messages
+     * Patterns are turned into thousands of messages while rendering, which would
+     * otherwise each be allocated from the heap on the rendering thread. Freed blocks
+     * are kept in a free list per thread and size (in steps of 16 bytes, up to
+     * `MaxBlockSize`) and handed out again, so that once a segment has played through
+     * its patterns no more memory is allocated, and no lock is shared between the
+     * rendering threads of several contexts. Each list keeps at most `MaxCachedBlocks`
+     * blocks, the rest and whatever is left when the thread exits go back to the system.
+     * Larger blocks are allocated and freed as usual.
+     */
+    class MessagePool {
+    public:
+        static const std::size_t MaxBlockSize = 256;
+        static const std::size_t MaxCachedBlocks = 16384;
+
+        static void* allocate(std::size_t bytes);
+        static void deallocate(void* ptr, std::size_t bytes) noexcept;
+    };
+
+    /// Allocator drawing from the MessagePool, for `std::allocate_shared`
+    template<typename T>
+    class MessageAllocator {
+    public:
+        using value_type = T;
+
+        MessageAllocator() noexcept = default;
+
+        template<typename U>
+        MessageAllocator(const MessageAllocator<U>&) noexcept {}
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(MessagePool::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* ptr, std::size_t n) noexcept {
+            MessagePool::deallocate(ptr, n * sizeof(T));
+        }
+
+        template<typename U>
+        bool operator ==(const MessageAllocator<U>&) const noexcept { return true; }
+
+        template<typename U>
+        bool operator !=(const MessageAllocator<U>&) const noexcept { return false; }
+    };
+
+    /// Creates a message, whose memory (and that of its reference count) comes from the MessagePool
+    template<typename T, typename... Args>
+    std::shared_ptr<T> makeMessage(Args&&... args) {
+        return std::allocate_shared<T>(MessageAllocator<T>(), std::forward<Args>(args)...);
+    }
+}
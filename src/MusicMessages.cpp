@@ -1,5 +1,7 @@
 #include "MusicMessages.h"
 #include "DummyPlayer.h"
+#include "RenderProfiler.h"
+#include <dmusic/Trace.h>
 #include <dmusic/Structs.h>
 #include <dmusic/PlayingContext.h>
 #include <cassert>
@@ -15,13 +17,11 @@ using namespace DirectMusic;
 
 #define PI 3.14159265359
 
-void MusicMessage::changeTempo(PlayingContext& ctx, double tempo) {
-    ctx.m_tempo = tempo;
-}
-
 std::shared_ptr<InstrumentPlayer> MusicMessage::createInstrument(PlayingContext& ctx,
     std::uint8_t bank_lo, std::uint8_t bank_hi, std::uint8_t patch,
     const GUID& bandGuid, DirectMusic::DLS::DownloadableSound& dls, float volume, float pan) {
+    auto scheduler = ctx.getScheduler();
+    SchedulerScope scope(*scheduler);
     return ctx.m_instrumentFactory(bank_lo, bank_hi, patch, bandGuid, dls, ctx.m_sampleRate, ctx.m_audioChannels, volume, pan);
 }
 
@@ -29,6 +29,8 @@ std::shared_ptr<InstrumentPlayer> MusicMessage::createGMInstrument(PlayingContex
     std::uint8_t bank_lo, std::uint8_t bank_hi, std::uint8_t patch,
     float volume, float pan) {
     if (ctx.m_gminstrumentFactory != nullptr) {
+        auto scheduler = ctx.getScheduler();
+        SchedulerScope scope(*scheduler);
         return ctx.m_gminstrumentFactory(bank_lo, bank_hi, patch, ctx.m_sampleRate, ctx.m_audioChannels, volume, pan);
     } else {
         DLS::DownloadableSound snd;
@@ -111,21 +113,17 @@ static std::int32_t getMusicOffset(std::uint32_t mtGridStart, std::int16_t nTime
 static bool getOffsetFromScale(std::uint8_t degree, std::uint32_t scale, std::uint8_t* offset) {
     assert(offset != nullptr);
 
-    // FIXME: There is probably a faster way to do this
-    std::vector<int> degrees;
+    // Walks the degrees of the scale without collecting them, as this runs for every note of a pattern
+    int found = 0;
     for (int i = 0; i < 24; i++) {
         if (scale & (0x00000001 << i)) {
-            degrees.push_back(i);
+            *offset = i;
+            if (found++ == degree) {
+                return true;
+            }
         }
     }
-
-    if (degree < degrees.size()) {
-        *offset = degrees[degree];
-        return true;
-    } else {
-        *offset = degrees[degrees.size() - 1];
-        return false;
-    }
+    return false;
 }
 
 static bool MusicValueToMIDI(std::uint32_t chord, const std::vector<DMUS_IO_SUBCHORD>& subchords, DMUS_IO_STYLENOTE note, DMUS_IO_STYLEPART part, std::uint8_t* value) {
@@ -198,7 +196,7 @@ static bool MusicValueToMIDI(std::uint32_t chord, const std::vector<DMUS_IO_SUBC
         // } else if (getOffsetFromScale(chordTone, subchord.dwScalePattern, &scaleOffset)) {
         //     noteValue += scaleOffset;
     } else {
-        TRACE_VERBOSE("Note not found: " << noteValue);
+        TRACE_VERBOSE_VALUE("Note not found", noteValue);
         return false;
     }
 
@@ -227,11 +225,12 @@ static bool MusicValueToMIDI(std::uint32_t chord, const std::vector<DMUS_IO_SUBC
     return true;
 }
 
-static std::uint8_t getRandomVariation(const std::vector<StylePart>& parts) {
+static std::uint8_t getRandomVariation(const std::vector<std::pair<DMUS_IO_PARTREF, StylePart>>& parts, Random& random) {
     int numVariations = 0;
     const std::array<std::uint32_t, 32>* choices = nullptr;
 
-    for (const auto& part : parts) {
+    for (const auto& partTuple : parts) {
+        const auto& part = partTuple.second;
         int partialCount = 0;
         for (std::uint32_t variation : part.getHeader().dwVariationChoices) {
             if (variation & 0x0FFFFFFF) {
@@ -245,7 +244,7 @@ static std::uint8_t getRandomVariation(const std::vector<StylePart>& parts) {
     }
 
     assert(choices != nullptr);
-    std::uint8_t idx = std::rand() % numVariations;
+    std::uint8_t idx = random.next(numVariations);
     std::uint8_t j = -1;
     for (int i = 0; i < numVariations; i++) {
         if ((*choices)[i]) j++;
@@ -264,21 +263,21 @@ static T lerp(float x, T start, T end) {
 
 void MusicMessage::playPattern(PlayingContext& ctx) {
     TRACE("Playing pattern");
-    ctx.m_patternMessageQueue = MessageQueue();
+    QueueContents::clear(ctx.m_patternMessageQueue);
     for (const auto& kvpair : ctx.m_performanceChannels) {
         kvpair.second->allNotesOff();
     }
 
     if (ctx.m_primarySegment != nullptr && ctx.m_performanceChannels.size() > 0) {
-        PlayingContext::Pattern pttn;
-        if (ctx.getRandomPattern(*ctx.m_primarySegment, ctx.m_grooveLevel, &pttn)) {
-            TRACE("Suitable pattern found: " << pttn.parts.size() << " parts");
-            std::uint32_t patternLength = pttn.header.wNbrMeasures * getMeasureLength(pttn.header.timeSig);
-            std::vector<StylePart> parts;
-            for (const auto& pair : pttn.parts) {
-                parts.push_back(pair.second);
+        const PlayingContext::Pattern* pattern = nullptr;
+        if (ctx.getRandomPattern(*ctx.m_primarySegment, ctx.m_grooveLevel, &pattern)) {
+            const auto& pttn = *pattern;
+            TRACE_VALUE("Suitable pattern found", pttn.parts.size());
+            if (ctx.m_profiler->isEnabled()) {
+                ctx.m_profiler->patternGenerated();
             }
-            std::uint32_t variation = 1 << getRandomVariation(parts);
+            std::uint32_t patternLength = pttn.header.wNbrMeasures * getMeasureLength(pttn.header.timeSig);
+            std::uint32_t variation = 1 << getRandomVariation(pttn.parts, ctx.m_random);
 
             for (const auto& partTuple : pttn.parts) {
                 const auto& partRef = partTuple.first;
@@ -300,11 +299,11 @@ void MusicMessage::playPattern(PlayingContext& ctx) {
 
                     if (MusicValueToMIDI(ctx.m_chord, ctx.m_subchords, note, part.getHeader(), &midiNote)) {
                         std::uint32_t time = ctx.m_musicTime + timeStart;
-                        auto noteOnMessage = std::make_shared<NoteOnMessage>(time, midiNote, note.bVelocity, 0, partRef.wLogicalPartID, PChannel);
+                        auto noteOnMessage = makeMessage<NoteOnMessage>(time, midiNote, note.bVelocity, 0, partRef.wLogicalPartID, PChannel);
                         assert(noteOnMessage != nullptr);
                         ctx.m_patternMessageQueue.push(noteOnMessage);
 
-                        auto noteOffMessage = std::make_shared<NoteOffMessage>(time + note.mtDuration, midiNote, partRef.wLogicalPartID, PChannel);
+                        auto noteOffMessage = makeMessage<NoteOffMessage>(time + note.mtDuration, midiNote, partRef.wLogicalPartID, PChannel);
                         assert(noteOffMessage != nullptr);
                         ctx.m_patternMessageQueue.push(noteOffMessage);
                     }
@@ -338,7 +337,7 @@ void MusicMessage::playPattern(PlayingContext& ctx) {
 
                             float value = curveFunction(phase, startValue, endValue);
 
-                            auto msg = std::make_shared<ControlChangeMessage>(ctx.m_musicTime + timeStart + offset, partRef.wLogicalPartID, PChannel, control, value);
+                            auto msg = makeMessage<ControlChangeMessage>(ctx.m_musicTime + timeStart + offset, partRef.wLogicalPartID, PChannel, control, value);
                             assert(msg != nullptr);
                             ctx.m_patternMessageQueue.push(msg);
                         }
@@ -346,7 +345,7 @@ void MusicMessage::playPattern(PlayingContext& ctx) {
                 }
             }
 
-            auto patternEndMessage = std::make_shared<PatternEndMessage>(ctx.m_musicTime + patternLength);
+            auto patternEndMessage = makeMessage<PatternEndMessage>(ctx.m_musicTime + patternLength);
             ctx.m_patternMessageQueue.push(patternEndMessage);
         } else {
             TRACE("No suitable pattern found");
@@ -389,13 +388,13 @@ SegmentTiming MusicMessage::getNextSegmentTiming(PlayingContext& ctx) {
     return ctx.m_nextSegmentTiming;
 }
 
-void TempoChangeMessage::Execute(PlayingContext& ctx) {
-    TRACE("Tempo change: " << m_tempo);
-    this->changeTempo(ctx, m_tempo);
+std::uint32_t MusicMessage::random(PlayingContext& ctx, std::uint32_t bound) {
+    return ctx.m_random.next(bound);
 }
 
 BandChangeMessage::BandChangeMessage(PlayingContext& ctx, std::uint32_t time, const BandForm& form)
     : MusicMessage(time) {
+    Instruments instruments;
     for (const auto& instr : form.getInstruments()) {
         const auto& header = instr.getHeader();
         const auto ref = instr.getReference();
@@ -416,30 +415,29 @@ BandChangeMessage::BandChangeMessage(PlayingContext& ctx, std::uint32_t time, co
             instruments[header.dwPChannel] = createGMInstrument(ctx, bankLo, bankHi, patch, volume, pan);
         }
     }
+    this->instruments = std::make_shared<const Instruments>(std::move(instruments));
 }
 
 void BandChangeMessage::Execute(PlayingContext& ctx) {
-    TRACE("Band change");
-    for (const auto& kvpair : instruments) {
+    for (const auto& kvpair : *instruments) {
         setInstrument(ctx, kvpair.first, kvpair.second);
     }
 }
 
 void GrooveLevelMessage::Execute(PlayingContext& ctx) {
     if (m_range == 0) {
-        TRACE("Groove change: " << (int)m_level);
+        TRACE_VALUE("Groove change", m_level);
         setGrooveLevel(ctx, m_level);
     } else {
-        std::int8_t offset = (std::rand() % m_range) - (m_range / 2);
+        std::int8_t offset = (int)random(ctx, m_range) - (m_range / 2);
         std::uint8_t newLevel = m_level - offset;
-        TRACE("Groove change: " << (int)newLevel);
+        TRACE_VALUE("Groove change", newLevel);
         setGrooveLevel(ctx, newLevel);
     }
 }
 
 void ChordMessage::Execute(PlayingContext& ctx) {
-    TRACE("Chord change");
-    changeChord(ctx, this->m_chord, this->m_subchords);
+    changeChord(ctx, this->m_chord, *this->m_subchords);
 }
 
 static std::shared_ptr<InstrumentPlayer> findChannel(const std::map<std::uint32_t, std::shared_ptr<InstrumentPlayer>>& channels, std::uint32_t channel, std::uint32_t channelAlt) {
@@ -453,14 +451,13 @@ static std::shared_ptr<InstrumentPlayer> findChannel(const std::map<std::uint32_
 }
 
 void NoteOnMessage::Execute(PlayingContext& ctx) {
-    TRACE_VERBOSE("Note on");
     const auto& channels = getChannels(ctx);
     std::shared_ptr<InstrumentPlayer> player = nullptr;
     if (player = findChannel(channels, m_channel, m_channelAlt)) {
         if (m_velRange == 0) {
             player->noteOn(m_note, m_vel);
         } else {
-            std::int8_t offset = (std::rand() % m_velRange) - (m_velRange / 2);
+            std::int8_t offset = (int)random(ctx, m_velRange) - (m_velRange / 2);
             player->noteOn(m_note, m_vel - offset);
         }
     }
@@ -468,7 +465,6 @@ void NoteOnMessage::Execute(PlayingContext& ctx) {
 }
 
 void NoteOffMessage::Execute(PlayingContext& ctx) {
-    TRACE_VERBOSE("Note off");
     const auto& channels = getChannels(ctx);
     std::shared_ptr<InstrumentPlayer> player = nullptr;
     if (player = findChannel(channels, m_channel, m_channelAlt)) {
@@ -478,19 +474,16 @@ void NoteOffMessage::Execute(PlayingContext& ctx) {
 }
 
 void SegmentEndMessage::Execute(PlayingContext& ctx) {
-    TRACE("Segment end");
     enqueueNextSegment(ctx);
 }
 
 void PatternEndMessage::Execute(PlayingContext& ctx) {
-    TRACE("Pattern end");
     if (isNextSegmentAvailable(ctx) && getNextSegmentTiming(ctx) == SegmentTiming::Pattern)
         enqueueNextSegment(ctx);
     playPattern(ctx);
 }
 
 void ControlChangeMessage::Execute(PlayingContext& ctx) {
-    TRACE("Control change");
     const auto& channels = getChannels(ctx);
     std::shared_ptr<InstrumentPlayer> player = nullptr;
     if (player = findChannel(channels, m_channel, m_channelAlt)) {
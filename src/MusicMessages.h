@@ -4,44 +4,39 @@
 #include <locale>
 #include <codecvt>
 #include <dmusic/MusicMessage.h>
+#include <dmusic/PlayingContext.h>
 #include <dmusic/Tracks.h>
+#include "MemoryAccounting.h"
+#include "MessagePool.h"
 
 namespace DirectMusic {
-    class TempoChangeMessage : public MusicMessage {
-    public:
-        TempoChangeMessage(std::uint32_t time, double tempo)
-        : MusicMessage(time), 
-        m_tempo(tempo) { }
-
-        virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<TempoChangeMessage>(newTime, m_tempo);
-        }
-
-        virtual MusicMessageType getMessageType() const { return MusicMessageType::TempoChange; }
-
-        virtual void Execute(PlayingContext& ctx);
-
-    private:
-        double m_tempo;
-    };
-    
     class BandChangeMessage : public MusicMessage {
     public:
-        BandChangeMessage(std::uint32_t time, std::map<std::uint32_t, std::shared_ptr<InstrumentPlayer>> instr)
+        using Instruments = std::map<std::uint32_t, std::shared_ptr<InstrumentPlayer>>;
+
+        /// Clones share the instruments, so that cloning allocates nothing but the message
+        BandChangeMessage(std::uint32_t time, std::shared_ptr<const Instruments> instr)
             : MusicMessage(time)
-            , instruments(instr) {}
+            , instruments(std::move(instr)) {}
         BandChangeMessage(PlayingContext& ctx, std::uint32_t time, const DirectMusic::BandForm& form);
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<BandChangeMessage>(newTime, instruments);
+            return makeMessage<BandChangeMessage>(newTime, instruments);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::BandChange; }
 
+        virtual std::size_t getMemoryUsage() const {
+            return sizeof(*this) + SharedControlBytes + sizeof(Instruments)
+                + instruments->size() * (MapNodeBytes + sizeof(Instruments::value_type));
+        }
+
         virtual void Execute(PlayingContext& ctx);
 
+        const Instruments& getInstruments() const { return *instruments; }
+
     private:
-        std::map<std::uint32_t, std::shared_ptr<InstrumentPlayer>> instruments;
+        std::shared_ptr<const Instruments> instruments;
     };
 
     class GrooveLevelMessage : public MusicMessage {
@@ -53,11 +48,13 @@ namespace DirectMusic {
             m_range(grooveRange % 2 == 0 ? grooveRange : grooveRange  - 1) {};
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<GrooveLevelMessage>(newTime, m_level, m_range);
+            return makeMessage<GrooveLevelMessage>(newTime, m_level, m_range);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::GrooveLevel; }
 
+        virtual std::size_t getMemoryUsage() const { return sizeof(*this); }
+
         virtual void Execute(PlayingContext& ctx);
         virtual int getPriority() { return -1; };
 
@@ -70,20 +67,30 @@ namespace DirectMusic {
         ChordMessage(std::uint32_t time, std::uint32_t chord, const std::vector<DMUS_IO_SUBCHORD> subchords)
             : MusicMessage(time),
             m_chord(chord),
-            m_subchords(subchords) {};
+            m_subchords(std::make_shared<const std::vector<DMUS_IO_SUBCHORD>>(subchords)) {};
+
+        /// Clones share the subchords, so that cloning allocates nothing but the message
+        ChordMessage(std::uint32_t time, std::uint32_t chord, std::shared_ptr<const std::vector<DMUS_IO_SUBCHORD>> subchords)
+            : MusicMessage(time),
+            m_chord(chord),
+            m_subchords(std::move(subchords)) {};
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<ChordMessage>(newTime, m_chord, m_subchords);
+            return makeMessage<ChordMessage>(newTime, m_chord, m_subchords);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::ChordMessage; }
 
+        virtual std::size_t getMemoryUsage() const {
+            return sizeof(*this) + SharedControlBytes + sizeof(*m_subchords) + heapBytes(*m_subchords);
+        }
+
         virtual void Execute(PlayingContext& ctx);
         virtual int getPriority() { return 1; };
 
     private:
         std::uint32_t m_chord;
-        const std::vector<DMUS_IO_SUBCHORD> m_subchords;
+        std::shared_ptr<const std::vector<DMUS_IO_SUBCHORD>> m_subchords;
     };
 
     class NoteOnMessage : public MusicMessage {
@@ -97,11 +104,13 @@ namespace DirectMusic {
             m_channelAlt(channelAlt) {}
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<NoteOnMessage>(newTime, m_note, m_vel, m_velRange, m_channel, m_channelAlt);
+            return makeMessage<NoteOnMessage>(newTime, m_note, m_vel, m_velRange, m_channel, m_channelAlt);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::NoteOn; }
 
+        virtual std::size_t getMemoryUsage() const { return sizeof(*this); }
+
         virtual void Execute(PlayingContext& ctx);
 
     private:
@@ -118,11 +127,13 @@ namespace DirectMusic {
             m_channelAlt(channelAlt) {}
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<NoteOffMessage>(newTime, m_note, m_channel, m_channelAlt);
+            return makeMessage<NoteOffMessage>(newTime, m_note, m_channel, m_channelAlt);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::NoteOff; }
 
+        virtual std::size_t getMemoryUsage() const { return sizeof(*this); }
+
         virtual void Execute(PlayingContext& ctx);
 
     private:
@@ -136,11 +147,13 @@ namespace DirectMusic {
             : MusicMessage(time) {}
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<SegmentEndMessage>(newTime);
+            return makeMessage<SegmentEndMessage>(newTime);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::SegmentEnd; }
 
+        virtual std::size_t getMemoryUsage() const { return sizeof(*this); }
+
         virtual void Execute(PlayingContext& ctx);
     };
 
@@ -150,11 +163,13 @@ namespace DirectMusic {
             : MusicMessage(time) {}
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<PatternEndMessage>(newTime);
+            return makeMessage<PatternEndMessage>(newTime);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::PatternEnd; }
 
+        virtual std::size_t getMemoryUsage() const { return sizeof(*this); }
+
         virtual int getPriority() { return -2; }
 
         virtual void Execute(PlayingContext& ctx);
@@ -170,11 +185,13 @@ namespace DirectMusic {
             m_value(value) {}
 
         virtual std::shared_ptr<MusicMessage> Clone(std::uint32_t newTime) {
-            return std::make_shared<ControlChangeMessage>(newTime, m_channel, m_channelAlt, m_control, m_value);
+            return makeMessage<ControlChangeMessage>(newTime, m_channel, m_channelAlt, m_control, m_value);
         }
 
         virtual MusicMessageType getMessageType() const { return MusicMessageType::ControlChange; }
 
+        virtual std::size_t getMemoryUsage() const { return sizeof(*this); }
+
         virtual void Execute(PlayingContext& ctx);
 
     private:
@@ -182,4 +199,16 @@ namespace DirectMusic {
         std::uint32_t m_channel, m_channelAlt;
         DirectMusic::Midi::Control m_control;
     };
-}
\ No newline at end of file
+
+    // Gives access to the messages of a queue, which std::priority_queue keeps in its protected member
+    struct QueueContents : MessageQueue {
+        static const container_type& get(const MessageQueue& queue) {
+            return queue.*&QueueContents::c;
+        }
+
+        /// Empties the queue, keeping its memory for the following messages
+        static void clear(MessageQueue& queue) noexcept {
+            (queue.*&QueueContents::c).clear();
+        }
+    };
+}
@@ -1,88 +1,164 @@
 #include <dmusic/PlayingContext.h>
 #include <dmusic/Tracks.h>
 #include "MusicMessages.h"
+#include "RenderProfiler.h"
+#include "MemoryAccounting.h"
+#include <dmusic/Trace.h>
+#include <dmusic/AllocationCheck.h>
 #include <exception>
 #include <cassert>
 #include <cmath>
 #include <bitset>
+#include <algorithm>
+#include <tuple>
+#include <set>
 
 using namespace DirectMusic;
 
-static std::uint32_t calcBeatLength(const DMUS_IO_TIMESIG& signature)
+// Used until a segment plays
+static const TempoMap s_defaultTempoMap;
+
+#if DMUSIC_TRACE
+// Names of the message executions in the trace
+static const char* getMessageName(MusicMessageType type) {
+    switch (type) {
+    case MusicMessageType::BandChange: return "Band change";
+    case MusicMessageType::GrooveLevel: return "Groove level";
+    case MusicMessageType::ChordMessage: return "Chord change";
+    case MusicMessageType::NoteOn: return "Note on";
+    case MusicMessageType::NoteOff: return "Note off";
+    case MusicMessageType::SegmentEnd: return "Segment end";
+    case MusicMessageType::PatternEnd: return "Pattern end";
+    case MusicMessageType::ControlChange: return "Control change";
+    }
+    return "Message";
+}
+#endif
+
+PlayingContext::PlayingContext(std::uint32_t sampleRate,
+    std::uint32_t audioChannels,
+    PlayerFactory instrumentFactory,
+    GMPlayerFactory gminstrumentFactory)
+    : m_instrumentFactory(instrumentFactory),
+    m_gminstrumentFactory(gminstrumentFactory),
+    m_sampleRate(sampleRate),
+    m_audioChannels(audioChannels),
+    m_assets(std::make_shared<AssetStore>()),
+    m_musicTime(0),
+    m_grooveLevel(1),
+    m_primarySegment(nullptr)
 {
-    if (signature.bBeat == 0) {
-        return PlayingContext::PulsesPerQuarterNote / 64;
-    } else if (signature.bBeat <= 4) {
-        return PlayingContext::PulsesPerQuarterNote * (4 / signature.bBeat);
-    } else {
-        return PlayingContext::PulsesPerQuarterNote / (signature.bBeat / 4);
+    m_quantum.resize(QuantumFrames * m_audioChannels);
+    m_quantumPosition = (std::uint32_t)m_quantum.size();
+    m_profiler = std::make_unique<RenderProfiler>();
+    registerContext(this);
+}
+
+PlayingContext::~PlayingContext() {
+    unregisterContext(this);
+
+    // Prefetches use this context until they are done
+    std::unique_lock<std::mutex> lock(m_prefetchMutex);
+    m_prefetchDone.wait(lock, [this] { return m_pendingPrefetches == 0; });
+}
+
+void PlayingContext::setAssetStore(const std::shared_ptr<AssetStore>& assets) {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_assets = assets != nullptr ? assets : std::make_shared<AssetStore>();
+}
+
+void PlayingContext::setScheduler(const std::shared_ptr<Scheduler>& scheduler) {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    // Rendering in parallel needs one at hand
+    m_scheduler = scheduler != nullptr || !m_parallelRender ? scheduler : Scheduler::getDefault();
+    reserveParallelRender(m_performanceChannels.size());
+}
+
+std::shared_ptr<Scheduler> PlayingContext::getScheduler() {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    if (m_scheduler == nullptr) {
+        m_scheduler = Scheduler::getDefault();
     }
+    return m_scheduler;
 }
 
-static std::uint32_t calcMeasureLength(const DMUS_IO_TIMESIG& signature) {
-    return signature.bBeatsPerMeasure * calcBeatLength(signature);
+void PlayingContext::setParallelRendering(bool parallel) {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    // Created here rather than on the audio thread
+    if (parallel && m_scheduler == nullptr) {
+        m_scheduler = Scheduler::getDefault();
+    }
+    m_parallelRender = parallel;
+    reserveParallelRender(m_performanceChannels.size());
 }
 
-void PlayingContext::renderAudio(std::int16_t *data, std::uint32_t count, float volume) noexcept {
-    double pulsesPerSecond = PulsesPerQuarterNote * (m_tempo / 60);
-    double pulsesPerSample = pulsesPerSecond / m_sampleRate;
+void PlayingContext::setRenderThreads(std::uint32_t threads) {
+    setScheduler(threads > 1 ? Scheduler::createThreadPool(threads) : nullptr);
+    setParallelRendering(threads > 1);
+}
 
-    MusicMessageComparer comparer;
+const TempoMap& PlayingContext::getTempoMap() const noexcept {
+    return m_primarySegment != nullptr ? m_primarySegment->tempoMap : s_defaultTempoMap;
+}
 
-    std::uint32_t offset = 0;
-    while (offset < count) {
-        std::shared_ptr<MusicMessage> nextMessage = nullptr;
-        bool messageIsfromPattern = false;
+std::uint64_t PlayingContext::getSegmentFrame(std::uint32_t musicTime) const noexcept {
+    if (musicTime <= m_currentSegmentStart) {
+        return 0;
+    }
+    // Rounding errors must not push a time falling on a frame to the next one
+    double frame = getTempoMap().getSeconds(musicTime - m_currentSegmentStart) * m_sampleRate;
+    return (std::uint64_t)std::ceil(frame - 1e-6);
+}
 
-        if (!m_patternMessageQueue.empty()) {
-            nextMessage = m_patternMessageQueue.top();
-            messageIsfromPattern = true;
-        }
+void PlayingContext::advanceFrames(std::uint32_t frames) noexcept {
+    m_segmentFrames += frames;
+    double seconds = (double)m_segmentFrames / m_sampleRate;
+    m_musicTime = m_currentSegmentStart + (std::uint32_t)getTempoMap().getMusicTime(seconds);
+}
 
-        if (!m_messageQueue.empty()) {
-            if (nextMessage == nullptr || comparer(nextMessage, m_messageQueue.top())) {
-                nextMessage = m_messageQueue.top();
-                messageIsfromPattern = false;
-            }
-        }
+MessageQueue* PlayingContext::getNextQueue() noexcept {
+    MessageQueue* next = nullptr;
+    if (!m_patternMessageQueue.empty()) {
+        next = &m_patternMessageQueue;
+    }
+    if (!m_messageQueue.empty() && (next == nullptr || MusicMessageComparer()(next->top(), m_messageQueue.top()))) {
+        next = &m_messageQueue;
+    }
+    return next;
+}
 
-        if (nextMessage == nullptr) {
+void PlayingContext::renderAudio(std::int16_t *data, std::uint32_t count, float volume) noexcept {
+    std::uint32_t offset = 0;
+    while (offset < count) {
+        MessageQueue* queue = getNextQueue();
+        if (queue == nullptr) {
             goto fill_buffer;
         } else {
-            pulsesPerSecond = PulsesPerQuarterNote * (m_tempo / 60);
-            pulsesPerSample = pulsesPerSecond / (m_sampleRate * m_audioChannels);
+            std::shared_ptr<MusicMessage> nextMessage = queue->top();
 
-            std::uint32_t nextMessageTimeOffset = nextMessage->getMessageTime() - m_musicTime;
+            // Messages already due are played right away
+            std::uint64_t messageFrame = getSegmentFrame(nextMessage->getMessageTime());
+            std::uint64_t frames = messageFrame > m_segmentFrames ? messageFrame - m_segmentFrames : 0;
 
-            if (nextMessage->getMessageTime() < m_musicTime) {
-                nextMessageTimeOffset = 0;
-            }
-
-            std::uint32_t nextMessageTimeOffsetInSamples = (std::uint32_t)(nextMessageTimeOffset / pulsesPerSample);
-            if (nextMessageTimeOffsetInSamples % m_audioChannels != 0) {
-                nextMessageTimeOffsetInSamples++;
-                nextMessageTimeOffset = (std::uint32_t)(nextMessageTimeOffsetInSamples * pulsesPerSample);
-            }
-
-            if (nextMessageTimeOffsetInSamples + offset > count) {
+            if (frames * m_audioChannels > count - offset) {
                 goto fill_buffer;
             } else {
-                bool first = true;
-                for (const auto& channel : m_performanceChannels) {
-                    {
-                        const auto& player = channel.second;
-                        player->renderBlock(data + offset, nextMessageTimeOffsetInSamples, !first);
-                        first = false;
-                    }
+                std::uint32_t samples = (std::uint32_t)frames * m_audioChannels;
+                renderChannels(data + offset, samples);
+                offset += samples;
+                advanceFrames((std::uint32_t)frames);
+
+                // The message runs at its own time rather than at that of its frame, so
+                // that the messages it enqueues in turn are not delayed by the rounding
+                m_musicTime = std::max(m_musicTime, nextMessage->getMessageTime());
+                queue->pop();
+                {
+                    TRACE_SCOPE("message", getMessageName(nextMessage->getMessageType()));
+                    nextMessage->Execute(*this);
                 }
-                offset += nextMessageTimeOffsetInSamples;
-                m_musicTime += nextMessageTimeOffset;
-                if (messageIsfromPattern) {
-                    m_patternMessageQueue.pop();
-                } else {
-                    m_messageQueue.pop();
+                if (m_profiler->isEnabled()) {
+                    m_profiler->eventDispatched();
                 }
-                nextMessage->Execute(*this);
             }
         }
     }
@@ -92,62 +168,217 @@ fill_buffer:
     // process the already-playing instruments
     int remainingSamples = count - offset;
     if (remainingSamples > 0) {
-        bool first = true;
-        for (const auto& channel : m_performanceChannels) {
-            {
-                const auto& player = channel.second;
-                player->renderBlock(data + offset, remainingSamples, !first);
-                first = false;
-            }
+        renderChannels(data + offset, remainingSamples);
+        advanceFrames(remainingSamples / m_audioChannels);
+    }
+}
+
+void PlayingContext::renderChannels(std::int16_t *data, std::uint32_t count) noexcept {
+    if (m_parallelRender && m_scheduler->getConcurrency() > 1 && renderChannelsParallel(data, count)) {
+        return;
+    }
+
+    const bool profiling = m_profiler->isEnabled() && count > 0;
+    if (profiling) {
+        m_profiler->subBlock();
+    }
+
+    bool first = true;
+    for (const auto& channel : m_performanceChannels) {
+        const auto& player = channel.second;
+        if (player->isIdle()) {
+            continue;
+        }
+        if (profiling) {
+            auto start = RenderProfiler::Clock::now();
+            player->renderBlock(data, count, !first);
+            m_profiler->channelRendered(channel.first, RenderProfiler::elapsed(start));
+        } else {
+            player->renderBlock(data, count, !first);
         }
-        m_musicTime += (remainingSamples * pulsesPerSample);
+        first = false;
+    }
+
+    if (first) {
+        std::fill(data, data + count, std::int16_t(0));
     }
 }
 
 void PlayingContext::renderBlock(std::int16_t *data, std::uint32_t count, float volume) noexcept {
-    m_queueMutex.lock();
+    TRACE_SCOPE("render", "Render block");
+    RealtimeScope realtime;
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+
+    const bool profiling = m_profiler->isEnabled();
+    RenderProfiler::Clock::time_point start;
+    if (profiling) {
+        m_profiler->beginBlock();
+        start = RenderProfiler::Clock::now();
+    }
+
+    const std::uint32_t quantumSize = (std::uint32_t)m_quantum.size();
+    while (count > 0) {
+        // Whole silent quanta go straight to the output, filled at once
+        std::uint32_t silent = m_quantumPosition == quantumSize ? skipSilentQuanta(count / quantumSize) * quantumSize : 0;
+        if (silent > 0) {
+            std::fill(data, data + silent, std::int16_t(0));
+            data += silent;
+            count -= silent;
+            continue;
+        }
+
+        if (m_quantumPosition == quantumSize) {
+            renderQuantum(m_quantum.data(), quantumSize, volume);
+            m_quantumPosition = 0;
+        }
+
+        std::uint32_t available = quantumSize - m_quantumPosition;
+        std::uint32_t copied = count < available ? count : available;
+        std::copy(m_quantum.data() + m_quantumPosition, m_quantum.data() + m_quantumPosition + copied, data);
+        m_quantumPosition += copied;
+        data += copied;
+        count -= copied;
+    }
+
+    if (profiling) {
+        m_profiler->endBlock(RenderProfiler::elapsed(start));
+    }
+}
+
+void PlayingContext::renderBlock(std::int16_t *data, std::uint32_t frames, const OutputLayout& layout, float volume) noexcept {
+    TRACE_SCOPE("render", "Render block");
+    RealtimeScope realtime;
+    std::fill(data, data + frames * layout.channels, std::int16_t(0));
+
+    std::lock_guard<std::mutex> lock(m_queueMutex);
 
-    double pulsesPerSecond = (double)PulsesPerQuarterNote * (m_tempo / 60);
-    double pulsesPerSample = pulsesPerSecond / m_sampleRate;
+    const bool profiling = m_profiler->isEnabled();
+    RenderProfiler::Clock::time_point start;
+    if (profiling) {
+        m_profiler->beginBlock();
+        start = RenderProfiler::Clock::now();
+    }
+
+    std::uint32_t frame = 0;
+    while (frame < frames) {
+        // The output is already silent: whole silent quanta are just skipped
+        std::uint32_t silent = m_quantumPosition == m_quantum.size() ? skipSilentQuanta((frames - frame) / QuantumFrames) : 0;
+        if (silent > 0) {
+            frame += silent * QuantumFrames;
+            continue;
+        }
+
+        if (m_quantumPosition == m_quantum.size()) {
+            renderQuantum(m_quantum.data(), (std::uint32_t)m_quantum.size(), volume);
+            m_quantumPosition = 0;
+        }
 
-    std::uint32_t beatLength = calcBeatLength(m_signature),
-        measureLength = calcMeasureLength(m_signature);
+        std::uint32_t available = ((std::uint32_t)m_quantum.size() - m_quantumPosition) / m_audioChannels;
+        std::uint32_t copied = frames - frame < available ? frames - frame : available;
+        layout.copyFrames(m_quantum.data() + m_quantumPosition, m_audioChannels, copied, data, frame, frames);
+        m_quantumPosition += copied * m_audioChannels;
+        frame += copied;
+    }
 
-    beatLength = beatLength == 0 ? 1 : beatLength;
-    measureLength = measureLength == 0 ? 1 : measureLength;
+    if (profiling) {
+        m_profiler->endBlock(RenderProfiler::elapsed(start));
+    }
+}
 
-    std::uint32_t segmentTimeOffset = m_musicTime - m_currentSegmentStart;
+void OutputLayout::copyFrames(const std::int16_t *source, std::uint32_t sourceChannels, std::uint32_t frames,
+    std::int16_t *output, std::uint32_t offset, std::uint32_t outputFrames) const noexcept {
+    for (std::uint32_t c = 0; c < sourceChannels && c < channelMap.size(); c++) {
+        std::uint32_t target = channelMap[c];
+        if (target >= channels) {
+            continue;
+        }
 
-    double timeToNextBeat = beatLength - (segmentTimeOffset % beatLength);
-    double timeToNextMeasure = measureLength - (segmentTimeOffset % measureLength);
+        // Samples of the target channel are `stride` apart in the output
+        std::int16_t *out = planar ? output + target * outputFrames + offset : output + offset * channels + target;
+        std::uint32_t stride = planar ? 1 : channels;
+        for (std::uint32_t i = 0; i < frames; i++) {
+            out[i * stride] = source[i * sourceChannels + c];
+        }
+    }
+}
 
-    std::uint32_t timeToNextBeatInSamples = (std::uint32_t)(timeToNextBeat / pulsesPerSample);
-    std::uint32_t timeToNextMeasureInSamples = (std::uint32_t)(timeToNextMeasure / pulsesPerSample);
+std::uint32_t PlayingContext::skipSilentQuanta(std::uint32_t maxQuanta) noexcept {
+    if (maxQuanta == 0 || (m_nextSegment != nullptr && m_nextSegmentTiming == SegmentTiming::Immediate)) {
+        return 0;
+    }
 
-    timeToNextBeatInSamples += timeToNextBeatInSamples % 2;
-    timeToNextMeasureInSamples += timeToNextMeasureInSamples % 2;
+    for (const auto& channel : m_performanceChannels) {
+        if (!channel.second->isIdle()) {
+            return 0;
+        }
+    }
+
+    // Same computations as renderQuantum's and renderAudio's, which would render a whole
+    // quantum without a transition nor a message if the next one comes after its end
+    std::uint64_t nextFrame = UINT64_MAX;
+    if (m_nextSegment != nullptr &&
+        (m_nextSegmentTiming == SegmentTiming::Beat || m_nextSegmentTiming == SegmentTiming::Measure)) {
+        const TempoMap& tempoMap = getTempoMap();
+        std::uint32_t segmentTime = m_musicTime - m_currentSegmentStart;
+        std::uint32_t boundary = m_nextSegmentTiming == SegmentTiming::Beat ? tempoMap.getNextBeat(segmentTime) : tempoMap.getNextMeasure(segmentTime);
+        nextFrame = getSegmentFrame(m_currentSegmentStart + boundary);
+    }
+    MessageQueue* queue = getNextQueue();
+    if (queue != nullptr) {
+        nextFrame = std::min(nextFrame, getSegmentFrame(queue->top()->getMessageTime()));
+    }
+
+    std::uint32_t quanta = maxQuanta;
+    if (nextFrame <= m_segmentFrames) {
+        return 0;
+    } else if ((nextFrame - m_segmentFrames - 1) / QuantumFrames < maxQuanta) {
+        quanta = (std::uint32_t)((nextFrame - m_segmentFrames - 1) / QuantumFrames);
+    }
+    if (quanta == 0) {
+        return 0;
+    }
+
+    advanceFrames(quanta * QuantumFrames);
+    if (m_profiler->isEnabled()) {
+        m_profiler->silentQuanta(quanta);
+    }
+    return quanta;
+}
+
+void PlayingContext::renderQuantum(std::int16_t *data, std::uint32_t count, float volume) noexcept {
+    TRACE_SCOPE("render", "Render quantum");
+    const bool profiling = m_profiler->isEnabled();
+    RenderProfiler::Clock::time_point start;
+    if (profiling) {
+        m_profiler->beginQuantum();
+        start = RenderProfiler::Clock::now();
+    }
 
     if (m_nextSegment != nullptr && m_nextSegmentTiming == SegmentTiming::Immediate) {
         TRACE("Enqueueing next segment");
         enqueueSegment(m_nextSegment);
         m_primarySegment = std::move(m_nextSegment);
         m_nextSegment = nullptr;
-        m_currentSegmentStart = m_musicTime;
         renderAudio(data, count, volume);
     } else if (m_nextSegment != nullptr &&
         (m_nextSegmentTiming == SegmentTiming::Beat || m_nextSegmentTiming == SegmentTiming::Measure)) {
-        std::uint32_t transitionTime = m_nextSegmentTiming == SegmentTiming::Beat ? timeToNextBeatInSamples : timeToNextMeasureInSamples;
+        const TempoMap& tempoMap = getTempoMap();
+        std::uint32_t segmentTime = m_musicTime - m_currentSegmentStart;
+        std::uint32_t boundary = m_nextSegmentTiming == SegmentTiming::Beat ? tempoMap.getNextBeat(segmentTime) : tempoMap.getNextMeasure(segmentTime);
+
+        std::uint64_t boundaryFrame = getSegmentFrame(m_currentSegmentStart + boundary);
+        std::uint64_t transitionFrames = boundaryFrame > m_segmentFrames ? boundaryFrame - m_segmentFrames : 0;
 
-        if (count < transitionTime) {
+        if (count < transitionFrames * m_audioChannels) {
             renderAudio(data, count, volume);
         } else {
+            std::uint32_t transitionTime = (std::uint32_t)transitionFrames * m_audioChannels;
             renderAudio(data, transitionTime, volume);
 
             TRACE("Enqueueing next segment");
             enqueueSegment(m_nextSegment);
             m_primarySegment = std::move(m_nextSegment);
             m_nextSegment = nullptr;
-            m_currentSegmentStart = m_musicTime;
 
             renderAudio(data + transitionTime, count - transitionTime, volume);
         }
@@ -155,34 +386,283 @@ void PlayingContext::renderBlock(std::int16_t *data, std::uint32_t count, float
         renderAudio(data, count, volume);
     }
 
-    m_queueMutex.unlock();
+    if (profiling) {
+        std::uint64_t nanoseconds = RenderProfiler::elapsed(start);
+        std::uint64_t voices = 0;
+        for (const auto& channel : m_performanceChannels) {
+            voices += channel.second->getActiveVoices();
+        }
+        m_profiler->endQuantum(nanoseconds, voices, m_messageQueue.size() + m_patternMessageQueue.size());
+    }
+}
+
+void PlayingContext::reserveParallelRender(std::size_t channels) {
+    m_renderPlayers.reserve(channels);
+    m_renderChannelIds.reserve(channels);
+    m_renderTimes.reserve(channels);
+
+    // Only rendering in parallel needs a block per channel, and a call renders at most a quantum
+    std::size_t samples = m_renderPlayers.capacity() * m_quantum.size();
+    if (m_parallelRender && m_renderScratch.size() < samples) {
+        m_renderScratch.resize(samples);
+    }
+}
+
+bool PlayingContext::renderChannelsParallel(std::int16_t *data, std::uint32_t count) noexcept {
+    if (m_performanceChannels.size() > m_renderPlayers.capacity()) {
+        return false;
+    }
+
+    m_renderPlayers.clear();
+    m_renderChannelIds.clear();
+    for (const auto& channel : m_performanceChannels) {
+        if (!channel.second->isIdle()) {
+            m_renderPlayers.push_back(channel.second.get());
+            m_renderChannelIds.push_back(channel.first);
+        }
+    }
+
+    if (m_renderPlayers.empty()) {
+        std::fill(data, data + count, std::int16_t(0));
+        return true;
+    }
+    if (m_renderScratch.size() < m_renderPlayers.size() * count) {
+        return false;
+    }
+
+    // The players rendered on the pool time themselves, the profiler is only fed
+    // from this thread
+    const bool profiling = m_profiler->isEnabled() && count > 0;
+    if (profiling) {
+        m_profiler->subBlock();
+        m_renderTimes.resize(m_renderPlayers.size());
+    }
+
+    m_scheduler->parallelFor(m_renderPlayers.size(), [this, count, profiling](std::size_t i) {
+        RealtimeScope realtime;
+        InstrumentPlayer* player = m_renderPlayers[i];
+        if (player->canRenderConcurrently()) {
+            auto start = profiling ? RenderProfiler::Clock::now() : RenderProfiler::Clock::time_point();
+            player->renderBlock(m_renderScratch.data() + i * count, count, false);
+            if (profiling) {
+                m_renderTimes[i] = RenderProfiler::elapsed(start);
+            }
+        }
+    });
+
+    // Mix the blocks in channel order, saturating after each one like the players do
+    // when mixing, so that the result is the same as with `renderChannels`
+    for (std::size_t i = 0; i < m_renderPlayers.size(); i++) {
+        InstrumentPlayer* player = m_renderPlayers[i];
+        if (!player->canRenderConcurrently()) {
+            auto start = profiling ? RenderProfiler::Clock::now() : RenderProfiler::Clock::time_point();
+            player->renderBlock(data, count, i != 0);
+            if (profiling) {
+                m_profiler->channelRendered(m_renderChannelIds[i], RenderProfiler::elapsed(start));
+            }
+            continue;
+        }
+
+        if (profiling) {
+            m_profiler->channelRendered(m_renderChannelIds[i], m_renderTimes[i]);
+        }
+
+        const std::int16_t* block = m_renderScratch.data() + i * count;
+        if (i == 0) {
+            std::copy(block, block + count, data);
+            continue;
+        }
+
+        for (std::uint32_t j = 0; j < count; j++) {
+            int sample = data[j] + block[j];
+            data[j] = (std::int16_t)(sample < -32768 ? -32768 : (sample > 32767 ? 32767 : sample));
+        }
+    }
+    return true;
+}
+
+PlayerStats PlayingContext::getPlayerStats() {
+    PlayerStats total;
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    for (const auto& channel : m_performanceChannels) {
+        PlayerStats stats = channel.second->getStats();
+        total.noteOns += stats.noteOns;
+        total.regionLookups += stats.regionLookups;
+        total.regionMatches += stats.regionMatches;
+    }
+    return total;
+}
+
+void PlayingContext::seek(std::uint32_t musicTime) {
+    TRACE_VALUE("Seek", musicTime);
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+
+    // A segment just started with playSegment only becomes the primary one on the
+    // next quantum, the seek would otherwise move the segment it replaces
+    if (m_nextSegment != nullptr && m_nextSegmentTiming == SegmentTiming::Immediate) {
+        m_primarySegment = std::move(m_nextSegment);
+        m_nextSegment = nullptr;
+    }
+    if (m_primarySegment == nullptr) {
+        return;
+    }
+    if (m_primarySegment->length > 0) {
+        musicTime %= m_primarySegment->length;
+    }
+
+    for (const auto& channel : m_performanceChannels) {
+        channel.second->allNotesOff();
+    }
+    QueueContents::clear(m_patternMessageQueue);
+    enqueueSegment(m_primarySegment);
+    m_quantumPosition = (std::uint32_t)m_quantum.size();
+
+    // Everything before the target but the notes is run, in order: the bands, chords,
+    // groove levels and controller curves leave the performance as playing up to there
+    // would have, and the patterns are chosen as they would have been
+    const std::uint32_t target = m_currentSegmentStart + musicTime;
+    MessageQueue* queue;
+    while ((queue = getNextQueue()) != nullptr && queue->top()->getMessageTime() < target) {
+        std::shared_ptr<MusicMessage> message = queue->top();
+        queue->pop();
+
+        MusicMessageType type = message->getMessageType();
+        if (type != MusicMessageType::NoteOn && type != MusicMessageType::NoteOff) {
+            m_musicTime = message->getMessageTime();
+            message->Execute(*this);
+        }
+    }
+
+    // The synthesizer updates its envelopes and LFOs once per block, so the audio only
+    // comes out as if the segment had played up to the target when the quanta are cut
+    // at the same frames. The quantum holding the target is rendered from its start,
+    // and the frames before the target (without notes) are dropped.
+    const std::uint64_t frame = getSegmentFrame(target);
+    const std::uint32_t early = (std::uint32_t)(frame % QuantumFrames);
+    m_musicTime = target;
+    m_segmentFrames = frame - early;
+    if (early > 0) {
+        renderQuantum(m_quantum.data(), (std::uint32_t)m_quantum.size(), 1.0f);
+        m_quantumPosition = early * m_audioChannels;
+    }
+}
+
+std::uint32_t PlayingContext::getSegmentTime() {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_musicTime - m_currentSegmentStart;
+}
+
+void PlayingContext::setSeed(std::uint64_t seed) {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_random.setSeed(seed);
+}
+
+std::uint64_t PlayingContext::getSeed() {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_random.getSeed();
+}
+
+void PlayingContext::setProfiling(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_profiler->setEnabled(enabled);
+}
+
+RenderStats PlayingContext::getRenderStats() const {
+    return m_profiler->snapshot();
+}
+
+void PlayingContext::resetRenderStats() {
+    m_profiler->requestReset();
+}
+
+static std::size_t getQueueBytes(const MessageQueue& queue) {
+    const auto& messages = QueueContents::get(queue);
+    std::size_t bytes = heapBytes(messages);
+    for (const auto& message : messages) {
+        bytes += SharedControlBytes + message->getMemoryUsage();
+    }
+    return bytes;
+}
+
+std::size_t PlayingContext::getQueueMemoryUsage() {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return getQueueBytes(m_messageQueue) + getQueueBytes(m_patternMessageQueue);
+}
+
+MemoryUsage PlayingContext::getMemoryUsage(std::vector<AssetMemoryUsage>* assets) {
+    std::shared_ptr<AssetStore> store;
+    MemoryUsage usage;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        store = m_assets;
+        usage.messageQueues = getQueueBytes(m_messageQueue) + getQueueBytes(m_patternMessageQueue);
+
+        // Players and banks can be shared by several channels and segments
+        std::set<const InstrumentPlayer*> players;
+        std::set<const void*> banks;
+        auto addPlayer = [&](const std::shared_ptr<InstrumentPlayer>& player) {
+            if (player == nullptr || !players.insert(player.get()).second) {
+                return;
+            }
+            PlayerMemoryUsage playerUsage = player->getMemoryUsage();
+            usage.players += playerUsage.bytes;
+            if (playerUsage.sharedData != nullptr && banks.insert(playerUsage.sharedData).second) {
+                usage.synthBanks += playerUsage.sharedBytes;
+            }
+        };
+
+        for (const auto& channel : m_performanceChannels) {
+            addPlayer(channel.second);
+        }
+        for (const auto& segment : { m_primarySegment, m_nextSegment }) {
+            if (segment == nullptr) {
+                continue;
+            }
+            usage.segments += segment->memoryUsage;
+            for (const auto& message : segment->messages) {
+                if (message->getMessageType() == MusicMessageType::BandChange) {
+                    for (const auto& instrument : static_cast<const BandChangeMessage&>(*message).getInstruments()) {
+                        addPlayer(instrument.second);
+                    }
+                }
+            }
+        }
+    }
+
+    MemoryUsage storeUsage = store->getMemoryUsage(assets);
+    usage.collections = storeUsage.collections;
+    usage.styles = storeUsage.styles;
+    return usage;
 }
 
 void PlayingContext::enqueueSegment(const std::shared_ptr<SegmentInfo>& segment) {
     assert(segment != nullptr);
     TRACE("Segment enqueued");
-    m_messageQueue = MessageQueue();
-    m_messageQueue.push(std::make_shared<TempoChangeMessage>(m_musicTime, segment->initialTempo));
+    QueueContents::clear(m_messageQueue);
+    m_currentSegmentStart = m_musicTime;
+    m_segmentFrames = 0;
     for (const auto& message : segment->messages) {
         m_messageQueue.push(message->Clone(message->getMessageTime() + m_musicTime));
     }
 }
 
-// Loads tempo change information into the message vector
-static void loadTempoTrack(const TrackForm& track, std::vector<std::shared_ptr<MusicMessage>>& messageVector) {
+// Adds the tempo changes of a track to those the segment's tempo map is compiled from
+static void loadTempoTrack(const TrackForm& track, std::vector<DMUS_IO_TEMPO_ITEM>& tempos) {
     auto tempoTrack = std::static_pointer_cast<TempoTrack>(track.getData());
-    for (const auto& item : tempoTrack->getItems()) {
-        auto message = std::make_shared<TempoChangeMessage>(item.lTime, item.dblTempo);
-        assert(message != nullptr);
-        messageVector.push_back(message);
-    }
+    tempos.insert(tempos.end(), tempoTrack->getItems().begin(), tempoTrack->getItems().end());
+}
+
+// Adds the time signature changes of a track to those the segment's tempo map is compiled from
+static void loadTimeSignatureTrack(const TrackForm& track, std::vector<DMUS_IO_TIMESIGNATURE_ITEM>& signatures) {
+    auto signatureTrack = std::static_pointer_cast<TimeSignatureTrack>(track.getData());
+    signatures.insert(signatures.end(), signatureTrack->getItems().begin(), signatureTrack->getItems().end());
 }
 
 // Loads commands information (for now only groove level changes) into the message vector
 static void loadCommandTrack(const TrackForm& track, std::vector<std::shared_ptr<MusicMessage>>& messageVector) {
     auto commandTrack = std::static_pointer_cast<CommandTrack>(track.getData());
     for (const auto& command : commandTrack->getCommands()) {
-        auto message = std::make_shared<GrooveLevelMessage>(command.mtTime, command.bGrooveLevel, command.bGrooveRange);
+        auto message = makeMessage<GrooveLevelMessage>(command.mtTime, command.bGrooveLevel, command.bGrooveRange);
         assert(message != nullptr);
         messageVector.push_back(message);
     }
@@ -195,7 +675,7 @@ static void loadBandTrack(const TrackForm& track, std::vector<std::shared_ptr<Mu
         DMUS_IO_BAND_ITEM_HEADER2 header = band.first;
         BandForm bandForm = band.second;
 
-        auto message = std::make_shared<BandChangeMessage>(ctx, header.lBandTimePhysical, bandForm);
+        auto message = makeMessage<BandChangeMessage>(ctx, header.lBandTimePhysical, bandForm);
         messageVector.push_back(message);
     }
 }
@@ -206,21 +686,107 @@ static void loadChordTrack(const TrackForm& track, std::vector<std::shared_ptr<M
     for (const auto& chord : chordTrack->getChords()) {
         const auto& chordHeader = chord.first;
         const auto& chordBody = chord.second;
-        auto message = std::make_shared<ChordMessage>(chordHeader.mtTime, chordTrack->getHeader(), std::move(chordBody));
+        auto message = makeMessage<ChordMessage>(chordHeader.mtTime, chordTrack->getHeader(), std::move(chordBody));
         messageVector.push_back(message);
     }
 }
 
+void PlayingContext::preload(const SegmentForm& segment) {
+    TRACE_SCOPE("load", "Preload segment");
+    std::vector<std::pair<GUID, std::string>> styleRefs;
+    std::vector<BandForm> bands;
+    for (const auto& track : segment.getTracks()) {
+        const auto& header = track.getHeader();
+        std::string fccType = std::string(header.fccType);
+        fccType.resize(4);
+
+        if (*header.ckid == 0 && fccType == "sttr") {
+            auto styleTrack = std::static_pointer_cast<StyleTrack>(track.getData());
+            for (const auto& style : styleTrack->getStyles()) {
+                styleRefs.push_back(std::make_pair(style.second.getGuid(), style.second.getFile()));
+            }
+        } else if (*header.ckid == 0 && fccType == "DMBT") {
+            auto bandTrack = std::static_pointer_cast<BandTrack>(track.getData());
+            for (const auto& band : bandTrack->getBands()) {
+                bands.push_back(band.second);
+            }
+        }
+    }
+
+    // Failures are ignored here: loading again while preparing the segment reports them
+    std::vector<std::shared_ptr<StyleForm>> styles(styleRefs.size());
+    auto scheduler = getScheduler();
+    scheduler->parallelFor(styleRefs.size(), [&](std::size_t i) {
+        try {
+            styles[i] = loadStyle(styleRefs[i].first, styleRefs[i].second);
+        } catch (...) {}
+    });
+
+    for (const auto& style : styles) {
+        if (style != nullptr) {
+            bands.insert(bands.end(), style->getBands().begin(), style->getBands().end());
+        }
+    }
+
+    // Keyed like the store's cache, so that every collection is loaded once
+    std::map<GUID, std::tuple<GUID, GUID, std::string>> collectionRefs;
+    for (const auto& band : bands) {
+        for (const auto& instr : band.getInstruments()) {
+            const auto ref = instr.getReference();
+            if (ref != nullptr) {
+                collectionRefs[ref->getGuid() ^ band.getGuid()] = std::make_tuple(ref->getGuid(), band.getGuid(), ref->getFile());
+            }
+        }
+    }
+
+    std::vector<std::tuple<GUID, GUID, std::string>> collections;
+    for (const auto& ref : collectionRefs) {
+        collections.push_back(ref.second);
+    }
+
+    scheduler->parallelFor(collections.size(), [&](std::size_t i) {
+        try {
+            loadInstrumentCollection(std::get<0>(collections[i]), std::get<1>(collections[i]), std::get<2>(collections[i]));
+        } catch (...) {}
+    });
+}
+
+void PlayingContext::prefetchSegment(const std::shared_ptr<SegmentForm>& segment) {
+    {
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        m_pendingPrefetches++;
+    }
+
+    getScheduler()->async([this, segment] {
+        try {
+            preload(*segment);
+        } catch (...) {}
+
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        m_pendingPrefetches--;
+        m_prefetchDone.notify_all();
+    });
+}
+
 std::shared_ptr<SegmentInfo> PlayingContext::prepareSegment(const SegmentForm& segment) {
-    TRACE("Preparing segment");
+    TRACE_SCOPE("load", "Prepare segment");
+    {
+        // Don't load again what a prefetch is already loading
+        std::unique_lock<std::mutex> lock(m_prefetchMutex);
+        m_prefetchDone.wait(lock, [this] { return m_pendingPrefetches == 0; });
+    }
+    preload(segment);
+
     auto newSegment = std::make_shared<SegmentInfo>();
     newSegment->numLoops = segment.getHeader().dwRepeats;
     newSegment->infiniteLoop = false;
     newSegment->length = segment.getHeader().mtLength;
-    newSegment->messages.push_back(std::make_shared<SegmentEndMessage>(newSegment->length));
+    newSegment->messages.push_back(makeMessage<SegmentEndMessage>(newSegment->length));
     newSegment->guid = segment.getGuid();
     newSegment->unfo = segment.getInfo();
 
+    std::vector<DMUS_IO_TEMPO_ITEM> tempos;
+    std::vector<DMUS_IO_TIMESIGNATURE_ITEM> signatures;
     for (const auto& track : segment.getTracks()) {
         const auto& header = track.getHeader();
         std::string ckid = std::string(header.ckid),
@@ -230,7 +796,7 @@ std::shared_ptr<SegmentInfo> PlayingContext::prepareSegment(const SegmentForm& s
         fccType.resize(4);
 
         if (ckid == "tetr") {
-            loadTempoTrack(track, newSegment->messages);
+            loadTempoTrack(track, tempos);
         } else if (ckid == "cmnd") {
             loadCommandTrack(track, newSegment->messages);
         } else if (*header.ckid == 0 && fccType == "sttr") {
@@ -270,7 +836,7 @@ std::shared_ptr<SegmentInfo> PlayingContext::prepareSegment(const SegmentForm& s
                 // Load the style's band
                 bool firstBand = true;
                 for (const auto& band : styleForm->getBands()) {
-                    auto message = std::make_shared<BandChangeMessage>(*this, 0, band);
+                    auto message = makeMessage<BandChangeMessage>(*this, 0, band);
                     newSegment->messages.push_back(message);
                 }
 
@@ -282,12 +848,51 @@ std::shared_ptr<SegmentInfo> PlayingContext::prepareSegment(const SegmentForm& s
             loadBandTrack(track, newSegment->messages, *this);
         } else if (*header.ckid == 0 && fccType == "cord") {
             loadChordTrack(track, newSegment->messages);
+        } else if (*header.ckid == 0 && fccType == "TIMS") {
+            loadTimeSignatureTrack(track, signatures);
+        }
+    }
+
+    newSegment->tempoMap = TempoMap(newSegment->initialTempo, newSegment->initialSignature, tempos, signatures);
+
+    // The channels the bands add are made room for now rather than on the audio thread
+    std::set<std::uint32_t> channels;
+    for (const auto& message : newSegment->messages) {
+        if (message->getMessageType() == MusicMessageType::BandChange) {
+            for (const auto& instrument : static_cast<const BandChangeMessage&>(*message).getInstruments()) {
+                channels.insert(instrument.first);
+            }
         }
     }
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        for (const auto& channel : m_performanceChannels) {
+            channels.insert(channel.first);
+        }
+        reserveParallelRender(channels.size());
+    }
+
+    std::size_t bytes = sizeof(SegmentInfo) + SharedControlBytes + heapBytes(newSegment->patterns)
+        + heapBytes(newSegment->messages) + heapBytes(newSegment->unfo) + newSegment->tempoMap.getMemoryUsage();
+    for (const auto& pattern : newSegment->patterns) {
+        bytes += heapBytes(pattern.parts);
+        for (const auto& part : pattern.parts) {
+            bytes += heapBytes(part.second);
+        }
+    }
+    for (const auto& message : newSegment->messages) {
+        bytes += SharedControlBytes + message->getMemoryUsage();
+    }
+    newSegment->memoryUsage = bytes;
+    trackMemory(MemoryCategory::Segments, (std::int64_t)bytes);
 
     return newSegment;
 }
 
+SegmentInfo::~SegmentInfo() {
+    trackMemory(MemoryCategory::Segments, -(std::int64_t)memoryUsage);
+}
+
 void PlayingContext::playSegment(const SegmentForm& segment, SegmentTiming timing) {
     auto newSegment = prepareSegment(segment);
     playSegment(newSegment, timing);
@@ -311,69 +916,36 @@ void PlayingContext::playSegment(std::shared_ptr<SegmentInfo> segment, SegmentTi
     m_queueMutex.unlock();
 }
 
-bool PlayingContext::getRandomPattern(const SegmentInfo& segm, std::uint8_t grooveLevel, Pattern* output) const {
-    std::vector<int> suitablePatterns;
-    for (size_t i = 0; i < segm.patterns.size(); i++) {
-        const auto& pattern = segm.patterns[i];
-        if (pattern.header.bGrooveBottom <= grooveLevel &&
+bool PlayingContext::getRandomPattern(const SegmentInfo& segm, std::uint8_t grooveLevel, const Pattern** output) {
+    auto isSuitable = [&](const Pattern& pattern) {
+        return pattern.header.bGrooveBottom <= grooveLevel &&
             pattern.header.bGrooveTop >= grooveLevel &&
-            pattern.header.wEmbellishment == DMUS_EMBELLISHT_NORMAL) {
-            suitablePatterns.push_back(i);
-        }
-    }
+            pattern.header.wEmbellishment == DMUS_EMBELLISHT_NORMAL;
+    };
 
-    if (suitablePatterns.size() == 0) {
+    // Counted first and then walked again, so that choosing a pattern allocates nothing
+    std::size_t suitablePatterns = std::count_if(segm.patterns.begin(), segm.patterns.end(), isSuitable);
+    if (suitablePatterns == 0) {
         return false;
-    } else if (suitablePatterns.size() == 1) {
-        *output = segm.patterns[suitablePatterns[0]];
-        return true;
-    } else {
-        int idx = std::rand();
-        *output = segm.patterns[suitablePatterns[idx % suitablePatterns.size()]];
-        return true;
     }
-}
 
-std::shared_ptr<DirectMusic::DLS::DownloadableSound> PlayingContext::loadInstrumentCollection(const GUID& guid, const GUID& bandGuid, const std::string& file) {
-    std::shared_ptr<DirectMusic::DLS::DownloadableSound> band = nullptr;
-    GUID id = guid ^ bandGuid;
-
-    if (m_bands.find(id) == m_bands.end()) {
-        TRACE("Loading new band");
-        std::vector<std::uint8_t> data = m_loader(file);
-        band = genObjFromChunkData<DirectMusic::DLS::DownloadableSound>(data);
-
-        if (band == nullptr) {
-            throw std::runtime_error("Couldn't load band: " + file);
+    std::size_t choice = 0;
+    if (suitablePatterns > 1) {
+        choice = m_random.next((std::uint32_t)suitablePatterns);
+    }
+    for (const auto& pattern : segm.patterns) {
+        if (isSuitable(pattern) && choice-- == 0) {
+            *output = &pattern;
+            break;
         }
-
-        m_bands[id] = band;
-    } else {
-        TRACE("Band found in cache");
-        band = m_bands.at(id);
     }
+    return true;
+}
 
-    return band;
+std::shared_ptr<DirectMusic::DLS::DownloadableSound> PlayingContext::loadInstrumentCollection(const GUID& guid, const GUID& bandGuid, const std::string& file) {
+    return m_assets->loadInstrumentCollection(guid, bandGuid, file);
 }
 
 std::shared_ptr<StyleForm> PlayingContext::loadStyle(const GUID& guid, const std::string& file) {
-    std::shared_ptr<StyleForm> style = nullptr;
-    auto key = std::make_pair(guid, file);
-
-    if (m_styles.find(key) == m_styles.end()) {
-        TRACE("Loading new style");
-        std::vector<std::uint8_t> data = m_loader(file);
-        style = genObjFromChunkData<StyleForm>(data);
-
-        if (style == nullptr) {
-            throw std::runtime_error("Couldn't load style: " + file);
-        }
-
-        m_styles[key] = style;
-    } else {
-        TRACE("Style found in cache");
-        style = m_styles.at(key);
-    }
-
-    return style;
+    return m_assets->loadStyle(guid, file);
 }
\ No newline at end of file
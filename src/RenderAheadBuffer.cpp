@@ -0,0 +1,137 @@
+#include <dmusic/RenderAheadBuffer.h>
+#include <algorithm>
+#include <chrono>
+
+using namespace DirectMusic;
+
+// How long the rendering thread sleeps when the buffer is full enough
+static const std::chrono::milliseconds IdleWait(1);
+
+static std::uint32_t calcAheadSamples(const PlayingContext& context, std::uint32_t aheadMilliseconds) {
+    std::uint32_t quantum = PlayingContext::QuantumFrames * context.getAudioChannels();
+    std::uint64_t frames = (std::uint64_t)aheadMilliseconds * context.getSampleRate() / 1000;
+    std::uint64_t samples = frames * context.getAudioChannels();
+    return (std::uint32_t)std::max<std::uint64_t>(samples, 2 * quantum);
+}
+
+static std::size_t calcRingSize(std::uint32_t minSize) {
+    std::size_t size = 1;
+    while (size < minSize) {
+        size <<= 1;
+    }
+    return size;
+}
+
+RenderAheadBuffer::RenderAheadBuffer(PlayingContext& context, std::uint32_t aheadMilliseconds)
+    : m_context(context)
+    , m_channels(context.getAudioChannels())
+    , m_aheadSamples(calcAheadSamples(context, aheadMilliseconds))
+    // One more quantum, as the rendering thread renders a whole one when the buffer is
+    // not full enough
+    , m_ring(calcRingSize(m_aheadSamples + PlayingContext::QuantumFrames * m_channels))
+    , m_readPosition(0)
+    , m_writePosition(0)
+    , m_underruns(0)
+    , m_failedCommands(0)
+    , m_stop(false)
+{
+    m_thread = std::thread(&RenderAheadBuffer::renderLoop, this);
+}
+
+RenderAheadBuffer::~RenderAheadBuffer() {
+    m_stop = true;
+    m_thread.join();
+}
+
+void RenderAheadBuffer::read(std::int16_t *data, std::uint32_t count) noexcept {
+    std::uint64_t readPosition = m_readPosition.load(std::memory_order_relaxed);
+    std::uint64_t available = m_writePosition.load(std::memory_order_acquire) - readPosition;
+    std::uint32_t copied = (std::uint32_t)std::min<std::uint64_t>(available, count);
+
+    std::size_t mask = m_ring.size() - 1;
+    for (std::uint32_t i = 0; i < copied; i++) {
+        data[i] = m_ring[(readPosition + i) & mask];
+    }
+
+    if (copied < count) {
+        std::fill(data + copied, data + count, std::int16_t(0));
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_readPosition.store(readPosition + copied, std::memory_order_release);
+}
+
+void RenderAheadBuffer::read(std::int16_t *data, std::uint32_t frames, const OutputLayout& layout) noexcept {
+    std::fill(data, data + frames * layout.channels, std::int16_t(0));
+
+    std::uint64_t readPosition = m_readPosition.load(std::memory_order_relaxed);
+    std::uint64_t available = (m_writePosition.load(std::memory_order_acquire) - readPosition) / m_channels;
+    std::uint32_t copied = (std::uint32_t)std::min<std::uint64_t>(available, frames);
+
+    // The frames to copy may wrap around the end of the ring. Its size being a power of two,
+    // it holds whole frames of one or two channels.
+    std::size_t start = readPosition & (m_ring.size() - 1);
+    std::uint32_t first = (std::uint32_t)std::min<std::size_t>(copied, (m_ring.size() - start) / m_channels);
+    layout.copyFrames(m_ring.data() + start, m_channels, first, data, 0, frames);
+    layout.copyFrames(m_ring.data(), m_channels, copied - first, data, first, frames);
+
+    if (copied < frames) {
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_readPosition.store(readPosition + copied * m_channels, std::memory_order_release);
+}
+
+void RenderAheadBuffer::post(std::function<void(PlayingContext&)> command) {
+    std::uint64_t position = m_readPosition.load(std::memory_order_acquire) + m_aheadSamples;
+    position -= position % m_channels;
+
+    std::lock_guard<std::mutex> lock(m_commandMutex);
+    m_commands.push_back(Command{ position, std::move(command) });
+}
+
+void RenderAheadBuffer::renderLoop() {
+    const std::uint32_t quantum = PlayingContext::QuantumFrames * m_channels;
+    const std::size_t mask = m_ring.size() - 1;
+
+    while (!m_stop) {
+        // Rendering a whole quantum must not go past read + m_aheadSamples, where the
+        // commands posted from now on run, else they would run late
+        std::uint64_t writePosition = m_writePosition.load(std::memory_order_relaxed);
+        if (writePosition - m_readPosition.load(std::memory_order_acquire) > m_aheadSamples - quantum) {
+            std::this_thread::sleep_for(IdleWait);
+            continue;
+        }
+
+        // Run the commands which are due, and stop the rendering at the next one
+        std::uint64_t end = writePosition + quantum;
+        {
+            std::unique_lock<std::mutex> lock(m_commandMutex);
+            while (!m_commands.empty() && m_commands.front().position <= writePosition) {
+                auto command = std::move(m_commands.front().function);
+                m_commands.pop_front();
+                lock.unlock();
+                try {
+                    command(m_context);
+                } catch (...) {
+                    m_failedCommands.fetch_add(1, std::memory_order_relaxed);
+                }
+                lock.lock();
+            }
+            if (!m_commands.empty() && m_commands.front().position < end) {
+                end = m_commands.front().position;
+            }
+        }
+
+        // The block may wrap around the end of the ring
+        std::size_t start = writePosition & mask;
+        std::uint32_t count = (std::uint32_t)(end - writePosition);
+        std::uint32_t first = (std::uint32_t)std::min<std::size_t>(count, m_ring.size() - start);
+        m_context.renderBlock(m_ring.data() + start, first);
+        if (first < count) {
+            m_context.renderBlock(m_ring.data(), count - first);
+        }
+
+        m_writePosition.store(end, std::memory_order_release);
+    }
+}
@@ -0,0 +1,208 @@
+#include "RenderProfiler.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+using namespace DirectMusic;
+
+static std::size_t bucketIndex(std::uint64_t value) {
+    if (value < 4) {
+        return (std::size_t)value;
+    }
+
+    // The power of two, then the next two bits
+    std::size_t exponent = 63;
+    while ((value >> exponent) == 0) {
+        exponent--;
+    }
+    return 4 * (exponent - 1) + ((value >> (exponent - 2)) & 3);
+}
+
+// The largest value which falls in the bucket
+static std::uint64_t bucketLimit(std::size_t index) {
+    if (index < 4) {
+        return index;
+    }
+    std::size_t exponent = index / 4 + 1;
+    std::uint64_t step = std::uint64_t(1) << (exponent - 2);
+    return (4 + index % 4) * step + step - 1;
+}
+
+void RenderProfiler::Histogram::record(std::uint64_t value) noexcept {
+    if (count == 0 || value < min) {
+        min = value;
+    }
+    if (value > max) {
+        max = value;
+    }
+    count++;
+    sum += value;
+    buckets[std::min(bucketIndex(value), Buckets - 1)]++;
+}
+
+HistogramSummary RenderProfiler::Histogram::summary() const noexcept {
+    HistogramSummary summary;
+    if (count == 0) {
+        return summary;
+    }
+
+    summary.count = count;
+    summary.min = min;
+    summary.max = max;
+    summary.mean = (double)sum / count;
+
+    // The first bucket reaching 99% of the values
+    std::uint64_t target = count - count / 100;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < Buckets; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            std::uint64_t limit = i < Buckets - 1 ? bucketLimit(i) : max;
+            summary.p99 = limit < max ? limit : max;
+            break;
+        }
+    }
+    return summary;
+}
+
+RenderProfiler::RenderProfiler()
+    : m_resetRequested(false)
+    , m_sequence(0)
+{
+    clear();
+    for (auto& word : m_published) {
+        word.store(0, std::memory_order_relaxed);
+    }
+}
+
+void RenderProfiler::clear() noexcept {
+    std::memset((void*)&m_data, 0, sizeof(m_data));
+    m_quantumEvents = 0;
+    m_quantumSubBlocks = 0;
+}
+
+void RenderProfiler::setEnabled(bool enabled) noexcept {
+    if (enabled && !m_enabled) {
+        clear();
+        publish();
+    }
+    m_enabled = enabled;
+}
+
+void RenderProfiler::beginBlock() noexcept {
+    if (m_resetRequested.exchange(false, std::memory_order_relaxed)) {
+        clear();
+    }
+}
+
+void RenderProfiler::endBlock(std::uint64_t nanoseconds) noexcept {
+    m_data.blocks++;
+    m_data.blockTime.record(nanoseconds);
+    publish();
+}
+
+void RenderProfiler::beginQuantum() noexcept {
+    m_quantumEvents = 0;
+    m_quantumSubBlocks = 0;
+}
+
+void RenderProfiler::endQuantum(std::uint64_t nanoseconds, std::uint64_t activeVoices, std::uint64_t queueDepth) noexcept {
+    std::uint64_t splits = m_quantumSubBlocks > 1 ? m_quantumSubBlocks - 1 : 0;
+    m_data.quanta++;
+    m_data.eventsDispatched += m_quantumEvents;
+    m_data.subBlockSplits += splits;
+    m_data.quantumTime.record(nanoseconds);
+    m_data.activeVoices.record(activeVoices);
+    m_data.eventsPerQuantum.record(m_quantumEvents);
+    m_data.splitsPerQuantum.record(splits);
+    m_data.queueDepth.record(queueDepth);
+}
+
+void RenderProfiler::channelRendered(std::uint32_t channel, std::uint64_t nanoseconds) noexcept {
+    m_data.channelTime.record(nanoseconds);
+
+    Channel* entry = nullptr;
+    for (std::uint64_t i = 0; i < m_data.channelCount; i++) {
+        if (m_data.channels[i].channel == channel) {
+            entry = &m_data.channels[i];
+            break;
+        }
+    }
+    if (entry == nullptr) {
+        if (m_data.channelCount == RenderStats::MaxChannels) {
+            return;
+        }
+        entry = &m_data.channels[m_data.channelCount++];
+        entry->channel = channel;
+    }
+
+    entry->renders++;
+    entry->total += nanoseconds;
+    if (nanoseconds > entry->max) {
+        entry->max = nanoseconds;
+    }
+}
+
+void RenderProfiler::publish() noexcept {
+    const char* data = reinterpret_cast<const char*>(&m_data);
+    std::uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (std::size_t i = 0; i < Words; i++) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i * sizeof(word), sizeof(word));
+        m_published[i].store(word, std::memory_order_relaxed);
+    }
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+RenderStats RenderProfiler::snapshot() const {
+    std::unique_ptr<Data> data(new Data);
+    char* output = reinterpret_cast<char*>(data.get());
+
+    while (true) {
+        std::uint64_t before = m_sequence.load(std::memory_order_acquire);
+        if (before % 2 == 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (std::size_t i = 0; i < Words; i++) {
+            std::uint64_t word = m_published[i].load(std::memory_order_relaxed);
+            std::memcpy(output + i * sizeof(word), &word, sizeof(word));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == before) {
+            break;
+        }
+    }
+
+    RenderStats stats;
+    stats.blocks = data->blocks;
+    stats.quanta = data->quanta;
+    stats.silentQuanta = data->silentQuanta;
+    stats.eventsDispatched = data->eventsDispatched;
+    stats.subBlockSplits = data->subBlockSplits;
+    stats.patternGenerations = data->patternGenerations;
+    stats.blockTime = data->blockTime.summary();
+    stats.quantumTime = data->quantumTime.summary();
+    stats.channelTime = data->channelTime.summary();
+    stats.activeVoices = data->activeVoices.summary();
+    stats.eventsPerQuantum = data->eventsPerQuantum.summary();
+    stats.splitsPerQuantum = data->splitsPerQuantum.summary();
+    stats.queueDepth = data->queueDepth.summary();
+
+    for (std::uint64_t i = 0; i < data->channelCount && i < RenderStats::MaxChannels; i++) {
+        ChannelRenderStats channel;
+        channel.channel = (std::uint32_t)data->channels[i].channel;
+        channel.renders = data->channels[i].renders;
+        channel.totalNanoseconds = data->channels[i].total;
+        channel.maxNanoseconds = data->channels[i].max;
+        stats.channels.push_back(channel);
+    }
+    return stats;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <dmusic/RenderStats.h>
+
+namespace DirectMusic {
+    /** \brief Collects the RenderStats of a PlayingContext
+     * Everything but `snapshot` and `requestReset` is called by the rendering thread,
+     * with the queue mutex of the context held. The statistics are accumulated in
+     * a copy owned by that thread and published at the end of every block through
+     * a sequence lock: readers retry when they overlap a publication instead of
+     * making the rendering thread wait.
+     */
+    class RenderProfiler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        RenderProfiler();
+
+        RenderProfiler(const RenderProfiler&) = delete;
+        RenderProfiler& operator=(const RenderProfiler&) = delete;
+
+        /// Enabling clears the statistics
+        void setEnabled(bool enabled) noexcept;
+        bool isEnabled() const noexcept { return m_enabled; }
+
+        static std::uint64_t elapsed(Clock::time_point start) noexcept {
+            return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        }
+
+        void beginBlock() noexcept;
+        void endBlock(std::uint64_t nanoseconds) noexcept;
+        void beginQuantum() noexcept;
+        void endQuantum(std::uint64_t nanoseconds, std::uint64_t activeVoices, std::uint64_t queueDepth) noexcept;
+        void silentQuanta(std::uint32_t quanta) noexcept { m_data.silentQuanta += quanta; }
+        void subBlock() noexcept { m_quantumSubBlocks++; }
+        void eventDispatched() noexcept { m_quantumEvents++; }
+        void patternGenerated() noexcept { m_data.patternGenerations++; }
+        void channelRendered(std::uint32_t channel, std::uint64_t nanoseconds) noexcept;
+
+        /// Returns the statistics as of the end of the last block. Any thread may call it.
+        RenderStats snapshot() const;
+
+        /// Clears the statistics at the beginning of the next block. Any thread may call it.
+        void requestReset() noexcept { m_resetRequested.store(true, std::memory_order_relaxed); }
+
+    private:
+        // Four buckets per power of two up to 2^41, the last one holding anything larger
+        static const std::size_t Buckets = 160;
+
+        struct Histogram {
+            std::uint64_t count, sum, min, max;
+            std::uint64_t buckets[Buckets];
+
+            void record(std::uint64_t value) noexcept;
+            HistogramSummary summary() const noexcept;
+        };
+
+        struct Channel {
+            std::uint64_t channel, renders, total, max;
+        };
+
+        // Only made of 64-bit words, which are published one by one
+        struct Data {
+            std::uint64_t blocks, quanta, silentQuanta, eventsDispatched, subBlockSplits, patternGenerations;
+            Histogram blockTime, quantumTime, channelTime, activeVoices, eventsPerQuantum, splitsPerQuantum, queueDepth;
+            std::uint64_t channelCount;
+            Channel channels[RenderStats::MaxChannels];
+        };
+
+        static const std::size_t Words = sizeof(Data) / sizeof(std::uint64_t);
+
+        void clear() noexcept;
+        void publish() noexcept;
+
+        bool m_enabled = false;
+        Data m_data;
+        std::uint64_t m_quantumEvents = 0;
+        std::uint64_t m_quantumSubBlocks = 0;
+
+        std::atomic<bool> m_resetRequested;
+        std::atomic<std::uint64_t> m_sequence; //< Odd while publishing
+        std::atomic<std::uint64_t> m_published[Words];
+    };
+}
@@ -0,0 +1,161 @@
+#include <dmusic/TempoMap.h>
+#include <dmusic/PlayingContext.h>
+#include <algorithm>
+
+using namespace DirectMusic;
+
+constexpr double TempoMap::DefaultTempo;
+
+static double getSecondsPerPulse(double tempo) {
+    return 60.0 / (tempo * PlayingContext::PulsesPerQuarterNote);
+}
+
+static std::uint32_t getBeatLength(const DMUS_IO_TIMESIG& signature) {
+    std::uint32_t length;
+    if (signature.bBeat == 0) {
+        length = PlayingContext::PulsesPerQuarterNote / 64;
+    } else if (signature.bBeat <= 4) {
+        length = PlayingContext::PulsesPerQuarterNote * (4 / signature.bBeat);
+    } else {
+        length = PlayingContext::PulsesPerQuarterNote / (signature.bBeat / 4);
+    }
+    return length == 0 ? 1 : length;
+}
+
+// The times of the items are signed MUSIC_TIMEs, read as unsigned
+static std::int32_t getSignedTime(std::uint32_t time) {
+    return (std::int32_t)time;
+}
+
+DMUS_IO_TIMESIG TempoMap::getDefaultSignature() noexcept {
+    DMUS_IO_TIMESIG signature;
+    signature.bBeatsPerMeasure = 4;
+    signature.bBeat = 4;
+    signature.wGridsPerBeat = 4;
+    return signature;
+}
+
+TempoMap::TempoMap()
+    : TempoMap(DefaultTempo, getDefaultSignature(), {}, {}) {}
+
+TempoMap::TempoMap(double initialTempo, const DMUS_IO_TIMESIG& initialSignature,
+    const std::vector<DMUS_IO_TEMPO_ITEM>& tempos,
+    const std::vector<DMUS_IO_TIMESIGNATURE_ITEM>& signatures) {
+    // Changes before the start apply from it, the last of them replacing the initial tempo
+    std::vector<DMUS_IO_TEMPO_ITEM> sortedTempos(tempos);
+    std::stable_sort(sortedTempos.begin(), sortedTempos.end(), [](const DMUS_IO_TEMPO_ITEM& a, const DMUS_IO_TEMPO_ITEM& b) {
+        return getSignedTime(a.lTime) < getSignedTime(b.lTime);
+    });
+    for (auto& item : sortedTempos) {
+        item.lTime = getSignedTime(item.lTime) < 0 ? 0 : item.lTime;
+    }
+
+    m_tempos.push_back({ 0, 0, getSecondsPerPulse(initialTempo > 0 ? initialTempo : DefaultTempo) });
+    for (const auto& item : sortedTempos) {
+        if (item.dblTempo <= 0) {
+            continue;
+        }
+
+        // Of several changes at the same time, the last one read wins
+        TempoPoint& last = m_tempos.back();
+        if (item.lTime == last.musicTime) {
+            last.secondsPerPulse = getSecondsPerPulse(item.dblTempo);
+            continue;
+        }
+
+        double seconds = last.seconds + (item.lTime - last.musicTime) * last.secondsPerPulse;
+        m_tempos.push_back({ (double)item.lTime, seconds, getSecondsPerPulse(item.dblTempo) });
+    }
+
+    std::vector<DMUS_IO_TIMESIGNATURE_ITEM> sortedSignatures(signatures);
+    std::stable_sort(sortedSignatures.begin(), sortedSignatures.end(), [](const DMUS_IO_TIMESIGNATURE_ITEM& a, const DMUS_IO_TIMESIGNATURE_ITEM& b) {
+        return getSignedTime(a.lTime) < getSignedTime(b.lTime);
+    });
+    for (auto& item : sortedSignatures) {
+        item.lTime = getSignedTime(item.lTime) < 0 ? 0 : item.lTime;
+    }
+
+    m_signatures.push_back({ 0, initialSignature });
+    for (const auto& item : sortedSignatures) {
+        DMUS_IO_TIMESIG signature;
+        signature.bBeatsPerMeasure = item.bBeatsPerMeasure;
+        signature.bBeat = item.bBeat;
+        signature.wGridsPerBeat = item.wGridsPerBeat;
+
+        if (item.lTime == m_signatures.back().musicTime) {
+            m_signatures.back().signature = signature;
+        } else {
+            m_signatures.push_back({ item.lTime, signature });
+        }
+    }
+}
+
+const TempoMap::TempoPoint& TempoMap::findTempo(double musicTime) const noexcept {
+    auto next = std::upper_bound(m_tempos.begin() + 1, m_tempos.end(), musicTime, [](double time, const TempoPoint& point) {
+        return time < point.musicTime;
+    });
+    return *(next - 1);
+}
+
+const TempoMap::SignaturePoint& TempoMap::findSignature(std::uint32_t musicTime) const noexcept {
+    auto next = std::upper_bound(m_signatures.begin() + 1, m_signatures.end(), musicTime, [](std::uint32_t time, const SignaturePoint& point) {
+        return time < point.musicTime;
+    });
+    return *(next - 1);
+}
+
+double TempoMap::getSeconds(double musicTime) const noexcept {
+    if (musicTime <= 0) {
+        return 0;
+    }
+    const TempoPoint& point = findTempo(musicTime);
+    return point.seconds + (musicTime - point.musicTime) * point.secondsPerPulse;
+}
+
+double TempoMap::getMusicTime(double seconds) const noexcept {
+    if (seconds <= 0) {
+        return 0;
+    }
+    auto next = std::upper_bound(m_tempos.begin() + 1, m_tempos.end(), seconds, [](double time, const TempoPoint& point) {
+        return time < point.seconds;
+    });
+    const TempoPoint& point = *(next - 1);
+    return point.musicTime + (seconds - point.seconds) / point.secondsPerPulse;
+}
+
+double TempoMap::getTempo(double musicTime) const noexcept {
+    return 60.0 / (findTempo(musicTime).secondsPerPulse * PlayingContext::PulsesPerQuarterNote);
+}
+
+DMUS_IO_TIMESIG TempoMap::getSignature(std::uint32_t musicTime) const noexcept {
+    return findSignature(musicTime).signature;
+}
+
+std::uint32_t TempoMap::getNextDivision(std::uint32_t musicTime, bool measure) const noexcept {
+    const SignaturePoint& point = findSignature(musicTime);
+    std::uint32_t length = getBeatLength(point.signature);
+    if (measure && point.signature.bBeatsPerMeasure > 1) {
+        length *= point.signature.bBeatsPerMeasure;
+    }
+
+    std::uint32_t next = point.musicTime + ((musicTime - point.musicTime) / length + 1) * length;
+
+    // A time signature change interrupts the current measure
+    const SignaturePoint* following = &point + 1;
+    if (following != m_signatures.data() + m_signatures.size() && following->musicTime < next) {
+        next = following->musicTime;
+    }
+    return next;
+}
+
+std::uint32_t TempoMap::getNextBeat(std::uint32_t musicTime) const noexcept {
+    return getNextDivision(musicTime, false);
+}
+
+std::uint32_t TempoMap::getNextMeasure(std::uint32_t musicTime) const noexcept {
+    return getNextDivision(musicTime, true);
+}
+
+std::size_t TempoMap::getMemoryUsage() const noexcept {
+    return m_tempos.capacity() * sizeof(TempoPoint) + m_signatures.capacity() * sizeof(SignaturePoint);
+}
@@ -0,0 +1,185 @@
+#include <dmusic/Trace.h>
+#include <chrono>
+
+using namespace DirectMusic;
+
+// How long the drain thread sleeps between two passes over the ring
+static const std::chrono::milliseconds DrainInterval(10);
+
+static std::uint64_t now() noexcept {
+    return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Numbers the threads in the order they record their first event
+static std::uint32_t currentThread() noexcept {
+    static std::atomic<std::uint32_t> threadCount(0);
+    thread_local std::uint32_t thread = ++threadCount;
+    return thread;
+}
+
+Tracer& Tracer::get() {
+    static Tracer tracer;
+    return tracer;
+}
+
+bool Tracer::isAvailable() noexcept {
+#if DMUSIC_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+Tracer::Tracer()
+    : m_writePosition(0)
+    , m_recording(false)
+    , m_dropped(0)
+    , m_stopDrain(false) {}
+
+Tracer::~Tracer() {
+    stop();
+}
+
+void Tracer::start(std::size_t capacity) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_drainThread.joinable()) {
+        return;
+    }
+
+    // The ring is never freed while the process runs: a thread may still be writing
+    // into it after tracing is stopped
+    if (m_ring == nullptr) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_ring.reset(new Cell[size]);
+        for (std::size_t i = 0; i < size; i++) {
+            m_ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_mask = size - 1;
+    }
+
+    m_epoch = now();
+    m_stopDrain = false;
+    m_drainThread = std::thread(&Tracer::drainLoop, this);
+    m_recording.store(true, std::memory_order_release);
+}
+
+void Tracer::stop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_drainThread.joinable()) {
+        return;
+    }
+
+    m_recording.store(false, std::memory_order_relaxed);
+    m_stopDrain = true;
+    std::thread thread = std::move(m_drainThread);
+    lock.unlock();
+
+    thread.join();
+    drain();
+}
+
+void Tracer::record(TraceEventType type, const char* category, const char* name, double value, bool hasValue) noexcept {
+    if (!m_recording.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // Bounded multi-producer queue: every cell carries the position it can be written
+    // at, and the position it can be read at once written
+    std::size_t position = m_writePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &m_ring[position & m_mask];
+        std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        std::intptr_t difference = (std::intptr_t)sequence - (std::intptr_t)position;
+        if (difference == 0) {
+            if (m_writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = m_writePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->event.timestamp = now() - m_epoch;
+    cell->event.category = category;
+    cell->event.name = name;
+    cell->event.value = value;
+    cell->event.thread = currentThread();
+    cell->event.type = type;
+    cell->event.hasValue = hasValue;
+    cell->sequence.store(position + 1, std::memory_order_release);
+}
+
+void Tracer::drain() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_ring == nullptr) {
+        return;
+    }
+
+    while (true) {
+        Cell& cell = m_ring[m_readPosition & m_mask];
+        if (cell.sequence.load(std::memory_order_acquire) != m_readPosition + 1) {
+            break;
+        }
+        m_events.push_back(cell.event);
+        cell.sequence.store(m_readPosition + m_mask + 1, std::memory_order_release);
+        m_readPosition++;
+    }
+}
+
+void Tracer::drainLoop() {
+    while (!m_stopDrain) {
+        drain();
+        std::this_thread::sleep_for(DrainInterval);
+    }
+}
+
+std::vector<TraceEvent> Tracer::takeEvents() {
+    drain();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<TraceEvent> events;
+    events.swap(m_events);
+    return events;
+}
+
+static void writeString(std::ostream& output, const char* text) {
+    output << '"';
+    for (const char* c = text; *c != 0; c++) {
+        if (*c == '"' || *c == '\\') {
+            output << '\\';
+        }
+        output << *c;
+    }
+    output << '"';
+}
+
+void Tracer::writeChromeTrace(std::ostream& output, const std::vector<TraceEvent>& events) {
+    output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& event : events) {
+        const char* phase = event.type == TraceEventType::Begin ? "B" : (event.type == TraceEventType::End ? "E" : "i");
+
+        output << (first ? "\n" : ",\n") << "{\"name\":";
+        writeString(output, event.name);
+        output << ",\"cat\":";
+        writeString(output, event.category);
+        output << ",\"ph\":\"" << phase << "\",\"ts\":" << event.timestamp / 1000 << "." << (event.timestamp % 1000) / 100
+            << ",\"pid\":1,\"tid\":" << event.thread;
+        if (event.type == TraceEventType::Instant) {
+            output << ",\"s\":\"t\"";
+        }
+        if (event.hasValue) {
+            output << ",\"args\":{\"value\":" << event.value << "}";
+        }
+        output << "}";
+        first = false;
+    }
+    output << "\n]}\n";
+}
@@ -0,0 +1,187 @@
+#include "WorkStealingPool.h"
+
+using namespace DirectMusic;
+
+// Number of times an idle worker checks for a new loop before going to sleep.
+// Loops tend to come in bursts (e.g. once per message in an audio block),
+// so this saves most of the wake up latency.
+static const int IdleSpinCount = 2000;
+
+// Set while a thread runs the items of a loop, so that loops started from
+// these items run serially instead of waiting for the pool
+static thread_local bool t_inLoop = false;
+
+// Set by SchedulerScope
+static thread_local Scheduler* t_currentScheduler = nullptr;
+
+std::shared_ptr<Scheduler> Scheduler::createThreadPool(std::uint32_t threads) {
+    return std::make_shared<WorkStealingPool>(threads);
+}
+
+std::shared_ptr<Scheduler> Scheduler::getDefault() {
+    static std::shared_ptr<Scheduler> pool = createThreadPool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+Scheduler& Scheduler::getCurrent() {
+    return t_currentScheduler != nullptr ? *t_currentScheduler : *getDefault();
+}
+
+SchedulerScope::SchedulerScope(Scheduler& scheduler) noexcept
+    : m_previous(t_currentScheduler) {
+    t_currentScheduler = &scheduler;
+}
+
+SchedulerScope::~SchedulerScope() {
+    t_currentScheduler = m_previous;
+}
+
+WorkStealingPool::WorkStealingPool(std::uint32_t threads)
+    : m_threadCount(threads == 0 ? 1 : threads)
+    , m_ranges(new Range[m_threadCount])
+    , m_pendingItems(0)
+    , m_loopOpen(false)
+    , m_loopWorkers(0)
+    , m_generation(0)
+{
+    for (std::uint32_t i = 0; i < m_threadCount; i++) {
+        m_ranges[i].next = 0;
+        m_ranges[i].end = 0;
+    }
+
+    for (std::uint32_t i = 0; i + 1 < m_threadCount; i++) {
+        m_workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& task) noexcept {
+    run(count, [](void* context, std::size_t i) { (*static_cast<const std::function<void(std::size_t)>*>(context))(i); }, (void*)&task);
+}
+
+void WorkStealingPool::async(std::function<void()> task) {
+    if (m_workers.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_asyncTasks.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+}
+
+void WorkStealingPool::run(std::size_t count, Task task, void* context) noexcept {
+    if (count == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> loopLock(m_loopMutex, std::defer_lock);
+    if (m_workers.empty() || count == 1 || t_inLoop || !loopLock.try_lock()) {
+        bool inLoop = t_inLoop;
+        t_inLoop = true;
+        for (std::size_t i = 0; i < count; i++) {
+            task(context, i);
+        }
+        t_inLoop = inLoop;
+        return;
+    }
+
+    for (std::uint32_t t = 0; t < m_threadCount; t++) {
+        m_ranges[t].next.store(count * t / m_threadCount, std::memory_order_relaxed);
+        m_ranges[t].end = count * (t + 1) / m_threadCount;
+    }
+    m_task = task;
+    m_context = context;
+    m_pendingItems.store(count, std::memory_order_relaxed);
+    m_loopOpen.store(true);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_generation.fetch_add(1, std::memory_order_release);
+    }
+    m_wake.notify_all();
+
+    // The calling thread owns the last range
+    work(m_threadCount - 1);
+
+    while (m_pendingItems.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+
+    // Workers busy with asynchronous tasks may join the loop only now: closing
+    // it and waiting for those which did ensures none of them touches it once
+    // this returns.
+    m_loopOpen.store(false);
+    while (m_loopWorkers.load() != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void WorkStealingPool::work(std::uint32_t self) noexcept {
+    bool inLoop = t_inLoop;
+    t_inLoop = true;
+    for (std::uint32_t t = 0; t < m_threadCount; t++) {
+        // Start with our own range, then go through the others
+        Range& range = m_ranges[(self + t) % m_threadCount];
+        for (;;) {
+            std::size_t i = range.next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= range.end) {
+                break;
+            }
+            m_task(m_context, i);
+            m_pendingItems.fetch_sub(1, std::memory_order_release);
+        }
+    }
+    t_inLoop = inLoop;
+}
+
+void WorkStealingPool::workerLoop(std::uint32_t self) {
+    std::uint64_t seen = 0;
+    for (;;) {
+        for (int spin = 0; spin < IdleSpinCount && m_generation.load(std::memory_order_acquire) == seen; spin++) {
+            std::this_thread::yield();
+        }
+
+        std::function<void()> asyncTask;
+        if (m_generation.load(std::memory_order_acquire) == seen) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] {
+                return m_stop || !m_asyncTasks.empty() || m_generation.load(std::memory_order_acquire) != seen;
+            });
+
+            // Loops come first, as their caller is waiting for them
+            if (m_generation.load(std::memory_order_acquire) == seen) {
+                if (m_stop) {
+                    return;
+                }
+                asyncTask = std::move(m_asyncTasks.front());
+                m_asyncTasks.pop_front();
+            }
+        }
+
+        if (asyncTask) {
+            asyncTask();
+            continue;
+        }
+
+        seen = m_generation.load(std::memory_order_acquire);
+        m_loopWorkers.fetch_add(1);
+        if (m_loopOpen.load()) {
+            work(self);
+        }
+        m_loopWorkers.fetch_sub(1);
+    }
+}
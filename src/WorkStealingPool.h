@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <dmusic/Scheduler.h>
+
+namespace DirectMusic {
+    /// The internal `Scheduler`: a fixed set of threads running parallel loops and
+    /// asynchronous tasks. Each loop is split into one contiguous range of items per
+    /// thread; a thread which is done with its own range steals the remaining items
+    /// of the others, one at a time.
+    class WorkStealingPool : public Scheduler {
+    public:
+        /// Starts `threads - 1` worker threads: the thread calling `parallelFor`
+        /// takes part in the loop as well.
+        explicit WorkStealingPool(std::uint32_t threads);
+        ~WorkStealingPool();
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        virtual std::uint32_t getConcurrency() const noexcept { return m_threadCount; }
+
+        /// A loop started while another one runs (from another thread, or from
+        /// a task of the loop itself) runs serially on the calling thread.
+        virtual void parallelFor(std::size_t count, const std::function<void(std::size_t)>& task) noexcept;
+
+        /// Without worker threads the task runs right away on the calling thread.
+        virtual void async(std::function<void()> task);
+
+    private:
+        using Task = void(*)(void*, std::size_t);
+
+        struct Range {
+            std::atomic<std::size_t> next;
+            std::size_t end;
+            // Keeps the counters of different threads on different cache lines
+            char padding[64];
+        };
+
+        void run(std::size_t count, Task task, void* context) noexcept;
+        void work(std::uint32_t self) noexcept;
+        void workerLoop(std::uint32_t self);
+
+        const std::uint32_t m_threadCount;
+        std::unique_ptr<Range[]> m_ranges;
+        std::vector<std::thread> m_workers;
+
+        // The loop being run, only one at a time
+        std::mutex m_loopMutex;
+        Task m_task = nullptr;
+        void* m_context = nullptr;
+        std::atomic<std::size_t> m_pendingItems;
+        std::atomic<bool> m_loopOpen;
+        std::atomic<std::uint32_t> m_loopWorkers; //< Workers which may still touch the loop
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::atomic<std::uint64_t> m_generation;
+        std::deque<std::function<void()>> m_asyncTasks;
+        bool m_stop = false;
+    };
+}
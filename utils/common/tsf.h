@@ -12,7 +12,10 @@
    [OPTIONAL] #define TSF_NO_STDIO to remove stdio dependency
    [OPTIONAL] #define TSF_MALLOC, TSF_REALLOC, and TSF_FREE to avoid stdlib.h
    [OPTIONAL] #define TSF_MEMCPY, TSF_MEMSET to avoid string.h
+   [OPTIONAL] #define TSF_ATOMIC_ADD(ptr, value) for compilers without GCC style or MSVC atomics
    [OPTIONAL] #define TSF_POW, TSF_POWF, TSF_EXPF, TSF_LOG, TSF_TAN, TSF_LOG10, TSF_SQRT to avoid math.h
+   [OPTIONAL] #define TSF_FASTMATH to compute timecent, cent, decibel and envelope conversions
+              with polynomial approximations instead of pow (relative error below 3e-7)
 
    NOT YET IMPLEMENTED
      - Lower level voice interface to render single voices/presets
@@ -173,10 +176,66 @@ TSFDEF void tsf_all_notes_off(tsf* f, int preset_index);
 TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 
+// Allocate the scratch buffer tsf_render_short needs to render the given number of samples
+// at once, so that rendering blocks of up to that size allocates nothing
+TSFDEF void tsf_reserve_output(tsf* f, int samples);
+
 // Copy a tsf instance from an exist one, use tsf_close to close it as well.
-// Copied tsf instances share everything with its base, except 'voices' and 'voiceNum'.
+// Copied tsf instances share everything with its base, except the voices (and their lists),
+// the voice limits, 'stats', the scratch buffer of tsf_render_short, the output settings and the
+// gain and panning of the presets. Copies can therefore be used on different threads at once.
 TSFDEF tsf* tsf_copy(const tsf* f);
 
+// Limit the number of voices which can play at once. Passing 0 (the default) lets the
+// voice array grow as needed. Otherwise all voices are allocated up front, with some headroom
+// for stolen voices fading out, and starting a note beyond the limit steals a voice: the
+// quietest releasing voice if there is one, the oldest voice otherwise.
+// Call this before playing any note, as all playing voices are dropped.
+TSFDEF void tsf_set_max_voices(tsf* f, int max_voices);
+
+// Kill releasing voices as soon as their output gain drops below the given level in decibels
+// (e.g. -90). The default of -100 or below keeps them until their release envelope is done.
+TSFDEF void tsf_set_silence_threshold(tsf* f, float threshold_db);
+
+// Returns the number of voices currently playing, including releasing ones
+TSFDEF int tsf_active_voice_count(const tsf* f);
+
+// Returns the number of bytes allocated for this instance alone (presets, voices and the
+// render buffer). If shared_bytes is not NULL, it receives the number of bytes shared with
+// the copies of the instance (samples and regions), which are not part of the result.
+TSFDEF size_t tsf_memory_usage(const tsf* f, size_t* shared_bytes);
+
+// Polyphony budget which can be shared by several tsf instances
+struct tsf_voice_budget
+{
+	// Maximum number of voices playing at once across all instances
+	int maxVoices;
+	// Number of voices currently playing, not counting stolen voices fading out
+	int playingVoices;
+};
+
+// Make the voices of a tsf instance count against a shared budget (TSF_NULL to detach it).
+// When the budget is exhausted a new note steals a voice of the same instance, or is
+// dropped if that instance plays nothing which could be stolen.
+// The budget must outlive the instance and be initialized with playingVoices = 0.
+// Instances sharing a budget may render concurrently (voices ending update it atomically),
+// but notes must not be started on several of them at the same time.
+TSFDEF void tsf_set_voice_budget(tsf* f, struct tsf_voice_budget* budget);
+
+// Counters accumulated by a tsf instance since it was loaded or copied
+struct tsf_stats
+{
+	// Number of tsf_note_on calls which resolved regions
+	unsigned int noteOns;
+	// Number of regions whose key range matched and had their velocity range tested
+	unsigned int regionLookups;
+	// Number of regions which started a voice
+	unsigned int regionMatches;
+};
+
+// Retrieve the counters of a tsf instance
+TSFDEF void tsf_get_stats(const tsf* f, struct tsf_stats* stats);
+
 #ifdef __cplusplus
 #  undef CPP_DEFAULT0
 }
@@ -195,6 +254,11 @@ TSFDEF tsf* tsf_copy(const tsf* f);
 #define TSF_RENDER_EFFECTSAMPLEBLOCK 64
 #endif
 
+// Number of filtered voices whose low-pass filters are processed side by side.
+#ifndef TSF_FILTER_LANES
+#define TSF_FILTER_LANES 4
+#endif
+
 // Grace release time for quick voice off (avoid clicking noise)
 #define TSF_FASTRELEASETIME 0.01f
 
@@ -211,6 +275,15 @@ TSFDEF tsf* tsf_copy(const tsf* f);
 #  define TSF_MEMSET  memset
 #endif
 
+#if !defined(TSF_ATOMIC_ADD)
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#    define TSF_ATOMIC_ADD(ptr, value) _InterlockedExchangeAdd((volatile long*)(ptr), (long)(value))
+#  else
+#    define TSF_ATOMIC_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_RELAXED)
+#  endif
+#endif
+
 #if !defined(TSF_POW) || !defined(TSF_POWF) || !defined(TSF_EXPF) || !defined(TSF_LOG) || !defined(TSF_TAN) || !defined(TSF_LOG10) || !defined(TSF_SQRT)
 #  include <math.h>
 #  if !defined(__cplusplus) && !defined(NAN) && !defined(powf) && !defined(expf)
@@ -250,17 +323,52 @@ typedef char tsf_char20[20];
 
 #define TSF_FourCCEquals(value1, value2) (value1[0] == value2[0] && value1[1] == value2[1] && value1[2] == value2[2] && value1[3] == value2[3])
 
+// Envelope state updated every effect block. Over a full block the level is multiplied by
+// blockFactor and then increased by blockStep, one of which is neutral depending on the curve.
+struct tsf_envelope_lanes { float *level, *blockFactor, *blockStep; int *samplesUntilNextSegment; };
+struct tsf_lfo_lanes { float *level, *delta; int *samplesUntil; };
+
+// Voice state touched every effect block, stored as one array per field (indexed like 'voices')
+// so that all voices are updated together by loops the compiler can vectorize.
+struct tsf_voice_lanes
+{
+	struct tsf_envelope_lanes ampenv, modenv;
+	struct tsf_lfo_lanes modlfo, viblfo;
+	float *modLfoToPitch, *vibLfoToPitch, *modEnvToPitch, *modLfoToVolume;
+	float *gainDB, *noteGain, *blockGain;
+	double *pitchInputTimecents, *pitchOutputFactor, *pitchRatio;
+
+	// Slots of the live voices in no particular order, the first activeVoiceNum entries are
+	// valid. The per-block updates only walk these instead of the whole pool.
+	int* active;
+};
+
 struct tsf
 {
 	struct tsf_preset* presets;
 	float* fontSamples;
 	struct tsf_voice* voices;
+	struct tsf_voice_lanes lanes;
 
 	int presetNum;
 	int fontSampleCount;
 	int voiceNum;
 	unsigned int voicePlayIndex;
 
+	// Indices into 'voices' heading the intrusive lists of live voices (all of them, and per
+	// key) and of unused voices. -1 marks an empty list.
+	int activeVoiceHead, freeVoiceHead;
+	int keyVoiceHead[128];
+
+	// Voice limit (0 if unlimited), number of live voices which are not being stolen and
+	// the optional budget shared with other instances.
+	int maxVoices, playingVoiceNum;
+	struct tsf_voice_budget* budget;
+
+	// Gain below which a releasing voice is considered inaudible (0 to never cut releases)
+	float silenceGain;
+	int activeVoiceNum;
+
 	float outSampleRate;
 	enum TSFOutputMode outputmode;
 	float globalGainDB, globalPanFactorLeft, globalPanFactorRight;
@@ -268,6 +376,8 @@ struct tsf
 	float** outputSamples;
 	int* outputSampleSize;
 	int* refCount;
+
+	struct tsf_stats stats;
 };
 
 #ifndef TSF_NO_STDIO
@@ -344,9 +454,21 @@ static void tsf_hydra_read_shdr(struct tsf_hydra_shdr* i, struct tsf_stream* str
 
 struct tsf_riffchunk { tsf_fourcc id; tsf_u32 size; };
 struct tsf_envelope { float delay, start, attack, hold, decay, sustain, release, keynumToHold, keynumToDecay; };
-struct tsf_voice_envelope { float level, slope; int samplesUntilNextSegment; int segment; struct tsf_envelope parameters; TSF_BOOL segmentIsExponential, exponentialDecay; };
-struct tsf_voice_lowpass { double QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
-struct tsf_voice_lfo { int samplesUntil; float level, delta; };
+struct tsf_voice_envelope { float slope; int segment; struct tsf_envelope parameters; TSF_BOOL segmentIsExponential, exponentialDecay; };
+struct tsf_voice_lowpass { float QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
+
+// Filtered voices of one effect block, with their samples interleaved by lane so that each
+// filter step processes all lanes at once. Coefficients ramp linearly over the block.
+struct tsf_voice_filterbatch
+{
+	int count, sampleCount[TSF_FILTER_LANES];
+	struct tsf_voice_lowpass* lowpass[TSF_FILTER_LANES];
+	float gainLeft[TSF_FILTER_LANES], gainRight[TSF_FILTER_LANES];
+	float a0[TSF_FILTER_LANES], a1[TSF_FILTER_LANES], b1[TSF_FILTER_LANES], b2[TSF_FILTER_LANES];
+	float da0[TSF_FILTER_LANES], da1[TSF_FILTER_LANES], db1[TSF_FILTER_LANES], db2[TSF_FILTER_LANES];
+	float z1[TSF_FILTER_LANES], z2[TSF_FILTER_LANES];
+	float samples[TSF_RENDER_EFFECTSAMPLEBLOCK * TSF_FILTER_LANES];
+};
 
 struct tsf_region
 {
@@ -372,25 +494,68 @@ struct tsf_preset
 	struct tsf_region* regions;
 	int regionNum;
 	float gainDB, panFactorLeft, panFactorRight;
+
+	// Region lookup table: the regions whose key range contains key k are
+	// keyRegionIndices[keyRegionOffsets[k]] up to keyRegionIndices[keyRegionOffsets[k+1]],
+	// listed in the same order as in 'regions'. Both arrays share one allocation.
+	int *keyRegionOffsets, *keyRegionIndices;
 };
 
 struct tsf_voice
 {
 	int playingPreset, playingKey, curPitchWheel;
 	struct tsf_region* region;
-	double pitchInputTimecents, pitchOutputFactor;
 	double sourceSamplePosition;
-	float  noteGainDB, noteGain, panFactorLeft, panFactorRight;
+	float  noteGainDB, panFactorLeft, panFactorRight;
 	unsigned int playIndex, sampleEnd, loopStart, loopEnd;
+	int activePrev, activeNext, keyPrev, keyNext, activeSlot;
+	TSF_BOOL stolen;
 	struct tsf_voice_envelope ampenv, modenv;
 	struct tsf_voice_lowpass lowpass;
-	struct tsf_voice_lfo modlfo, viblfo;
 };
 
+#ifdef TSF_FASTMATH
+// 2^x for x in [-126, 127]: 2^round(x) is built in the exponent bits, 2^fraction with a
+// degree 6 Taylor polynomial of e^(fraction*ln2) over [-0.5, 0.5] (relative error < 3e-7).
+static float tsf_fast_exp2f(float x)
+{
+	float f, p; int i; tsf_u32 bits;
+	if (x < -126.0f) x = -126.0f; else if (x > 127.0f) x = 127.0f;
+	i = (int)(x + (x < 0 ? -0.5f : 0.5f));
+	f = (x - (float)i) * 0.69314718f;
+	p = 1.0f + f * (1.0f + f * (0.5f + f * (1.0f / 6.0f + f * (1.0f / 24.0f + f * (1.0f / 120.0f + f * (1.0f / 720.0f))))));
+	bits = (tsf_u32)(i + 127) << 23;
+	TSF_MEMCPY(&f, &bits, sizeof(f));
+	return p * f;
+}
+
+// log2(x) for positive normal x: the exponent bits give the integer part, the mantissa m
+// (brought into [sqrt(0.5), sqrt(2)]) goes through the atanh series of ln(m) up to s^9
+// (absolute error < 2e-7 on top of rounding the result to float).
+static float tsf_fast_log2f(float x)
+{
+	float m, s, ss; int e; tsf_u32 bits;
+	TSF_MEMCPY(&bits, &x, sizeof(bits));
+	e = (int)((bits >> 23) & 0xFF) - 127;
+	bits = (bits & 0x007FFFFF) | 0x3F800000;
+	TSF_MEMCPY(&m, &bits, sizeof(m));
+	if (m > 1.41421356f) { m *= 0.5f; e++; }
+	s = (m - 1.0f) / (m + 1.0f); ss = s * s;
+	return (float)e + s * (2.0f + ss * (2.0f / 3.0f + ss * (2.0f / 5.0f + ss * (2.0f / 7.0f + ss * (2.0f / 9.0f))))) * 1.44269504f;
+}
+
+static double tsf_timecents2Secsd(double timecents) { return tsf_fast_exp2f((float)(timecents / 1200.0)); }
+static float tsf_timecents2Secsf(float timecents) { return tsf_fast_exp2f(timecents / 1200.0f); }
+static float tsf_cents2Hertz(float cents) { return 8.176f * tsf_fast_exp2f(cents / 1200.0f); }
+static float tsf_decibelsToGain(float db) { return (db > -100.f ? tsf_fast_exp2f(db * 0.166096405f) : 0); }
+static float tsf_powf(float base, float exponent) { return tsf_fast_exp2f(exponent * tsf_fast_log2f(base)); }
+#else
 static double tsf_timecents2Secsd(double timecents) { return TSF_POW(2.0, timecents / 1200.0); }
 static float tsf_timecents2Secsf(float timecents) { return TSF_POWF(2.0f, timecents / 1200.0f); }
 static float tsf_cents2Hertz(float cents) { return 8.176f * TSF_POWF(2.0f, cents / 1200.0f); }
 static float tsf_decibelsToGain(float db) { return (db > -100.f ? TSF_POWF(10.0f, db * 0.05f) : 0); }
+static float tsf_powf(float base, float exponent) { return TSF_POWF(base, exponent); }
+#endif
 
 static TSF_BOOL tsf_riffchunk_read(struct tsf_riffchunk* parent, struct tsf_riffchunk* chunk, struct tsf_stream* stream)
 {
@@ -513,6 +678,32 @@ static void tsf_region_envtosecs(struct tsf_envelope* p, TSF_BOOL sustainIsGain)
 	else p->sustain = p->sustain / 10.0f;
 }
 
+static void tsf_preset_build_key_table(struct tsf_preset* preset)
+{
+	// Count the regions covering each key, turn the counts into offsets and then
+	// fill in the region indices so tsf_note_on only needs to look at one key's list.
+	int key, total = 0, *offsets, *indices;
+	struct tsf_region *region, *regionEnd;
+	for (region = preset->regions, regionEnd = region + preset->regionNum; region != regionEnd; region++)
+		if (region->lokey <= region->hikey && region->lokey < 128) total += (region->hikey > 127 ? 127 : region->hikey) - region->lokey + 1;
+
+	offsets = preset->keyRegionOffsets = (int*)TSF_MALLOC((129 + total) * sizeof(int));
+	indices = preset->keyRegionIndices = offsets + 129;
+	TSF_MEMSET(offsets, 0, 129 * sizeof(int));
+	for (region = preset->regions; region != regionEnd; region++)
+		for (key = region->lokey; key <= region->hikey && key < 128; key++)
+			offsets[key + 1]++;
+	for (key = 0; key < 128; key++)
+		offsets[key + 1] += offsets[key];
+	for (region = preset->regions; region != regionEnd; region++)
+		for (key = region->lokey; key <= region->hikey && key < 128; key++)
+			indices[offsets[key]++] = (int)(region - preset->regions);
+	// The fill pass advanced every offset to the start of the following key
+	for (key = 128; key > 0; key--)
+		offsets[key] = offsets[key - 1];
+	offsets[0] = 0;
+}
+
 static void tsf_load_presets(tsf* res, struct tsf_hydra *hydra)
 {
 	enum { GenInstrument = 41, GenSampleID = 53 };
@@ -685,6 +876,8 @@ static void tsf_load_presets(tsf* res, struct tsf_hydra *hydra)
 			// Modulators (TODO)
 			//if (pbag->modNdx < pbag[1].modNdx) addUnsupportedOpcode("any modulator");
 		}
+
+		tsf_preset_build_key_table(preset);
 	}
 }
 
@@ -707,50 +900,50 @@ static void tsf_load_samples(float** fontSamples, int* fontSampleCount, struct t
 	}
 }
 
-static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, int active_segment, float outSampleRate)
+static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, float* level, int* samplesUntilNextSegment, int active_segment, float outSampleRate)
 {
 	switch (active_segment)
 	{
 		case TSF_SEGMENT_NONE:
-			e->samplesUntilNextSegment = (int)(e->parameters.delay * outSampleRate);
-			if (e->samplesUntilNextSegment > 0)
+			*samplesUntilNextSegment = (int)(e->parameters.delay * outSampleRate);
+			if (*samplesUntilNextSegment > 0)
 			{
 				e->segment = TSF_SEGMENT_DELAY;
 				e->segmentIsExponential = TSF_FALSE;
-				e->level = 0.0;
+				*level = 0.0;
 				e->slope = 0.0;
 				return;
 			}
 		case TSF_SEGMENT_DELAY:
-			e->samplesUntilNextSegment = (int)(e->parameters.attack * outSampleRate);
-			if (e->samplesUntilNextSegment > 0)
+			*samplesUntilNextSegment = (int)(e->parameters.attack * outSampleRate);
+			if (*samplesUntilNextSegment > 0)
 			{
 				e->segment = TSF_SEGMENT_ATTACK;
 				e->segmentIsExponential = TSF_FALSE;
-				e->level = e->parameters.start / 100.0f;
-				e->slope = 1.0f / e->samplesUntilNextSegment;
+				*level = e->parameters.start / 100.0f;
+				e->slope = 1.0f / *samplesUntilNextSegment;
 				return;
 			}
 		case TSF_SEGMENT_ATTACK:
-			e->samplesUntilNextSegment = (int)(e->parameters.hold * outSampleRate);
-			if (e->samplesUntilNextSegment > 0)
+			*samplesUntilNextSegment = (int)(e->parameters.hold * outSampleRate);
+			if (*samplesUntilNextSegment > 0)
 			{
 				e->segment = TSF_SEGMENT_HOLD;
 				e->segmentIsExponential = TSF_FALSE;
-				e->level = 1.0;
+				*level = 1.0;
 				e->slope = 0.0;
 				return;
 			}
 		case TSF_SEGMENT_HOLD:
-			e->samplesUntilNextSegment = (int)(e->parameters.decay * outSampleRate);
-			if (e->samplesUntilNextSegment > 0)
+			*samplesUntilNextSegment = (int)(e->parameters.decay * outSampleRate);
+			if (*samplesUntilNextSegment > 0)
 			{
 				e->segment = TSF_SEGMENT_DECAY;
-				e->level = 1.0;
+				*level = 1.0;
 				if (e->exponentialDecay)
 				{
 					// I don't truly understand this; just following what LinuxSampler does.
-					float mysterySlope = -9.226f / e->samplesUntilNextSegment;
+					float mysterySlope = -9.226f / *samplesUntilNextSegment;
 					e->slope = TSF_EXPF(mysterySlope);
 					e->segmentIsExponential = TSF_TRUE;
 					if (e->parameters.sustain > 0.0f)
@@ -760,36 +953,36 @@ static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, int act
 						// get to zero, not to the sustain level.  The SFZ spec is not that
 						// specific about what "decay" means, so perhaps it's really supposed
 						// to specify the time to reach the sustain level.
-						e->samplesUntilNextSegment = (int)(TSF_LOG((e->parameters.sustain / 100.0) / e->level) / mysterySlope);
+						*samplesUntilNextSegment = (int)(TSF_LOG((e->parameters.sustain / 100.0) / *level) / mysterySlope);
 					}
 				}
 				else
 				{
-					e->slope = (e->parameters.sustain / 100.0f - 1.0f) / e->samplesUntilNextSegment;
+					e->slope = (e->parameters.sustain / 100.0f - 1.0f) / *samplesUntilNextSegment;
 					e->segmentIsExponential = TSF_FALSE;
 				}
 				return;
 			}
 		case TSF_SEGMENT_DECAY:
 			e->segment = TSF_SEGMENT_SUSTAIN;
-			e->level = e->parameters.sustain / 100.0f;
+			*level = e->parameters.sustain / 100.0f;
 			e->slope = 0.0f;
-			e->samplesUntilNextSegment = 0x7FFFFFFF;
+			*samplesUntilNextSegment = 0x7FFFFFFF;
 			e->segmentIsExponential = TSF_FALSE;
 			return;
 		case TSF_SEGMENT_SUSTAIN:
 			e->segment = TSF_SEGMENT_RELEASE;
-			e->samplesUntilNextSegment = (int)((e->parameters.release <= 0 ? TSF_FASTRELEASETIME : e->parameters.release) * outSampleRate);
+			*samplesUntilNextSegment = (int)((e->parameters.release <= 0 ? TSF_FASTRELEASETIME : e->parameters.release) * outSampleRate);
 			if (e->exponentialDecay)
 			{
 				// I don't truly understand this; just following what LinuxSampler does.
-				float mysterySlope = -9.226f / e->samplesUntilNextSegment;
+				float mysterySlope = -9.226f / *samplesUntilNextSegment;
 				e->slope = TSF_EXPF(mysterySlope);
 				e->segmentIsExponential = TSF_TRUE;
 			}
 			else
 			{
-				e->slope = -e->level / e->samplesUntilNextSegment;
+				e->slope = -*level / *samplesUntilNextSegment;
 				e->segmentIsExponential = TSF_FALSE;
 			}
 			return;
@@ -797,12 +990,19 @@ static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, int act
 		default:
 			e->segment = TSF_SEGMENT_DONE;
 			e->segmentIsExponential = TSF_FALSE;
-			e->level = e->slope = 0;
-			e->samplesUntilNextSegment = 0x7FFFFFF;
+			*level = e->slope = 0;
+			*samplesUntilNextSegment = 0x7FFFFFF;
 	}
 }
 
-static void tsf_voice_envelope_setup(struct tsf_voice_envelope* e, struct tsf_envelope* new_parameters, int midiNoteNumber, TSF_BOOL setExponentialDecay, float outSampleRate)
+static void tsf_voice_envelope_next(struct tsf_voice_envelope* e, struct tsf_envelope_lanes* l, int i, int active_segment, float outSampleRate)
+{
+	tsf_voice_envelope_nextsegment(e, &l->level[i], &l->samplesUntilNextSegment[i], active_segment, outSampleRate);
+	l->blockFactor[i] = (e->segmentIsExponential ? tsf_powf(e->slope, (float)TSF_RENDER_EFFECTSAMPLEBLOCK) : 1.0f);
+	l->blockStep[i] = (e->segmentIsExponential ? 0.0f : e->slope * TSF_RENDER_EFFECTSAMPLEBLOCK);
+}
+
+static void tsf_voice_envelope_setup(struct tsf_voice_envelope* e, struct tsf_envelope_lanes* l, int i, struct tsf_envelope* new_parameters, int midiNoteNumber, TSF_BOOL setExponentialDecay, float outSampleRate)
 {
 	e->parameters = *new_parameters;
 	if (e->parameters.keynumToHold)
@@ -816,18 +1016,18 @@ static void tsf_voice_envelope_setup(struct tsf_voice_envelope* e, struct tsf_en
 		e->parameters.decay = (e->parameters.decay < -10000.0f ? 0.0f : tsf_timecents2Secsf(e->parameters.decay));
 	}
 	e->exponentialDecay = setExponentialDecay; 
-	tsf_voice_envelope_nextsegment(e, TSF_SEGMENT_NONE, outSampleRate);
+	tsf_voice_envelope_next(e, l, i, TSF_SEGMENT_NONE, outSampleRate);
 }
 
-static void tsf_voice_envelope_process(struct tsf_voice_envelope* e, int numSamples, float outSampleRate)
+// Advance an envelope over a partial block. Segment changes are left to tsf_voices_update.
+static void tsf_voice_envelope_process(struct tsf_voice_envelope* e, struct tsf_envelope_lanes* l, int i, int numSamples)
 {
 	if (e->slope)
 	{
-		if (e->segmentIsExponential) e->level *= TSF_POWF(e->slope, (float)numSamples);
-		else e->level += (e->slope * numSamples);
+		if (e->segmentIsExponential) l->level[i] *= tsf_powf(e->slope, (float)numSamples);
+		else l->level[i] += (e->slope * numSamples);
 	}
-	if ((e->samplesUntilNextSegment -= numSamples) <= 0)
-		tsf_voice_envelope_nextsegment(e, e->segment, outSampleRate);
+	l->samplesUntilNextSegment[i] -= numSamples;
 }
 
 static void tsf_voice_lowpass_setup(struct tsf_voice_lowpass* e, float Fc)
@@ -835,42 +1035,233 @@ static void tsf_voice_lowpass_setup(struct tsf_voice_lowpass* e, float Fc)
 	// Lowpass filter from http://www.earlevel.com/main/2012/11/26/biquad-c-source-code/
 	double K = TSF_TAN(TSF_PI * Fc), KK = K * K;
 	double norm = 1 / (1 + K * e->QInv + KK);
-	e->a0 = KK * norm;
+	e->a0 = (float)(KK * norm);
 	e->a1 = 2 * e->a0;
-	e->b1 = 2 * (KK - 1) * norm;
-	e->b2 = (1 - K * e->QInv + KK) * norm;
+	e->b1 = (float)(2 * (KK - 1) * norm);
+	e->b2 = (float)((1 - K * e->QInv + KK) * norm);
 }
 
-static float tsf_voice_lowpass_process(struct tsf_voice_lowpass* e, double In)
+static void tsf_voice_lfo_setup(struct tsf_lfo_lanes* l, int i, float delay, int freqCents, float outSampleRate)
 {
-	double Out = In * e->a0 + e->z1; e->z1 = In * e->a1 + e->z2 - e->b1 * Out; e->z2 = In * e->a0 - e->b2 * Out; return (float)Out;
+	l->samplesUntil[i] = (int)(delay * outSampleRate);
+	l->delta[i] = (4.0f * tsf_cents2Hertz((float)freqCents) / outSampleRate);
+	l->level[i] = 0;
+}
+
+// Advance the triangle LFOs of the count slots listed in active by one block, bouncing off -1 and 1.
+static void tsf_voice_lfo_process(struct tsf_lfo_lanes* l, const int* active, int count, int blockSamples)
+{
+	int k, i;
+	for (k = 0; k < count; k++)
+	{
+		TSF_BOOL delayed;
+		i = active[k];
+		delayed = (l->samplesUntil[i] > blockSamples);
+		float level = l->level[i] + (delayed ? 0.0f : l->delta[i] * blockSamples), delta = l->delta[i];
+		if      (level >  1.0f) { delta = -delta; level =  2.0f - level; }
+		else if (level < -1.0f) { delta = -delta; level = -2.0f - level; }
+		l->level[i] = level;
+		l->delta[i] = delta;
+		l->samplesUntil[i] = (delayed ? l->samplesUntil[i] - blockSamples : l->samplesUntil[i]);
+	}
 }
 
-static void tsf_voice_lfo_setup(struct tsf_voice_lfo* e, float delay, int freqCents, float outSampleRate)
+// Put voice slot i of the lanes in a neutral state, so that updating it has no effect.
+static void tsf_voice_lanes_clear(struct tsf_voice_lanes* l, int i)
 {
-	e->samplesUntil = (int)(delay * outSampleRate);
-	e->delta = (4.0f * tsf_cents2Hertz((float)freqCents) / outSampleRate);
-	e->level = 0;
+	l->ampenv.level[i] = l->ampenv.blockStep[i] = l->modenv.level[i] = l->modenv.blockStep[i] = 0;
+	l->ampenv.blockFactor[i] = l->modenv.blockFactor[i] = 1.0f;
+	l->ampenv.samplesUntilNextSegment[i] = l->modenv.samplesUntilNextSegment[i] = 0x7FFFFFFF;
+	l->modlfo.level[i] = l->modlfo.delta[i] = l->viblfo.level[i] = l->viblfo.delta[i] = 0;
+	l->modlfo.samplesUntil[i] = l->viblfo.samplesUntil[i] = 0;
+	l->modLfoToPitch[i] = l->vibLfoToPitch[i] = l->modEnvToPitch[i] = l->modLfoToVolume[i] = 0;
+	l->gainDB[i] = -1000.0f;
+	l->noteGain[i] = l->blockGain[i] = 0;
+	l->pitchInputTimecents[i] = l->pitchOutputFactor[i] = l->pitchRatio[i] = 0;
 }
 
-static void tsf_voice_lfo_process(struct tsf_voice_lfo* e, int blockSamples)
+// The arrays of the lanes by element type, one element per voice.
+#define TSF_LANES_FLOATS(l) { \
+	&(l)->ampenv.level, &(l)->ampenv.blockFactor, &(l)->ampenv.blockStep, &(l)->modenv.level, &(l)->modenv.blockFactor, &(l)->modenv.blockStep, \
+	&(l)->modlfo.level, &(l)->modlfo.delta, &(l)->viblfo.level, &(l)->viblfo.delta, \
+	&(l)->modLfoToPitch, &(l)->vibLfoToPitch, &(l)->modEnvToPitch, &(l)->modLfoToVolume, &(l)->gainDB, &(l)->noteGain, &(l)->blockGain }
+#define TSF_LANES_INTS(l) { &(l)->ampenv.samplesUntilNextSegment, &(l)->modenv.samplesUntilNextSegment, &(l)->modlfo.samplesUntil, &(l)->viblfo.samplesUntil, &(l)->active }
+#define TSF_LANES_DOUBLES(l) { &(l)->pitchInputTimecents, &(l)->pitchOutputFactor, &(l)->pitchRatio }
+
+// Bytes of the lanes for each voice.
+static size_t tsf_voice_lanes_bytes(void)
 {
-	if (e->samplesUntil > blockSamples) { e->samplesUntil -= blockSamples; return; }
-	e->level += e->delta * blockSamples;
-	if      (e->level >  1.0f) { e->delta = -e->delta; e->level =  2.0f - e->level; }
-	else if (e->level < -1.0f) { e->delta = -e->delta; e->level = -2.0f - e->level; }
+	struct tsf_voice_lanes l;
+	float** floats[] = TSF_LANES_FLOATS(&l);
+	int** ints[] = TSF_LANES_INTS(&l);
+	double** doubles[] = TSF_LANES_DOUBLES(&l);
+	return (sizeof(floats) / sizeof(*floats)) * sizeof(float) + (sizeof(ints) / sizeof(*ints)) * sizeof(int)
+		+ (sizeof(doubles) / sizeof(*doubles)) * sizeof(double);
 }
 
-static void tsf_voice_kill(struct tsf_voice* v)
+// Resize all arrays of the lanes to count voices (freeing them if count is 0).
+static void tsf_voice_lanes_resize(struct tsf_voice_lanes* l, int count)
 {
+	float** floats[] = TSF_LANES_FLOATS(l);
+	int** ints[] = TSF_LANES_INTS(l);
+	double** doubles[] = TSF_LANES_DOUBLES(l);
+	int i;
+	for (i = 0; i != (int)(sizeof(floats) / sizeof(*floats)); i++)
+	{
+		if (count) *floats[i] = (float*)TSF_REALLOC(*floats[i], count * sizeof(float));
+		else { TSF_FREE(*floats[i]); *floats[i] = TSF_NULL; }
+	}
+	for (i = 0; i != (int)(sizeof(ints) / sizeof(*ints)); i++)
+	{
+		if (count) *ints[i] = (int*)TSF_REALLOC(*ints[i], count * sizeof(int));
+		else { TSF_FREE(*ints[i]); *ints[i] = TSF_NULL; }
+	}
+	for (i = 0; i != (int)(sizeof(doubles) / sizeof(*doubles)); i++)
+	{
+		if (count) *doubles[i] = (double*)TSF_REALLOC(*doubles[i], count * sizeof(double));
+		else { TSF_FREE(*doubles[i]); *doubles[i] = TSF_NULL; }
+	}
+}
+
+static void tsf_voices_reset(tsf* f)
+{
+	int i;
+	f->activeVoiceHead = f->freeVoiceHead = -1;
+	f->activeVoiceNum = f->playingVoiceNum = 0;
+	for (i = 0; i != 128; i++) f->keyVoiceHead[i] = -1;
+}
+
+static void tsf_voices_grow(tsf* f, int count)
+{
+	int i;
+	f->voices = (struct tsf_voice*)TSF_REALLOC(f->voices, (f->voiceNum + count) * sizeof(struct tsf_voice));
+	tsf_voice_lanes_resize(&f->lanes, f->voiceNum + count);
+	for (i = f->voiceNum + count - 1; i >= f->voiceNum; i--)
+	{
+		tsf_voice_lanes_clear(&f->lanes, i);
+		f->voices[i].playingPreset = -1;
+		f->voices[i].activeNext = f->freeVoiceHead;
+		f->freeVoiceHead = i;
+	}
+	f->voiceNum += count;
+}
+
+static void tsf_voice_kill(tsf* f, struct tsf_voice* v)
+{
+	int i = (int)(v - f->voices);
+
+	if (v->activePrev != -1) f->voices[v->activePrev].activeNext = v->activeNext;
+	else f->activeVoiceHead = v->activeNext;
+	if (v->activeNext != -1) f->voices[v->activeNext].activePrev = v->activePrev;
+
+	if (v->keyPrev != -1) f->voices[v->keyPrev].keyNext = v->keyNext;
+	else f->keyVoiceHead[v->playingKey] = v->keyNext;
+	if (v->keyNext != -1) f->voices[v->keyNext].keyPrev = v->keyPrev;
+
+	if (!v->stolen)
+	{
+		f->playingVoiceNum--;
+		if (f->budget) TSF_ATOMIC_ADD(&f->budget->playingVoices, -1);
+	}
+
+	// Move the last live slot into the hole to keep the active slots packed.
+	f->activeVoiceNum--;
+	f->lanes.active[v->activeSlot] = f->lanes.active[f->activeVoiceNum];
+	f->voices[f->lanes.active[v->activeSlot]].activeSlot = v->activeSlot;
+
+	tsf_voice_lanes_clear(&f->lanes, i);
 	v->region = TSF_NULL;
 	v->playingPreset = -1;
+	v->activeNext = f->freeVoiceHead;
+	f->freeVoiceHead = i;
+}
+
+// Pick the voice to give up for a new note: the quietest releasing voice, or else the oldest one.
+// Voices of the note being started and voices already being stolen are left alone.
+static struct tsf_voice* tsf_voice_find_victim(tsf* f, unsigned int playIndex)
+{
+	struct tsf_voice *v, *victim = TSF_NULL;
+	float victimLevel = 0;
+	TSF_BOOL victimReleased = TSF_FALSE;
+	int i;
+	for (i = f->activeVoiceHead; i != -1; i = v->activeNext)
+	{
+		TSF_BOOL released; float level;
+		v = &f->voices[i];
+		if (v->stolen || v->playIndex == playIndex) continue;
+		released = (v->ampenv.segment >= TSF_SEGMENT_RELEASE);
+		level = f->lanes.noteGain[i] * f->lanes.ampenv.level[i];
+		if (!victim || (released && !victimReleased) ||
+			(released && level < victimLevel) ||
+			(!released && !victimReleased && v->playIndex < victim->playIndex))
+		{
+			victim = v; victimLevel = level; victimReleased = released;
+		}
+	}
+	return victim;
 }
 
-static void tsf_voice_end(struct tsf_voice* v, float outSampleRate)
+static struct tsf_voice* tsf_voice_alloc(tsf* f, int key, unsigned int playIndex)
 {
-	tsf_voice_envelope_nextsegment(&v->ampenv, TSF_SEGMENT_SUSTAIN, outSampleRate);
-	tsf_voice_envelope_nextsegment(&v->modenv, TSF_SEGMENT_SUSTAIN, outSampleRate);
+	struct tsf_voice *v;
+	int i;
+
+	if ((f->maxVoices && f->playingVoiceNum >= f->maxVoices) ||
+		(f->budget && f->budget->playingVoices >= f->budget->maxVoices))
+	{
+		// Out of polyphony: fade out a voice to make room, or drop the note if there is none to steal.
+		v = tsf_voice_find_victim(f, playIndex);
+		if (!v) return TSF_NULL;
+		v->ampenv.parameters.release = 0.0f; tsf_voice_envelope_next(&v->ampenv, &f->lanes.ampenv, (int)(v - f->voices), TSF_SEGMENT_SUSTAIN, f->outSampleRate);
+		v->stolen = TSF_TRUE;
+		f->playingVoiceNum--;
+		if (f->budget) TSF_ATOMIC_ADD(&f->budget->playingVoices, -1);
+	}
+
+	if (f->freeVoiceHead == -1)
+	{
+		if (!f->maxVoices) tsf_voices_grow(f, 4);
+		else
+		{
+			// All the headroom is taken by stolen voices still fading out, cut the quietest one short.
+			struct tsf_voice* quietest = TSF_NULL;
+			for (i = f->activeVoiceHead; i != -1; i = v->activeNext)
+			{
+				v = &f->voices[i];
+				if (v->stolen && (!quietest || f->lanes.ampenv.level[i] < f->lanes.ampenv.level[quietest - f->voices])) quietest = v;
+			}
+			if (!quietest) return TSF_NULL;
+			tsf_voice_kill(f, quietest);
+		}
+	}
+
+	// Unlink from the free list, then link at the front of the active and per-key lists.
+	i = f->freeVoiceHead;
+	v = &f->voices[i];
+	f->freeVoiceHead = v->activeNext;
+	v->stolen = TSF_FALSE;
+	v->activeSlot = f->activeVoiceNum;
+	f->lanes.active[f->activeVoiceNum++] = i;
+	f->playingVoiceNum++;
+	if (f->budget) TSF_ATOMIC_ADD(&f->budget->playingVoices, 1);
+
+	v->activePrev = -1;
+	v->activeNext = f->activeVoiceHead;
+	if (f->activeVoiceHead != -1) f->voices[f->activeVoiceHead].activePrev = i;
+	f->activeVoiceHead = i;
+
+	v->keyPrev = -1;
+	v->keyNext = f->keyVoiceHead[key];
+	if (f->keyVoiceHead[key] != -1) f->voices[f->keyVoiceHead[key]].keyPrev = i;
+	f->keyVoiceHead[key] = i;
+	return v;
+}
+
+static void tsf_voice_end(tsf* f, struct tsf_voice* v)
+{
+	int i = (int)(v - f->voices);
+	tsf_voice_envelope_next(&v->ampenv, &f->lanes.ampenv, i, TSF_SEGMENT_SUSTAIN, f->outSampleRate);
+	tsf_voice_envelope_next(&v->modenv, &f->lanes.modenv, i, TSF_SEGMENT_SUSTAIN, f->outSampleRate);
 	if (v->region->loop_mode == TSF_LOOPMODE_SUSTAIN)
 	{
 		// Continue playing, but stop looping.
@@ -878,14 +1269,16 @@ static void tsf_voice_end(struct tsf_voice* v, float outSampleRate)
 	}
 }
 
-static void tsf_voice_endquick(struct tsf_voice* v, float outSampleRate)
+static void tsf_voice_endquick(tsf* f, struct tsf_voice* v)
 {
-	v->ampenv.parameters.release = 0.0f; tsf_voice_envelope_nextsegment(&v->ampenv, TSF_SEGMENT_SUSTAIN, outSampleRate);
-	v->modenv.parameters.release = 0.0f; tsf_voice_envelope_nextsegment(&v->modenv, TSF_SEGMENT_SUSTAIN, outSampleRate);
+	int i = (int)(v - f->voices);
+	v->ampenv.parameters.release = 0.0f; tsf_voice_envelope_next(&v->ampenv, &f->lanes.ampenv, i, TSF_SEGMENT_SUSTAIN, f->outSampleRate);
+	v->modenv.parameters.release = 0.0f; tsf_voice_envelope_next(&v->modenv, &f->lanes.modenv, i, TSF_SEGMENT_SUSTAIN, f->outSampleRate);
 }
 
-static void tsf_voice_calcpitchratio(struct tsf_voice* v, float outSampleRate)
+static void tsf_voice_calcpitchratio(tsf* f, struct tsf_voice* v)
 {
+	int i = (int)(v - f->voices);
 	double note = v->playingKey, adjustedPitch;
 	note += v->region->transpose;
 	note += v->region->tune / 100.0;
@@ -893,153 +1286,219 @@ static void tsf_voice_calcpitchratio(struct tsf_voice* v, float outSampleRate)
 	adjustedPitch = v->region->pitch_keycenter + (note - v->region->pitch_keycenter) * (v->region->pitch_keytrack / 100.0);
 	if (v->curPitchWheel != 8192) adjustedPitch += ((4.0 * v->curPitchWheel / 16383.0) - 2.0);
 
-	v->pitchInputTimecents = adjustedPitch * 100.0;
-	v->pitchOutputFactor = v->region->sample_rate / (tsf_timecents2Secsd(v->region->pitch_keycenter * 100.0) * outSampleRate);
+	f->lanes.pitchInputTimecents[i] = adjustedPitch * 100.0;
+	f->lanes.pitchOutputFactor[i] = v->region->sample_rate / (tsf_timecents2Secsd(v->region->pitch_keycenter * 100.0) * f->outSampleRate);
 }
 
-static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, int numSamples)
+// Advance the per-block state of the live voices: gain and pitch for the block about to be
+// rendered, then envelopes and LFOs to their values at the end of it.
+static void tsf_voices_update(tsf* f, int numSamples)
 {
-	struct tsf_region* region = v->region;
-	float* input = f->fontSamples;
-	float* outL = outputBuffer;
-	float* outR = (f->outputmode == TSF_STEREO_UNWEAVED ? outL + numSamples : TSF_NULL);
-
-    tsf_preset preset = f->presets[v->playingPreset];
+	struct tsf_voice_lanes* l = &f->lanes;
+	struct tsf_voice* v;
+	const int* active = l->active;
+	int k, i, n = f->activeVoiceNum;
 
-	// Cache some values, to give them at least some chance of ending up in registers.
-	TSF_BOOL updateModEnv = (region->modEnvToPitch || region->modEnvToFilterFc);
-	TSF_BOOL updateModLFO = (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume));
-	TSF_BOOL updateVibLFO = (v->viblfo.delta && (region->vibLfoToPitch));
-	TSF_BOOL isLooping    = (v->loopStart < v->loopEnd);
-	unsigned int tmpLoopStart = v->loopStart, tmpLoopEnd = v->loopEnd;
-	double tmpSampleEndDbl = (double)v->sampleEnd, tmpLoopEndDbl = (double)tmpLoopEnd + 1.0;
-	double tmpSourceSamplePosition = v->sourceSamplePosition;
-	struct tsf_voice_lowpass tmpLowpass = v->lowpass;
-
-	TSF_BOOL dynamicLowpass = (region->modLfoToFilterFc || region->modEnvToFilterFc);
-	float tmpSampleRate, tmpInitialFilterFc, tmpModLfoToFilterFc, tmpModEnvToFilterFc;
-
-	TSF_BOOL dynamicPitchRatio = (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch);
-	double pitchRatio;
-	float tmpModLfoToPitch, tmpVibLfoToPitch, tmpModEnvToPitch;
-
-	TSF_BOOL dynamicGain = (region->modLfoToVolume != 0);
-	float noteGain, tmpModLfoToVolume;
-
-	if (dynamicLowpass) tmpSampleRate = f->outSampleRate, tmpInitialFilterFc = (float)region->initialFilterFc, tmpModLfoToFilterFc = (float)region->modLfoToFilterFc, tmpModEnvToFilterFc = (float)region->modEnvToFilterFc;
-	else tmpSampleRate = 0, tmpInitialFilterFc = 0, tmpModLfoToFilterFc = 0, tmpModEnvToFilterFc = 0;
-
-	if (dynamicPitchRatio) pitchRatio = 0, tmpModLfoToPitch = (float)region->modLfoToPitch, tmpVibLfoToPitch = (float)region->vibLfoToPitch, tmpModEnvToPitch = (float)region->modEnvToPitch;
-	else pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor, tmpModLfoToPitch = 0, tmpVibLfoToPitch = 0, tmpModEnvToPitch = 0;
-
-	if (dynamicGain) tmpModLfoToVolume = (float)region->modLfoToVolume * 0.1f;
-	else noteGain = tsf_decibelsToGain(v->noteGainDB + preset.gainDB), tmpModLfoToVolume = 0;
+	for (k = 0; k < n; k++)
+	{
+		float noteGain;
+		i = active[k];
+		noteGain = tsf_decibelsToGain(l->gainDB[i] + l->modlfo.level[i] * l->modLfoToVolume[i]);
+		l->noteGain[i] += 0.1f * (noteGain - l->noteGain[i]);
+		l->blockGain[i] = l->noteGain[i] * l->ampenv.level[i];
+	}
 
-	while (numSamples)
+	for (k = 0; k < n; k++)
 	{
-		float gainMono, gainLeft, gainRight;
-		int blockSamples = (numSamples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples);
-		numSamples -= blockSamples;
+		i = active[k];
+		l->pitchRatio[i] = tsf_timecents2Secsd(l->pitchInputTimecents[i] + (l->modlfo.level[i] * l->modLfoToPitch[i] + l->viblfo.level[i] * l->vibLfoToPitch[i] + l->modenv.level[i] * l->modEnvToPitch[i])) * l->pitchOutputFactor[i];
+	}
 
-		if (dynamicLowpass)
+	if (numSamples == TSF_RENDER_EFFECTSAMPLEBLOCK)
+	{
+		for (k = 0; k < n; k++)
 		{
-			float fres = tmpInitialFilterFc + v->modlfo.level * tmpModLfoToFilterFc + v->modenv.level * tmpModEnvToFilterFc;
-			tmpLowpass.active = (fres <= 13500.0f);
-			if (tmpLowpass.active) tsf_voice_lowpass_setup(&tmpLowpass, tsf_cents2Hertz(fres) / tmpSampleRate);
+			i = active[k];
+			l->ampenv.level[i] = l->ampenv.level[i] * l->ampenv.blockFactor[i] + l->ampenv.blockStep[i];
+			l->ampenv.samplesUntilNextSegment[i] -= TSF_RENDER_EFFECTSAMPLEBLOCK;
+			l->modenv.level[i] = l->modenv.level[i] * l->modenv.blockFactor[i] + l->modenv.blockStep[i];
+			l->modenv.samplesUntilNextSegment[i] -= TSF_RENDER_EFFECTSAMPLEBLOCK;
 		}
+	}
+	else
+	{
+		// Only the last block of a render call can be partial, it goes through the scalar path.
+		for (k = 0; k < n; k++)
+		{
+			i = active[k];
+			v = &f->voices[i];
+			tsf_voice_envelope_process(&v->ampenv, &l->ampenv, i, numSamples);
+			tsf_voice_envelope_process(&v->modenv, &l->modenv, i, numSamples);
+		}
+	}
 
-		if (dynamicPitchRatio)
-			pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents + (v->modlfo.level * tmpModLfoToPitch + v->viblfo.level * tmpVibLfoToPitch + v->modenv.level * tmpModEnvToPitch)) * v->pitchOutputFactor;
-
-		if (dynamicGain)
-			noteGain = tsf_decibelsToGain(v->noteGainDB + (v->modlfo.level * tmpModLfoToVolume));
-
-        v->noteGain += 0.1f * (noteGain - v->noteGain);
-
-		gainMono = v->noteGain * v->ampenv.level;
+	tsf_voice_lfo_process(&l->modlfo, active, n, numSamples);
+	tsf_voice_lfo_process(&l->viblfo, active, n, numSamples);
 
-		// Update EG.
-		tsf_voice_envelope_process(&v->ampenv, blockSamples, f->outSampleRate);
-		if (updateModEnv) tsf_voice_envelope_process(&v->modenv, blockSamples, f->outSampleRate);
+	// Envelope segment changes (these never kill a voice, so the active slots stay put).
+	for (k = 0; k < n; k++)
+	{
+		i = active[k];
+		if (l->ampenv.samplesUntilNextSegment[i] > 0 && l->modenv.samplesUntilNextSegment[i] > 0) continue;
+		v = &f->voices[i];
+		if (l->ampenv.samplesUntilNextSegment[i] <= 0) tsf_voice_envelope_next(&v->ampenv, &l->ampenv, i, v->ampenv.segment, f->outSampleRate);
+		if (l->modenv.samplesUntilNextSegment[i] <= 0) tsf_voice_envelope_next(&v->modenv, &l->modenv, i, v->modenv.segment, f->outSampleRate);
+	}
+}
 
-		// Update LFOs.
-		if (updateModLFO) tsf_voice_lfo_process(&v->modlfo, blockSamples);
-		if (updateVibLFO) tsf_voice_lfo_process(&v->viblfo, blockSamples);
+static void tsf_voice_mix(tsf* f, float* outL, float* outR, const float* input, int inputStride, int numSamples, float gainLeft, float gainRight)
+{
+	switch (f->outputmode)
+	{
+		case TSF_STEREO_INTERLEAVED:
+			for (; numSamples--; input += inputStride) { *outL++ += *input * gainLeft; *outL++ += *input * gainRight; }
+			break;
 
-		switch (f->outputmode)
-		{
-			case TSF_STEREO_INTERLEAVED:
-				gainLeft = gainMono * f->globalPanFactorLeft * v->panFactorLeft, gainRight = gainMono * f->globalPanFactorRight * v->panFactorRight;
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+		case TSF_STEREO_UNWEAVED:
+			for (; numSamples--; input += inputStride) { *outL++ += *input * gainLeft; *outR++ += *input * gainRight; }
+			break;
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+		case TSF_MONO:
+			for (; numSamples--; input += inputStride) *outL++ += *input * gainLeft;
+			break;
+	}
+}
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+// Resample up to numSamples of the voice's sample into output, stopping early at the end of the sample.
+static int tsf_voice_generate(tsf* f, struct tsf_voice* v, double pitchRatio, float* output, int outputStride, int numSamples)
+{
+	const float* input = f->fontSamples;
+	TSF_BOOL isLooping = (v->loopStart < v->loopEnd);
+	unsigned int tmpLoopStart = v->loopStart, tmpLoopEnd = v->loopEnd;
+	double tmpSampleEndDbl = (double)v->sampleEnd, tmpLoopEndDbl = (double)tmpLoopEnd + 1.0;
+	double tmpSourceSamplePosition = v->sourceSamplePosition;
+	int count = 0;
 
-					*outL++ += val * gainLeft;
-					*outL++ += val * gainRight;
+	for (; count != numSamples && tmpSourceSamplePosition < tmpSampleEndDbl; count++, output += outputStride)
+	{
+		unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
+		// Simple linear interpolation.
+		float alpha = (float)(tmpSourceSamplePosition - pos);
+		*output = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
 
-			case TSF_STEREO_UNWEAVED:
-				gainLeft = gainMono * f->globalPanFactorLeft * v->panFactorLeft, gainRight = gainMono * f->globalPanFactorRight * v->panFactorRight;
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+		// Next sample.
+		tmpSourceSamplePosition += pitchRatio;
+		if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
+	}
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+	v->sourceSamplePosition = tmpSourceSamplePosition;
+	return count;
+}
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+// Run the low-pass filters of all queued voices and mix their output.
+static void tsf_voice_filterbatch_flush(tsf* f, struct tsf_voice_filterbatch* b, float* outL, float* outR)
+{
+	int i, l, numSamples = 0;
+	float* samples;
 
-					*outL++ += val * gainLeft;
-					*outR++ += val * gainRight;
+	for (l = 0; l != b->count; l++)
+		if (b->sampleCount[l] > numSamples) numSamples = b->sampleCount[l];
+	for (l = b->count; l != TSF_FILTER_LANES; l++)
+	{
+		// Unused lanes filter silence into silence.
+		b->a0[l] = b->a1[l] = b->b1[l] = b->b2[l] = 0;
+		b->da0[l] = b->da1[l] = b->db1[l] = b->db2[l] = 0;
+		b->z1[l] = b->z2[l] = 0;
+		for (i = 0; i != numSamples; i++) b->samples[i * TSF_FILTER_LANES + l] = 0;
+	}
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
+	for (i = 0, samples = b->samples; i != numSamples; i++, samples += TSF_FILTER_LANES)
+	{
+		for (l = 0; l != TSF_FILTER_LANES; l++)
+		{
+			float in = samples[l], out = in * b->a0[l] + b->z1[l];
+			b->z1[l] = in * b->a1[l] + b->z2[l] - b->b1[l] * out;
+			b->z2[l] = in * b->a0[l] - b->b2[l] * out;
+			samples[l] = out;
+			b->a0[l] += b->da0[l]; b->a1[l] += b->da1[l]; b->b1[l] += b->db1[l]; b->b2[l] += b->db2[l];
+		}
+	}
 
-			case TSF_MONO:
-				gainMono *= (f->globalPanFactorLeft + f->globalPanFactorRight) * .5f;
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+	for (l = 0; l != b->count; l++)
+	{
+		b->lowpass[l]->z1 = b->z1[l];
+		b->lowpass[l]->z2 = b->z2[l];
+		tsf_voice_mix(f, outL, outR, b->samples + l, TSF_FILTER_LANES, b->sampleCount[l], b->gainLeft[l], b->gainRight[l]);
+	}
+	b->count = 0;
+}
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+// Render one effect block of a voice (numSamples <= TSF_RENDER_EFFECTSAMPLEBLOCK). Unfiltered voices are
+// mixed into the output right away, filtered ones are queued into the batch for tsf_voice_filterbatch_flush.
+static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outL, float* outR, int numSamples, struct tsf_voice_filterbatch* batch)
+{
+	struct tsf_region* region = v->region;
+	struct tsf_voice_lanes* l = &f->lanes;
+	struct tsf_voice_lowpass target = v->lowpass;
+	int i = (int)(v - f->voices), count;
+	double pitchRatio = l->pitchRatio[i];
+	float gainMono = l->blockGain[i], gainLeft, gainRight;
+
+	// Drop releasing voices once they are too quiet to be heard.
+	if (gainMono < f->silenceGain && v->ampenv.segment == TSF_SEGMENT_RELEASE)
+	{
+		tsf_voice_kill(f, v);
+		return;
+	}
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+	// The filter coefficients ramp from the modulation at the start of the block to the one at its end
+	// (tsf_voices_update already advanced the LFO and envelope levels).
+	if (region->modLfoToFilterFc || region->modEnvToFilterFc)
+	{
+		float fres = (float)region->initialFilterFc + l->modlfo.level[i] * (float)region->modLfoToFilterFc + l->modenv.level[i] * (float)region->modEnvToFilterFc;
+		target.active = (fres <= 13500.0f);
+		if (target.active) tsf_voice_lowpass_setup(&target, tsf_cents2Hertz(fres) / f->outSampleRate);
 
-					*outL++ += val * gainMono;
+		// Jump to the new coefficients if the filter was not running yet.
+		if (!v->lowpass.active) v->lowpass = target;
+		v->lowpass.active = target.active;
+	}
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
-		}
+	if (f->outputmode == TSF_MONO)
+		gainLeft = gainRight = gainMono * (f->globalPanFactorLeft + f->globalPanFactorRight) * .5f;
+	else
+		gainLeft = gainMono * f->globalPanFactorLeft * v->panFactorLeft, gainRight = gainMono * f->globalPanFactorRight * v->panFactorRight;
 
-		if (tmpSourceSamplePosition >= tmpSampleEndDbl || v->ampenv.segment == TSF_SEGMENT_DONE)
-		{
-			tsf_voice_kill(v);
-			return;
-		}
+	if (v->lowpass.active)
+	{
+		int lane = batch->count++;
+		float rampFactor = 1.0f / numSamples;
+		count = tsf_voice_generate(f, v, pitchRatio, batch->samples + lane, TSF_FILTER_LANES, numSamples);
+		batch->sampleCount[lane] = count;
+		batch->lowpass[lane] = &v->lowpass;
+		batch->gainLeft[lane] = gainLeft;
+		batch->gainRight[lane] = gainRight;
+		batch->a0[lane] = v->lowpass.a0; batch->da0[lane] = (target.a0 - v->lowpass.a0) * rampFactor;
+		batch->a1[lane] = v->lowpass.a1; batch->da1[lane] = (target.a1 - v->lowpass.a1) * rampFactor;
+		batch->b1[lane] = v->lowpass.b1; batch->db1[lane] = (target.b1 - v->lowpass.b1) * rampFactor;
+		batch->b2[lane] = v->lowpass.b2; batch->db2[lane] = (target.b2 - v->lowpass.b2) * rampFactor;
+		batch->z1[lane] = v->lowpass.z1;
+		batch->z2[lane] = v->lowpass.z2;
+		for (; count != numSamples; count++) batch->samples[count * TSF_FILTER_LANES + lane] = 0;
+		v->lowpass.a0 = target.a0; v->lowpass.a1 = target.a1; v->lowpass.b1 = target.b1; v->lowpass.b2 = target.b2;
+	}
+	else
+	{
+		float samples[TSF_RENDER_EFFECTSAMPLEBLOCK];
+		count = tsf_voice_generate(f, v, pitchRatio, samples, 1, numSamples);
+		tsf_voice_mix(f, outL, outR, samples, 1, count, gainLeft, gainRight);
 	}
 
-	v->sourceSamplePosition = tmpSourceSamplePosition;
-	if (tmpLowpass.active || dynamicLowpass) v->lowpass = tmpLowpass;
+	// A voice queued in the batch may be killed right away: nothing reuses its slot before
+	// the batch is flushed, so writing its filter state back there is harmless.
+	if (v->sourceSamplePosition >= (double)v->sampleEnd || v->ampenv.segment == TSF_SEGMENT_DONE)
+		tsf_voice_kill(f, v);
 }
 
 TSFDEF tsf* tsf_load(struct tsf_stream* stream)
@@ -1123,6 +1582,7 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		res->refCount = (int*)TSF_MALLOC(sizeof(int));
 		*res->refCount = 1;
 		res->globalPanFactorLeft = res->globalPanFactorRight = 1.0f;
+		tsf_voices_reset(res);
 		fontSamples = TSF_NULL; //don't free below
 		tsf_load_presets(res, &hydra);
 	}
@@ -1142,7 +1602,19 @@ TSFDEF tsf* tsf_copy(const tsf* f)
 		TSF_MEMCPY(res, f, sizeof(tsf));
 		res->voices = TSF_NULL;
 		res->voiceNum = 0;
-		++(*res->refCount);
+		TSF_MEMSET(&res->lanes, 0, sizeof(res->lanes));
+		res->maxVoices = 0;
+		res->budget = TSF_NULL;
+		res->outputSamples = (float**)TSF_MALLOC(sizeof(float*));
+		*res->outputSamples = TSF_NULL;
+		res->outputSampleSize = (int*)TSF_MALLOC(sizeof(int));
+		*res->outputSampleSize = 0;
+		// The regions are shared, but not the preset gain and panning
+		res->presets = (struct tsf_preset*)TSF_MALLOC(f->presetNum * sizeof(struct tsf_preset));
+		TSF_MEMCPY(res->presets, f->presets, f->presetNum * sizeof(struct tsf_preset));
+		tsf_voices_reset(res);
+		TSF_MEMSET(&res->stats, 0, sizeof(res->stats));
+		TSF_ATOMIC_ADD(res->refCount, 1);
 	}
 	return res;
 }
@@ -1151,21 +1623,71 @@ TSFDEF void tsf_close(tsf* f)
 {
 	struct tsf_preset *preset, *presetEnd;
 	if (!f) return;
-	if (--(*f->refCount) == 0)
+	if (TSF_ATOMIC_ADD(f->refCount, -1) == 1)
 	{
 		for (preset = f->presets, presetEnd = preset + f->presetNum; preset != presetEnd; preset++)
-		TSF_FREE(preset->regions);
-		TSF_FREE(f->presets);
+		{
+			TSF_FREE(preset->regions);
+			TSF_FREE(preset->keyRegionOffsets);
+		}
 		TSF_FREE(f->fontSamples);
-		TSF_FREE(*f->outputSamples);
-		TSF_FREE(f->outputSamples);
-		TSF_FREE(f->outputSampleSize);
 		TSF_FREE(f->refCount);
 	}
+	TSF_FREE(f->presets);
+	TSF_FREE(*f->outputSamples);
+	TSF_FREE(f->outputSamples);
+	TSF_FREE(f->outputSampleSize);
+	if (f->budget) TSF_ATOMIC_ADD(&f->budget->playingVoices, -f->playingVoiceNum);
+	tsf_voice_lanes_resize(&f->lanes, 0);
 	TSF_FREE(f->voices);
 	TSF_FREE(f);
 }
 
+TSFDEF void tsf_set_max_voices(tsf* f, int max_voices)
+{
+	if (f->budget) TSF_ATOMIC_ADD(&f->budget->playingVoices, -f->playingVoiceNum);
+	tsf_voice_lanes_resize(&f->lanes, 0);
+	TSF_FREE(f->voices);
+	f->voices = TSF_NULL;
+	f->voiceNum = 0;
+	f->maxVoices = (max_voices > 0 ? max_voices : 0);
+	tsf_voices_reset(f);
+	if (f->maxVoices) tsf_voices_grow(f, f->maxVoices + f->maxVoices / 4 + 1);
+}
+
+TSFDEF void tsf_set_silence_threshold(tsf* f, float threshold_db)
+{
+	f->silenceGain = tsf_decibelsToGain(threshold_db);
+}
+
+TSFDEF int tsf_active_voice_count(const tsf* f)
+{
+	return f->activeVoiceNum;
+}
+
+TSFDEF size_t tsf_memory_usage(const tsf* f, size_t* shared_bytes)
+{
+	struct tsf_preset *preset, *presetEnd;
+	size_t shared;
+	if (!f) { if (shared_bytes) *shared_bytes = 0; return 0; }
+	if (shared_bytes)
+	{
+		shared = sizeof(int) + f->fontSampleCount * sizeof(float);
+		for (preset = f->presets, presetEnd = preset + f->presetNum; preset != presetEnd; preset++)
+			shared += preset->regionNum * sizeof(struct tsf_region) + (129 + preset->keyRegionOffsets[128]) * sizeof(int);
+		*shared_bytes = shared;
+	}
+	return sizeof(tsf) + f->presetNum * sizeof(struct tsf_preset) + sizeof(float*) + sizeof(int) + *f->outputSampleSize
+		+ f->voiceNum * (sizeof(struct tsf_voice) + tsf_voice_lanes_bytes());
+}
+
+TSFDEF void tsf_set_voice_budget(tsf* f, struct tsf_voice_budget* budget)
+{
+	if (f->budget) TSF_ATOMIC_ADD(&f->budget->playingVoices, -f->playingVoiceNum);
+	f->budget = budget;
+	if (f->budget) TSF_ATOMIC_ADD(&f->budget->playingVoices, f->playingVoiceNum);
+}
+
 TSFDEF int tsf_get_presetindex(const tsf* f, int bank, int preset_number)
 {
 	const struct tsf_preset *presets;
@@ -1213,48 +1735,62 @@ TSFDEF void tsf_set_preset_panning(tsf* f, int preset, float pan_factor_left, fl
 }
 
 TSFDEF void tsf_set_preset_gain(tsf* f, int preset, float gain) {
+	struct tsf_voice* v;
+	int i;
 	if (preset < 0 || preset >= f->presetNum) return;
 
 	f->presets[preset].gainDB = gain;
+
+	// Playing voices follow the new gain.
+	for (i = f->activeVoiceHead; i != -1; i = v->activeNext)
+	{
+		v = &f->voices[i];
+		if (v->playingPreset == preset) f->lanes.gainDB[i] = v->noteGainDB + gain;
+	}
 }
 
 TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 {
-	int midiVelocity = (int)(vel * 127), voicePlayIndex;
+	int midiVelocity = (int)(vel * 127), voicePlayIndex, i;
 	TSF_BOOL haveGroupedNotesPlaying = TSF_FALSE;
-	struct tsf_voice *v, *vEnd; struct tsf_region *region, *regionEnd;
-	struct tsf_preset preset = f->presets[preset_index];
+	struct tsf_voice *v; struct tsf_region *region;
+	struct tsf_preset* preset;
+	const int *regionIndex, *regionIndexEnd;
 
 	if (preset_index < 0 || preset_index >= f->presetNum) return;
+	if (key < 0 || key > 127) return;
 	if (vel <= 0.0f) { tsf_note_off(f, preset_index, key); return; }
+	preset = &f->presets[preset_index];
+	f->stats.noteOns++;
 
-	// Are any grouped notes playing? (Needed for group stopping) Also stop any voices still playing this note.
-	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+	// Are any grouped notes playing? (Needed for group stopping)
+	for (i = f->activeVoiceHead; i != -1; i = v->activeNext)
 	{
-		if (v->playingPreset != preset_index) continue;
-		if (v->region->group) haveGroupedNotesPlaying = TSF_TRUE;
+		v = &f->voices[i];
+		if (v->playingPreset == preset_index && v->region->group) { haveGroupedNotesPlaying = TSF_TRUE; break; }
 	}
 
 	// Play all matching regions.
 	voicePlayIndex = f->voicePlayIndex++;
-	for (region = preset.regions, regionEnd = region + preset.regionNum; region != regionEnd; region++)
+	for (regionIndex = preset->keyRegionIndices + preset->keyRegionOffsets[key], regionIndexEnd = preset->keyRegionIndices + preset->keyRegionOffsets[key + 1]; regionIndex != regionIndexEnd; regionIndex++)
 	{
-		struct tsf_voice* voice = TSF_NULL; double adjustedPan; TSF_BOOL doLoop; float filterQDB;
-		if (key < region->lokey || key > region->hikey || midiVelocity < region->lovel || midiVelocity > region->hivel) continue;
+		struct tsf_voice* voice; double adjustedPan; TSF_BOOL doLoop; float filterQDB; int voiceIndex;
+		region = &preset->regions[*regionIndex];
+		f->stats.regionLookups++;
+		if (midiVelocity < region->lovel || midiVelocity > region->hivel) continue;
+		f->stats.regionMatches++;
 
 		if (haveGroupedNotesPlaying && region->group)
-			for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+			for (i = f->activeVoiceHead; i != -1; i = v->activeNext)
+			{
+				v = &f->voices[i];
 				if (v->playingPreset == preset_index && v->region->group == region->group)
-					tsf_voice_endquick(v, f->outSampleRate);
+					tsf_voice_endquick(f, v);
+			}
 
-		for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++) if (v->playingPreset == -1) { voice = v; break; }
-		if (!voice)
-		{
-			f->voiceNum += 4;
-			f->voices = (struct tsf_voice*)TSF_REALLOC(f->voices, f->voiceNum * sizeof(struct tsf_voice));
-			voice = &f->voices[f->voiceNum - 4];
-			voice[1].playingPreset = voice[2].playingPreset = voice[3].playingPreset = -1;
-		}
+		voice = tsf_voice_alloc(f, key, voicePlayIndex);
+		if (!voice) return;
+		voiceIndex = (int)(voice - f->voices);
 
 		voice->region = region;
 		voice->playingPreset = preset_index;
@@ -1263,17 +1799,22 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 
 		// Pitch.
 		voice->curPitchWheel = 8192;
-		tsf_voice_calcpitchratio(voice, f->outSampleRate);
+		tsf_voice_calcpitchratio(f, voice);
+		f->lanes.modLfoToPitch[voiceIndex] = (float)region->modLfoToPitch;
+		f->lanes.vibLfoToPitch[voiceIndex] = (float)region->vibLfoToPitch;
+		f->lanes.modEnvToPitch[voiceIndex] = (float)region->modEnvToPitch;
 
 		// Gain.
         voice->noteGainDB = f->globalGainDB + region->volume;
 		// Thanks to <http:://www.drealm.info/sfz/plj-sfz.xhtml> for explaining the velocity curve in a way that I could understand, although they mean "log10" when they say "log".
 		voice->noteGainDB += (float)(-20.0 * TSF_LOG10(1.0 / vel));
-        voice->noteGain = 0;
+		f->lanes.gainDB[voiceIndex] = voice->noteGainDB + preset->gainDB;
+		f->lanes.modLfoToVolume[voiceIndex] = region->modLfoToVolume * 0.1f;
+		f->lanes.noteGain[voiceIndex] = 0;
 		// The SFZ spec is silent about the pan curve, but a 3dB pan law seems common. This sqrt() curve matches what Dimension LE does; Alchemy Free seems closer to sin(adjustedPan * pi/2).
 		adjustedPan = (region->pan + 100.0) / 200.0;
-		voice->panFactorLeft = (float)TSF_SQRT(1.0 - adjustedPan) * preset.panFactorLeft;
-		voice->panFactorRight = (float)TSF_SQRT(adjustedPan) * preset.panFactorRight;
+		voice->panFactorLeft = (float)TSF_SQRT(1.0 - adjustedPan) * preset->panFactorLeft;
+		voice->panFactorRight = (float)TSF_SQRT(adjustedPan) * preset->panFactorRight;
 
 		// Offset/end.
 		voice->sourceSamplePosition = region->offset;
@@ -1286,22 +1827,27 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		voice->loopEnd = (doLoop ? region->loop_end : 0);
 
 		// Setup envelopes.
-		tsf_voice_envelope_setup(&voice->ampenv, &region->ampenv, key, TSF_TRUE, f->outSampleRate);
-		tsf_voice_envelope_setup(&voice->modenv, &region->modenv, key, TSF_FALSE, f->outSampleRate);
+		tsf_voice_envelope_setup(&voice->ampenv, &f->lanes.ampenv, voiceIndex, &region->ampenv, key, TSF_TRUE, f->outSampleRate);
+		tsf_voice_envelope_setup(&voice->modenv, &f->lanes.modenv, voiceIndex, &region->modenv, key, TSF_FALSE, f->outSampleRate);
 
 		// Setup lowpass filter.
 		filterQDB = region->initialFilterQ / 10.0f;
-		voice->lowpass.QInv = 1.0 / TSF_POW(10.0, (filterQDB / 20.0));
+		voice->lowpass.QInv = (float)(1.0 / TSF_POW(10.0, (filterQDB / 20.0)));
 		voice->lowpass.z1 = voice->lowpass.z2 = 0;
 		voice->lowpass.active = (region->initialFilterFc <= 13500);
 		if (voice->lowpass.active) tsf_voice_lowpass_setup(&voice->lowpass, tsf_cents2Hertz((float)region->initialFilterFc) / f->outSampleRate);
 
 		// Setup LFO filters.
-		tsf_voice_lfo_setup(&voice->modlfo, region->delayModLFO, region->freqModLFO, f->outSampleRate);
-		tsf_voice_lfo_setup(&voice->viblfo, region->delayVibLFO, region->freqVibLFO, f->outSampleRate);
+		tsf_voice_lfo_setup(&f->lanes.modlfo, voiceIndex, region->delayModLFO, region->freqModLFO, f->outSampleRate);
+		tsf_voice_lfo_setup(&f->lanes.viblfo, voiceIndex, region->delayVibLFO, region->freqVibLFO, f->outSampleRate);
 	}
 }
 
+TSFDEF void tsf_get_stats(const tsf* f, struct tsf_stats* stats)
+{
+	*stats = f->stats;
+}
+
 TSFDEF void tsf_bank_note_on(tsf* f, int bank, int preset_number, int key, float vel)
 {
 	tsf_note_on(f, tsf_get_presetindex(f, bank, preset_number), key, vel);
@@ -1309,32 +1855,39 @@ TSFDEF void tsf_bank_note_on(tsf* f, int bank, int preset_number, int key, float
 
 TSFDEF void tsf_note_off(tsf* f, int preset_index, int key)
 {
-	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum, *vMatchFirst = TSF_NULL, *vMatchLast;
-	for (; v != vEnd; v++)
+	struct tsf_voice *v;
+	int i;
+	unsigned int minPlayIndex = 0;
+	TSF_BOOL found = TSF_FALSE;
+	if (key < 0 || key > 127) return;
+
+	//Look up the smallest play index among the held voices with matching preset and key
+	for (i = f->keyVoiceHead[key]; i != -1; i = v->keyNext)
 	{
-		//Find the first and last entry in the voices list with matching preset, key and look up the smallest play index
-		if (v->playingPreset != preset_index || v->playingKey != key || v->ampenv.segment >= TSF_SEGMENT_RELEASE) continue;
-		else if (!vMatchFirst || v->playIndex < vMatchFirst->playIndex) vMatchFirst = vMatchLast = v;
-		else if (v->playIndex == vMatchFirst->playIndex) vMatchLast = v;
+		v = &f->voices[i];
+		if (v->playingPreset != preset_index || v->ampenv.segment >= TSF_SEGMENT_RELEASE) continue;
+		if (!found || v->playIndex < minPlayIndex) { minPlayIndex = v->playIndex; found = TSF_TRUE; }
 	}
-	if (!vMatchFirst) return;
-	for (v = vMatchFirst; v <= vMatchLast; v++)
+	if (!found) return;
+
+	//Stop all voices with matching preset, key and the smallest play index which was enumerated above
+	for (i = f->keyVoiceHead[key]; i != -1; i = v->keyNext)
 	{
-		//Stop all voices with matching preset, key and the smallest play index which was enumerated above
-		if (v != vMatchFirst && v != vMatchLast &&
-			(v->playIndex != vMatchFirst->playIndex || v->playingPreset != preset_index || v->playingKey != key || v->ampenv.segment >= TSF_SEGMENT_RELEASE)) continue;
-		tsf_voice_end(v, f->outSampleRate);
+		v = &f->voices[i];
+		if (v->playingPreset != preset_index || v->playIndex != minPlayIndex || v->ampenv.segment >= TSF_SEGMENT_RELEASE) continue;
+		tsf_voice_end(f, v);
 	}
 }
 
 TSFDEF void tsf_all_notes_off(tsf* f, int preset_index)
 {
-	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
-	for (; v != vEnd; v++)
+	struct tsf_voice *v;
+	int i;
+	for (i = f->activeVoiceHead; i != -1; i = v->activeNext)
 	{
-		if (v->playingPreset == preset_index && v->ampenv.segment < TSF_SEGMENT_RELEASE){
-			tsf_voice_end(v, f->outSampleRate);
-		}
+		v = &f->voices[i];
+		if (v->playingPreset == preset_index && v->ampenv.segment < TSF_SEGMENT_RELEASE)
+			tsf_voice_end(f, v);
 	}
 }
 
@@ -1343,17 +1896,23 @@ TSFDEF void tsf_bank_note_off(tsf* f, int bank, int preset_number, int key)
 	tsf_note_off(f, tsf_get_presetindex(f, bank, preset_number), key);
 }
 
-TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing)
+TSFDEF void tsf_reserve_output(tsf* f, int samples)
 {
-	float *floatSamples;
-	int channelSamples = (f->outputmode == TSF_MONO ? 1 : 2) * samples, floatBufferSize = channelSamples * sizeof(float);
-	short* bufferEnd = buffer + channelSamples;
+	int floatBufferSize = (f->outputmode == TSF_MONO ? 1 : 2) * samples * sizeof(float);
 	if (floatBufferSize > *f->outputSampleSize)
 	{
 		TSF_FREE(*f->outputSamples);
 		*f->outputSamples = (float*)TSF_MALLOC(floatBufferSize);
 		*f->outputSampleSize = floatBufferSize;
 	}
+}
+
+TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing)
+{
+	float *floatSamples;
+	int channelSamples = (f->outputmode == TSF_MONO ? 1 : 2) * samples;
+	short* bufferEnd = buffer + channelSamples;
+	tsf_reserve_output(f, samples);
 
 	tsf_render_float(f, *f->outputSamples, samples, TSF_FALSE);
 
@@ -1375,11 +1934,29 @@ TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing
 
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing)
 {
-	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+	struct tsf_voice_filterbatch batch;
+	float *outL, *outR;
+	int i, next, offset, blockSamples;
 	if (!flag_mixing) TSF_MEMSET(buffer, 0, (f->outputmode == TSF_MONO ? 1 : 2) * sizeof(float) * samples);
-	for (; v != vEnd; v++)
-		if (v->playingPreset != -1)
-			tsf_voice_render(f, v, buffer, samples);
+
+	// Render all voices one effect block at a time, so that filtered voices can be batched.
+	batch.count = 0;
+	for (offset = 0; offset < samples; offset += blockSamples)
+	{
+		blockSamples = (samples - offset > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : samples - offset);
+		outL = buffer + (f->outputmode == TSF_STEREO_INTERLEAVED ? offset * 2 : offset);
+		outR = (f->outputmode == TSF_STEREO_UNWEAVED ? buffer + samples + offset : TSF_NULL);
+
+		tsf_voices_update(f, blockSamples);
+		for (i = f->activeVoiceHead; i != -1; i = next)
+		{
+			// Rendering may kill the voice and unlink it, so fetch its successor first.
+			next = f->voices[i].activeNext;
+			tsf_voice_render(f, &f->voices[i], outL, outR, blockSamples, &batch);
+			if (batch.count == TSF_FILTER_LANES) tsf_voice_filterbatch_flush(f, &batch, outL, outR);
+		}
+		if (batch.count) tsf_voice_filterbatch_flush(f, &batch, outL, outR);
+	}
 }
 
 #ifdef __cplusplus
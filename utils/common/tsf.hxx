@@ -45,6 +45,28 @@ public:
         tsf_set_preset_gain(m_soundfont, preset, gain);
     }
 
+    void setMaxVoices(int maxVoices) {
+        tsf_set_max_voices(m_soundfont, maxVoices);
+    }
+
+    void setVoiceBudget(tsf_voice_budget* budget) {
+        tsf_set_voice_budget(m_soundfont, budget);
+    }
+
+    void setSilenceThreshold(float thresholdDb) {
+        tsf_set_silence_threshold(m_soundfont, thresholdDb);
+    }
+
+    int getActiveVoiceCount() const {
+        return tsf_active_voice_count(m_soundfont);
+    }
+
+    /// Returns the bytes held by this instance alone. `shared`, if not null, receives
+    /// those of the samples and regions shared with its copies.
+    std::size_t getMemoryUsage(std::size_t* shared = nullptr) const {
+        return tsf_memory_usage(m_soundfont, shared);
+    }
+
     void noteOn(int preset_index, int key, float vel) {
         tsf_note_on(m_soundfont, preset_index, key, vel);
     }
@@ -57,6 +79,11 @@ public:
         tsf_all_notes_off(m_soundfont, preset);
     }
 
+    /// Allocates what rendering blocks of up to `samples` samples (per channel) needs up front
+    void reserveOutput(int samples) {
+        tsf_reserve_output(m_soundfont, samples);
+    }
+
     void renderSamples(short* buffer, int samples, bool mixing) {
         tsf_render_short(m_soundfont, buffer, samples, mixing ? 1 : 0);
     }
@@ -64,4 +91,10 @@ public:
     void renderSamples(float* buffer, int samples, bool mixing) {
         tsf_render_float(m_soundfont, buffer, samples, mixing ? 1 : 0);
     }
+
+    tsf_stats getStats() const {
+        tsf_stats stats;
+        tsf_get_stats(m_soundfont, &stats);
+        return stats;
+    }
 };
\ No newline at end of file
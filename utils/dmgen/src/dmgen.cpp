@@ -0,0 +1,115 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <dmusic/AssetGenerator.h>
+#include <args.hxx>
+
+using namespace DirectMusic;
+
+static bool writeFile(const std::string& path, const std::vector<std::uint8_t>& data) {
+    std::ofstream ofs(path, std::ios::binary);
+    ofs.write((const char*)data.data(), data.size());
+    if (!ofs) {
+        std::cerr << "dmgen: Could not write " << path << std::endl;
+        return false;
+    }
+    std::cout << path << ": " << data.size() << " bytes" << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    args::ArgumentParser parser("dmgen generates synthetic DirectMusic collections, styles and segments");
+    args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
+    args::ValueFlag<std::string> name(parser, "name", "The name of the generated files, without extension", { 'n', "name" });
+    args::ValueFlag<unsigned int> instruments(parser, "instruments", "The number of instruments", { "instruments" });
+    args::ValueFlag<unsigned int> waves(parser, "waves", "The number of waves", { "waves" });
+    args::ValueFlag<unsigned int> waveFrames(parser, "frames", "The length of every wave in frames", { "wave-frames" });
+    args::ValueFlag<unsigned int> waveRate(parser, "rate", "The sampling rate of the waves", { "wave-rate" });
+    args::ValueFlag<unsigned int> waveBits(parser, "bits", "The format of the waves: 8 or 16 bits PCM, or 32 bits float", { "wave-bits" });
+    args::Flag oneShot(parser, "one-shot", "Don't loop the waves", { "one-shot" });
+    args::ValueFlag<unsigned int> parts(parser, "parts", "The number of parts", { 'p', "parts" });
+    args::ValueFlag<unsigned int> patterns(parser, "patterns", "The number of patterns", { "patterns" });
+    args::ValueFlag<unsigned int> patternMeasures(parser, "measures", "The length of every pattern in measures", { "pattern-measures" });
+    args::ValueFlag<unsigned int> notes(parser, "notes", "The number of note onsets per part and measure", { "notes" });
+    args::ValueFlag<unsigned int> chordSize(parser, "notes", "The number of notes played at each onset", { "chord-size" });
+    args::ValueFlag<unsigned int> curves(parser, "curves", "The number of expression curves per part and measure", { "curves" });
+    args::ValueFlag<double> tempo(parser, "tempo", "The tempo of the style", { "tempo" });
+    args::ValueFlag<unsigned int> measures(parser, "measures", "The length of the segment in measures", { 'm', "measures" });
+    args::ValueFlag<unsigned int> chords(parser, "changes", "The number of chord changes, which makes the notes of the style relative to the chords", { "chords" });
+    args::ValueFlag<unsigned int> tempos(parser, "changes", "The number of tempo changes", { "tempos" });
+    args::ValueFlag<unsigned int> bands(parser, "changes", "The number of band changes", { "bands" });
+    args::Positional<std::string> outputDirectory(parser, "output", "The output directory");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << parser;
+        return 0;
+    } catch (const args::ParseError& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    } catch (const args::ValidationError& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    if (!outputDirectory) {
+        std::cerr << "dmgen: No output directory specified" << std::endl;
+        return 1;
+    }
+
+    std::string baseName = name ? args::get(name) : "generated";
+
+    CollectionSettings collection;
+    collection.instruments = instruments ? args::get(instruments) : collection.instruments;
+    collection.waves = waves ? args::get(waves) : collection.waves;
+    collection.waveFrames = waveFrames ? args::get(waveFrames) : collection.waveFrames;
+    collection.sampleRate = waveRate ? args::get(waveRate) : collection.sampleRate;
+    collection.bitsPerSample = waveBits ? (std::uint16_t)args::get(waveBits) : collection.bitsPerSample;
+    collection.looped = oneShot ? false : true;
+
+    StyleSettings style;
+    style.parts = parts ? args::get(parts) : style.parts;
+    style.patterns = patterns ? args::get(patterns) : style.patterns;
+    style.patternMeasures = patternMeasures ? (std::uint16_t)args::get(patternMeasures) : style.patternMeasures;
+    style.notesPerMeasure = notes ? args::get(notes) : style.notesPerMeasure;
+    style.chordSize = chordSize ? args::get(chordSize) : style.chordSize;
+    style.curvesPerMeasure = curves ? args::get(curves) : style.curvesPerMeasure;
+    style.tempo = tempo ? args::get(tempo) : style.tempo;
+    style.collectionFile = baseName + ".dls";
+    style.collectionId = collection.id;
+    style.collectionInstruments = collection.instruments;
+
+    SegmentSettings segment;
+    segment.measures = measures ? args::get(measures) : segment.measures;
+    segment.chordChanges = chords ? args::get(chords) : segment.chordChanges;
+    segment.tempoChanges = tempos ? args::get(tempos) : segment.tempoChanges;
+    segment.bandChanges = bands ? args::get(bands) : segment.bandChanges;
+    segment.bandParts = style.parts;
+    segment.styleFile = baseName + ".sty";
+    segment.styleId = style.id;
+    segment.collectionFile = style.collectionFile;
+    segment.collectionId = collection.id;
+    segment.collectionInstruments = collection.instruments;
+    style.chordRelative = segment.chordChanges > 0;
+
+    if (collection.instruments == 0 || style.parts == 0 || style.patterns == 0 || style.patternMeasures == 0
+        || style.notesPerMeasure == 0 || segment.measures == 0) {
+        std::cerr << "dmgen: Invalid settings" << std::endl;
+        return 1;
+    }
+
+    std::string prefix = args::get(outputDirectory) + "/" + baseName;
+    try {
+        bool written = writeFile(prefix + ".dls", AssetGenerator::generateCollection(collection))
+            && writeFile(prefix + ".sty", AssetGenerator::generateStyle(style))
+            && writeFile(prefix + ".sgt", AssetGenerator::generateSegment(segment));
+        return written ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "dmgen: " << e.what() << std::endl;
+        return 1;
+    }
+}
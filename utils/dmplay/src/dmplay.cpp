@@ -2,7 +2,9 @@
 #include <queue>
 #include <locale>
 #include <map>
+#include <memory>
 #include <dmusic/PlayingContext.h>
+#include <dmusic/RenderAheadBuffer.h>
 #include <dmusic/InstrumentPlayer.h>
 #include <dmusic/DlsPlayer.h>
 #include <dmusic/Tracks.h>
@@ -17,22 +19,38 @@
 using namespace DirectMusic;
 using namespace DirectMusic::DLS;
 
-static int streamChannels = 2;
+struct Playback {
+    PlayingContext* context;
+    std::unique_ptr<RenderAheadBuffer> buffer; //< Null when rendering in the callback
+    OutputLayout layout; //< Device channels, the stereo output of the context going to the front ones
+};
 
 static void audioCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
     /* Cast data passed through stream to our structure. */
-    PlayingContext* data = (PlayingContext*)pDevice->pUserData;
+    Playback* data = (Playback*)pDevice->pUserData;
     std::int16_t *out = (std::int16_t*)pOutput;
-    int samples = frameCount * data->getAudioChannels();
+    int samples = frameCount * data->context->getAudioChannels();
 
-    if(streamChannels > 2) {
-        for(std::size_t i = 0; i < frameCount; i++) {
-            data->renderBlock(out, 2, 1);
-            std::fill(out + 2, out + streamChannels, 0);
-            out += streamChannels;
+    if (data->layout.channels > 2) {
+        if (data->buffer != nullptr) {
+            data->buffer->read(out, frameCount, data->layout);
+        } else {
+            data->context->renderBlock(out, frameCount, data->layout, 1);
         }
+    } else if (data->buffer != nullptr) {
+        data->buffer->read(out, samples);
     } else {
-        data->renderBlock(out, samples, 1);
+        data->context->renderBlock(out, samples, 1);
+    }
+}
+
+// Starts playing the segment, in sync with the audio heard when rendering ahead
+static void playSegment(Playback& playback, const SegmentForm& segment) {
+    auto info = playback.context->prepareSegment(segment);
+    if (playback.buffer != nullptr) {
+        playback.buffer->post([info](PlayingContext& ctx) { ctx.playSegment(info, SegmentTiming::Measure); });
+    } else {
+        playback.context->playSegment(info, SegmentTiming::Measure);
     }
 }
 
@@ -41,6 +59,8 @@ int main(int argc, char **argv) {
     args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
     args::ValueFlag<unsigned int> samplingRate(parser, "sampling rate", "The sampling rate to use", { 's', "sample" });
     args::ValueFlag<unsigned int> numChannels(parser, "channels", "The number of channels to use", { 'c', "channels" });
+    args::ValueFlag<unsigned int> renderThreads(parser, "threads", "The number of threads rendering the performance channels", { 't', "threads" });
+    args::ValueFlag<unsigned int> renderAhead(parser, "milliseconds", "How far ahead of the playback to render (default 100, 0 renders in the audio callback)", { 'a', "ahead" });
     args::Positional<std::string> segmentName(parser, "segment", "The segment to render");
 
     try {
@@ -68,14 +88,23 @@ int main(int argc, char **argv) {
     int channels = numChannels ? args::get(numChannels) : 2;
 
     PlayingContext ctx(sampleRate, channels > 2 ? 2 : channels, DlsPlayer::createFactory());
-    streamChannels = channels;
+    if (renderThreads) {
+        ctx.setRenderThreads(args::get(renderThreads));
+    }
+    Playback playback;
+    playback.context = &ctx;
+    playback.layout.channels = channels;
+    unsigned int ahead = renderAhead ? args::get(renderAhead) : 100;
+    if (ahead > 0) {
+        playback.buffer.reset(new RenderAheadBuffer(ctx, ahead));
+    }
 
     ma_device_config config = ma_device_config_init(ma_device_type_playback);
     config.playback.format   = ma_format_s16;
     config.playback.channels = channels;
     config.sampleRate        = sampleRate;
     config.dataCallback      = audioCallback;
-    config.pUserData         = &ctx;
+    config.pUserData         = &playback;
 
     ma_device device;
     if (ma_device_init(NULL, &config, &device) != MA_SUCCESS) {
@@ -94,7 +123,7 @@ int main(int argc, char **argv) {
     if (segment != nullptr) {
         std::cout << " done.\nStart playback... ";
         try {
-            ctx.playSegment(*segment, SegmentTiming::Measure);
+            playSegment(playback, *segment);
             std::cout << " done.\nBegin rendering... ";
         } catch (const std::runtime_error& e) {
             std::cerr << " Cannot play segment. " << e.what();
@@ -118,7 +147,7 @@ int main(int argc, char **argv) {
         }
         std::cout << " done.\nStart playback... ";
         try {
-            ctx.playSegment(*segment, SegmentTiming::Measure);
+            playSegment(playback, *segment);
         } catch (const std::runtime_error& e) {
             std::cerr << " Cannot play segment. " << e.what();
             return 1;
@@ -0,0 +1,635 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <dmusic/AssetGenerator.h>
+#include <dmusic/PlayingContext.h>
+#include <dmusic/DlsPlayer.h>
+#include <dmusic/MemoryUsage.h>
+#include <args.hxx>
+
+using namespace DirectMusic;
+
+static const std::uint32_t SampleRate = 44100;
+static const std::uint32_t Channels = 2;
+static const std::uint32_t BlockFrames = 1024;
+static const std::uint64_t Seed = 1;
+static const int ReportVersion = 1;
+
+// Frames per analysis window of the spectrum, and the number of bands it is reduced to
+static const std::size_t SpectrumWindow = 2048;
+static const std::size_t SpectrumBands = 24;
+static const double SpectrumLowest = 40; //< Lower edge of the first band in Hz
+static const double SilenceDecibels = -120;
+
+// Seconds after a seek from which the output must be the same as when playing up to there.
+// Before that, the notes started earlier are missing and those of the previous segment fade out.
+static const double SeekSettleSeconds = 1;
+
+/// A synthetic segment of the suite, generated with its own collection, style and settings
+struct Case {
+    std::string name;
+    CollectionSettings collection;
+    StyleSettings style;
+    SegmentSettings segment;
+    std::uint32_t renderThreads = 0;
+
+    /// If not 0, the segment is started from this measure with `PlayingContext::seek`,
+    /// while another segment plays, and checked against playing it from its start
+    std::uint32_t seekMeasure = 0;
+};
+
+struct Result {
+    std::string name;
+    std::uint64_t checksum = 0;
+    double realtime = 0; //< Speed in multiples of real time
+    std::uint64_t peakMemory = 0; //< Highest total of the context's memory usage, in bytes
+    std::vector<double> spectrum; //< Energy of each band in dB relative to full scale
+};
+
+// The suite covers every kind of message and the synthesizer's sample formats.
+// Each case has a collection of its own, as the converted banks are cached by GUID.
+static std::vector<Case> makeCases() {
+    std::vector<Case> cases;
+    auto add = [&](const std::string& name) -> Case& {
+        Case c;
+        c.name = name;
+        c.collection.id = 100 + (std::uint32_t)cases.size();
+        cases.push_back(c);
+        return cases.back();
+    };
+
+    add("default");
+
+    Case& chords = add("chords");
+    chords.style.chordRelative = true;
+    chords.segment.chordChanges = 16;
+
+    add("curves").style.curvesPerMeasure = 4;
+
+    Case& changes = add("changes");
+    changes.segment.tempoChanges = 8;
+    changes.segment.bandChanges = 4;
+
+    Case& patterns = add("patterns");
+    patterns.style.patterns = 4;
+    patterns.style.patternMeasures = 2;
+
+    Case& dense = add("dense");
+    dense.collection.instruments = 16;
+    dense.style.parts = 16;
+    dense.style.notesPerMeasure = 32;
+    dense.style.chordSize = 4;
+
+    Case& oneShot = add("one-shot-8bit");
+    oneShot.collection.bitsPerSample = 8;
+    oneShot.collection.looped = false;
+    oneShot.collection.waveFrames = 22050;
+
+    Case& floatWaves = add("float-22khz");
+    floatWaves.collection.bitsPerSample = 32;
+    floatWaves.collection.sampleRate = 22050;
+    floatWaves.collection.waves = 4;
+
+    add("parallel").renderThreads = 4;
+
+    Case& seek = add("seek");
+    seek.segment.tempoChanges = 8;
+    seek.segment.bandChanges = 4;
+    seek.seekMeasure = 20;
+
+    for (auto& c : cases) {
+        c.style.collectionId = c.collection.id;
+        c.style.collectionInstruments = c.collection.instruments;
+        c.segment.collectionId = c.collection.id;
+        c.segment.collectionInstruments = c.collection.instruments;
+        c.segment.bandParts = c.style.parts;
+    }
+    return cases;
+}
+
+// Accumulates the power spectrum of the mono mix of the rendered audio,
+// over Hann-windowed frames which don't overlap
+class SpectrumAnalyzer {
+public:
+    SpectrumAnalyzer()
+        : m_window(SpectrumWindow), m_power(SpectrumWindow / 2 + 1, 0.0) {}
+
+    void add(const std::int16_t* samples, std::size_t frames) {
+        for (std::size_t i = 0; i < frames; i++) {
+            double sum = 0;
+            for (std::uint32_t c = 0; c < Channels; c++) {
+                sum += samples[i * Channels + c];
+            }
+            m_window[m_filled++] = sum / Channels;
+            if (m_filled == SpectrumWindow) {
+                analyze();
+                m_filled = 0;
+            }
+        }
+    }
+
+    /// Returns the average energy of logarithmically spaced bands, from SpectrumLowest to
+    /// the Nyquist frequency, in dB relative to a full scale sine
+    std::vector<double> bands() const {
+        std::vector<double> result(SpectrumBands, SilenceDecibels);
+        if (m_frames == 0) {
+            return result;
+        }
+
+        const double nyquist = SampleRate / 2.0;
+        const double fullScale = std::pow(32768.0 * SpectrumWindow / 4, 2);
+        for (std::size_t band = 0; band < SpectrumBands; band++) {
+            double low = SpectrumLowest * std::pow(nyquist / SpectrumLowest, (double)band / SpectrumBands);
+            double high = SpectrumLowest * std::pow(nyquist / SpectrumLowest, (double)(band + 1) / SpectrumBands);
+            double energy = 0;
+            for (std::size_t bin = 0; bin < m_power.size(); bin++) {
+                double frequency = bin * (double)SampleRate / SpectrumWindow;
+                if (frequency >= low && frequency < high) {
+                    energy += m_power[bin];
+                }
+            }
+            energy /= m_frames;
+            result[band] = energy > 0 ? std::max(SilenceDecibels, 10 * std::log10(energy / fullScale)) : SilenceDecibels;
+        }
+        return result;
+    }
+
+private:
+    void analyze() {
+        const double pi = 3.14159265358979323846;
+        std::vector<std::complex<double>> values(SpectrumWindow);
+        for (std::size_t i = 0; i < SpectrumWindow; i++) {
+            double hann = 0.5 - 0.5 * std::cos(2 * pi * i / (SpectrumWindow - 1));
+            values[i] = m_window[i] * hann;
+        }
+
+        // Iterative radix-2 FFT
+        for (std::size_t i = 1, j = 0; i < SpectrumWindow; i++) {
+            std::size_t bit = SpectrumWindow >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+            if (i < j) {
+                std::swap(values[i], values[j]);
+            }
+        }
+        for (std::size_t length = 2; length <= SpectrumWindow; length <<= 1) {
+            std::complex<double> step = std::polar(1.0, -2 * pi / length);
+            for (std::size_t start = 0; start < SpectrumWindow; start += length) {
+                std::complex<double> twiddle(1);
+                for (std::size_t k = 0; k < length / 2; k++) {
+                    std::complex<double> even = values[start + k], odd = values[start + k + length / 2] * twiddle;
+                    values[start + k] = even + odd;
+                    values[start + k + length / 2] = even - odd;
+                    twiddle *= step;
+                }
+            }
+        }
+
+        for (std::size_t bin = 0; bin < m_power.size(); bin++) {
+            m_power[bin] += std::norm(values[bin]);
+        }
+        m_frames++;
+    }
+
+    std::vector<double> m_window;
+    std::size_t m_filled = 0;
+    std::vector<double> m_power;
+    std::uint64_t m_frames = 0;
+};
+
+static std::shared_ptr<AssetStore> makeStore(const Case& c) {
+    std::map<std::string, std::vector<std::uint8_t>> files = {
+        { c.style.collectionFile, AssetGenerator::generateCollection(c.collection) },
+        { c.segment.styleFile, AssetGenerator::generateStyle(c.style) },
+        { "regress.sgt", AssetGenerator::generateSegment(c.segment) }
+    };
+    if (c.seekMeasure > 0) {
+        SegmentSettings intro = c.segment;
+        intro.id++;
+        intro.measures = 4;
+        files["intro.sgt"] = AssetGenerator::generateSegment(intro);
+    }
+    return AssetGenerator::createStore(std::move(files));
+}
+
+static std::uint32_t getSeekTime(const Case& c) {
+    return c.seekMeasure * 4 * PlayingContext::PulsesPerQuarterNote;
+}
+
+// Plays the segment of a seek case from its start, and throws if `output`, rendered
+// after seeking, isn't the same once the seek has settled
+static void checkSeek(const Case& c, const std::shared_ptr<AssetStore>& store, const std::vector<std::int16_t>& output) {
+    PlayingContext ctx(SampleRate, Channels, DlsPlayer::createFactory());
+    ctx.setAssetStore(store);
+    ctx.setSeed(Seed);
+    auto segment = ctx.prepareSegment(*ctx.loadSegment("regress.sgt"));
+    ctx.playSegment(segment);
+
+    // Same rounding as the context's, a time falling on a frame starts there
+    double seekFrame = segment->getTempoMap().getSeconds(getSeekTime(c)) * SampleRate;
+    std::uint64_t skipped = (std::uint64_t)std::ceil(seekFrame - 1e-6);
+    std::uint64_t frames = output.size() / Channels;
+    std::vector<std::int16_t> expected((skipped + frames + BlockFrames) * Channels);
+    for (std::uint64_t i = 0; i < skipped + frames; i += BlockFrames) {
+        ctx.renderBlock(expected.data() + i * Channels, BlockFrames * Channels);
+    }
+
+    std::uint64_t settled = (std::uint64_t)(SeekSettleSeconds * SampleRate);
+    for (std::uint64_t i = settled * Channels; i < output.size(); i++) {
+        if (output[i] != expected[skipped * Channels + i]) {
+            std::ostringstream message;
+            message << "The output differs from playing up to the seek " << std::fixed << std::setprecision(2)
+                << i / Channels / (double)SampleRate << " seconds after it";
+            throw std::runtime_error(message.str());
+        }
+    }
+}
+
+// Renders `frames` frames of the case once. Only the calls to renderBlock are timed.
+static Result renderCase(const Case& c, std::uint64_t frames) {
+    PlayingContext ctx(SampleRate, Channels, DlsPlayer::createFactory());
+    auto store = makeStore(c);
+    ctx.setAssetStore(store);
+    if (c.renderThreads > 0) {
+        ctx.setRenderThreads(c.renderThreads);
+    }
+
+    // The random choices of the engine are the same on every run
+    ctx.setSeed(Seed);
+    auto segment = ctx.loadSegment("regress.sgt");
+    if (segment == nullptr) {
+        throw std::runtime_error("Cannot load the segment");
+    }
+
+    std::vector<std::int16_t> buffer(BlockFrames * Channels);
+    std::vector<std::int16_t> output;
+    if (c.seekMeasure > 0) {
+        // As when resuming the music: the segment replaces the one playing and
+        // is moved before it had a chance to start
+        ctx.playSegment(*ctx.loadSegment("intro.sgt"));
+        ctx.renderBlock(buffer.data(), BlockFrames * Channels);
+        ctx.setSeed(Seed);
+        ctx.playSegment(*segment);
+        ctx.seek(getSeekTime(c));
+        output.reserve(frames * Channels);
+    } else {
+        ctx.playSegment(*segment);
+    }
+
+    Result result;
+    result.name = c.name;
+    result.checksum = 1469598103934665603ULL; // FNV-1a
+    SpectrumAnalyzer analyzer;
+    std::chrono::steady_clock::duration elapsed(0);
+
+    for (std::uint64_t i = 0; i < frames; i += BlockFrames) {
+        std::uint32_t blockFrames = (std::uint32_t)std::min<std::uint64_t>(BlockFrames, frames - i);
+        auto start = std::chrono::steady_clock::now();
+        ctx.renderBlock(buffer.data(), blockFrames * Channels);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        for (std::size_t j = 0; j < blockFrames * Channels; j++) {
+            result.checksum = (result.checksum ^ (std::uint16_t)buffer[j]) * 1099511628211ULL;
+        }
+        analyzer.add(buffer.data(), blockFrames);
+        if (c.seekMeasure > 0) {
+            output.insert(output.end(), buffer.begin(), buffer.begin() + blockFrames * Channels);
+        }
+        result.peakMemory = std::max<std::uint64_t>(result.peakMemory, ctx.getMemoryUsage().total());
+    }
+
+    result.realtime = (frames / (double)SampleRate) / std::chrono::duration<double>(elapsed).count();
+    result.spectrum = analyzer.bands();
+    if (c.seekMeasure > 0) {
+        checkSeek(c, store, output);
+    }
+    return result;
+}
+
+static std::string toHex(std::uint64_t value) {
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << value;
+    return stream.str();
+}
+
+static void writeReport(std::ostream& out, double seconds, const std::vector<Result>& results) {
+    out << "{\n  \"version\": " << ReportVersion << ",\n  \"sampleRate\": " << SampleRate
+        << ",\n  \"channels\": " << Channels << ",\n  \"seconds\": " << seconds << ",\n  \"cases\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const auto& result = results[i];
+        out << "    { \"name\": \"" << result.name << "\", \"checksum\": \"" << toHex(result.checksum) << "\", "
+            << std::fixed << std::setprecision(2) << "\"realtime\": " << result.realtime
+            << ", \"peakMemory\": " << result.peakMemory << ", \"spectrum\": [";
+        for (std::size_t band = 0; band < result.spectrum.size(); band++) {
+            out << (band > 0 ? ", " : "") << result.spectrum[band];
+        }
+        out << "] }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    out.unsetf(std::ios::fixed);
+}
+
+/// Just enough of a JSON reader for the reports written above
+class JsonValue {
+public:
+    enum class Type { Null, Number, String, Array, Object };
+
+    static JsonValue parse(const std::string& text) {
+        std::size_t position = 0;
+        JsonValue value = parseValue(text, position);
+        skipSpaces(text, position);
+        if (position != text.size()) {
+            throw std::runtime_error("Unexpected data after the JSON value");
+        }
+        return value;
+    }
+
+    Type type = Type::Null;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    const JsonValue& operator[](const std::string& key) const {
+        static const JsonValue null;
+        auto it = object.find(key);
+        return it != object.end() ? it->second : null;
+    }
+
+private:
+    static void skipSpaces(const std::string& text, std::size_t& position) {
+        while (position < text.size() && std::isspace((unsigned char)text[position])) {
+            position++;
+        }
+    }
+
+    static void expect(const std::string& text, std::size_t& position, char c) {
+        skipSpaces(text, position);
+        if (position >= text.size() || text[position] != c) {
+            throw std::runtime_error(std::string("Expected '") + c + "' in the JSON data");
+        }
+        position++;
+    }
+
+    static std::string parseString(const std::string& text, std::size_t& position) {
+        expect(text, position, '"');
+        std::string result;
+        while (position < text.size() && text[position] != '"') {
+            if (text[position] == '\\' && position + 1 < text.size()) {
+                position++;
+            }
+            result += text[position++];
+        }
+        expect(text, position, '"');
+        return result;
+    }
+
+    static JsonValue parseValue(const std::string& text, std::size_t& position) {
+        skipSpaces(text, position);
+        if (position >= text.size()) {
+            throw std::runtime_error("Unexpected end of the JSON data");
+        }
+
+        JsonValue value;
+        char c = text[position];
+        if (c == '{') {
+            value.type = Type::Object;
+            position++;
+            skipSpaces(text, position);
+            if (position < text.size() && text[position] == '}') {
+                position++;
+                return value;
+            }
+            while (true) {
+                std::string key = parseString(text, position);
+                expect(text, position, ':');
+                value.object[key] = parseValue(text, position);
+                skipSpaces(text, position);
+                if (position >= text.size() || text[position] != ',') {
+                    break;
+                }
+                position++;
+            }
+            expect(text, position, '}');
+        } else if (c == '[') {
+            value.type = Type::Array;
+            position++;
+            skipSpaces(text, position);
+            if (position < text.size() && text[position] == ']') {
+                position++;
+                return value;
+            }
+            while (true) {
+                value.array.push_back(parseValue(text, position));
+                skipSpaces(text, position);
+                if (position >= text.size() || text[position] != ',') {
+                    break;
+                }
+                position++;
+            }
+            expect(text, position, ']');
+        } else if (c == '"') {
+            value.type = Type::String;
+            value.string = parseString(text, position);
+        } else if (text.compare(position, 4, "null") == 0) {
+            position += 4;
+        } else {
+            const char* start = text.c_str() + position;
+            char* end = nullptr;
+            value.type = Type::Number;
+            value.number = std::strtod(start, &end);
+            if (end == start) {
+                throw std::runtime_error("Invalid JSON value");
+            }
+            position += end - start;
+        }
+        return value;
+    }
+};
+
+static std::map<std::string, Result> readBaseline(const std::string& file, double seconds) {
+    std::ifstream input(file);
+    if (!input) {
+        throw std::runtime_error("Cannot read " + file);
+    }
+    std::stringstream text;
+    text << input.rdbuf();
+
+    JsonValue report = JsonValue::parse(text.str());
+    if (report["version"].number != ReportVersion) {
+        throw std::runtime_error(file + " is not a report of this version of dmregress");
+    }
+    if (report["sampleRate"].number != SampleRate || report["channels"].number != Channels
+        || report["seconds"].number != seconds) {
+        throw std::runtime_error(file + " was rendered with other settings");
+    }
+
+    std::map<std::string, Result> results;
+    for (const auto& entry : report["cases"].array) {
+        Result result;
+        result.name = entry["name"].string;
+        result.checksum = std::strtoull(entry["checksum"].string.c_str(), nullptr, 16);
+        result.realtime = entry["realtime"].number;
+        result.peakMemory = (std::uint64_t)entry["peakMemory"].number;
+        for (const auto& band : entry["spectrum"].array) {
+            result.spectrum.push_back(band.number);
+        }
+        results[result.name] = result;
+    }
+    return results;
+}
+
+struct Tolerances {
+    double spectrum; //< Largest difference of a band in dB when the output isn't bit-exact
+    bool exact; //< Fail if the output isn't bit-exact
+    double speed; //< Largest slowdown, as a fraction of the baseline's speed
+    double memory; //< Largest increase of the peak memory, as a fraction of the baseline's
+};
+
+// Prints how a result compares to its baseline, and returns false if it regressed
+static bool compare(const Result& result, const Result* baseline, const Tolerances& tolerances) {
+    std::cout << std::left << std::setw(16) << result.name << std::right << " " << toHex(result.checksum)
+        << std::fixed << std::setprecision(1) << std::setw(9) << result.realtime << "x"
+        << std::setw(10) << result.peakMemory / 1024.0 << " KiB";
+    if (baseline == nullptr) {
+        std::cout << "  (not in the baseline)" << std::endl;
+        return true;
+    }
+
+    bool passed = true;
+    std::ostringstream notes;
+    notes << std::fixed;
+    if (result.checksum == baseline->checksum) {
+        notes << "  exact";
+    } else {
+        double largest = 0;
+        for (std::size_t band = 0; band < result.spectrum.size(); band++) {
+            double expected = band < baseline->spectrum.size() ? baseline->spectrum[band] : SilenceDecibels;
+            largest = std::max(largest, std::abs(result.spectrum[band] - expected));
+        }
+        bool close = largest <= tolerances.spectrum && result.spectrum.size() == baseline->spectrum.size();
+        passed = close && !tolerances.exact;
+        notes << std::setprecision(2) << (close ? "  close" : "  DIFFERS") << " (" << largest << " dB)";
+    }
+
+    double speed = result.realtime / baseline->realtime - 1;
+    notes << std::showpos << std::setprecision(1) << "  speed " << speed * 100 << "%";
+    if (speed < -tolerances.speed) {
+        passed = false;
+        notes << " SLOWER";
+    }
+
+    double memory = baseline->peakMemory > 0 ? (double)result.peakMemory / baseline->peakMemory - 1 : 0;
+    notes << "  memory " << memory * 100 << "%" << std::noshowpos;
+    if (memory > tolerances.memory) {
+        passed = false;
+        notes << " LARGER";
+    }
+
+    std::cout << notes.str() << std::endl;
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    args::ArgumentParser parser("dmregress renders synthetic segments and compares the output, speed and memory use to a baseline");
+    args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
+    args::ValueFlag<std::string> baselineFile(parser, "file", "The report to compare the results to", { 'b', "baseline" });
+    args::ValueFlag<std::string> reportFile(parser, "file", "Write the results to this file, to be used as a baseline later", { 'o', "output" });
+    args::ValueFlag<std::string> filter(parser, "filter", "Only render the cases whose name contains this text", { 'f', "filter" });
+    args::ValueFlag<unsigned int> length(parser, "seconds", "The length of the audio rendered for every case", { 'l', "length" });
+    args::ValueFlag<unsigned int> repeat(parser, "count", "Render every case this many times, keeping the best speed (3 by default)", { 'r', "repeat" });
+    args::ValueFlag<double> spectrumTolerance(parser, "dB", "The largest difference of a band of the spectrum when the output isn't bit-exact", { "tolerance" });
+    args::Flag exact(parser, "exact", "Require the output to be bit-exact", { "exact" });
+    args::ValueFlag<double> speedTolerance(parser, "percent", "The largest slowdown allowed", { "speed-tolerance" });
+    args::ValueFlag<double> memoryTolerance(parser, "percent", "The largest increase of the peak memory allowed", { "memory-tolerance" });
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << parser;
+        return 0;
+    } catch (const args::ParseError& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    } catch (const args::ValidationError& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    double seconds = length ? args::get(length) : 10;
+    std::uint32_t repetitions = std::max(1u, repeat ? args::get(repeat) : 3u);
+    Tolerances tolerances;
+    tolerances.spectrum = spectrumTolerance ? args::get(spectrumTolerance) : 0.5;
+    tolerances.exact = exact ? true : false;
+    tolerances.speed = (speedTolerance ? args::get(speedTolerance) : 10) / 100;
+    tolerances.memory = (memoryTolerance ? args::get(memoryTolerance) : 5) / 100;
+
+    std::map<std::string, Result> baseline;
+    try {
+        if (baselineFile) {
+            baseline = readBaseline(args::get(baselineFile), seconds);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "dmregress: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<Result> results;
+    bool passed = true;
+    for (const auto& c : makeCases()) {
+        if (filter && c.name.find(args::get(filter)) == std::string::npos) {
+            continue;
+        }
+
+        Result best;
+        try {
+            for (std::uint32_t i = 0; i < repetitions; i++) {
+                Result result = renderCase(c, (std::uint64_t)(seconds * SampleRate));
+                if (i > 0 && result.checksum != best.checksum) {
+                    throw std::runtime_error("The output differs from one run to the other");
+                }
+                if (i == 0 || result.realtime > best.realtime) {
+                    best = result;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "dmregress: " << c.name << ": " << e.what() << std::endl;
+            passed = false;
+            continue;
+        }
+
+        auto it = baseline.find(c.name);
+        passed = compare(best, it != baseline.end() ? &it->second : nullptr, tolerances) && passed;
+        results.push_back(best);
+    }
+
+    if (reportFile) {
+        std::ofstream report(args::get(reportFile));
+        writeReport(report, seconds, results);
+        if (!report) {
+            std::cerr << "dmregress: Cannot write " << args::get(reportFile) << std::endl;
+            return 1;
+        }
+    }
+
+    if (baselineFile) {
+        std::cout << (passed ? "No regression" : "Regressions found") << std::endl;
+    }
+    return passed ? 0 : 1;
+}
@@ -1,29 +1,317 @@
 #include <iostream>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <string>
 #include <queue>
 #include <locale>
 #include <map>
+#include <future>
+#include <algorithm>
+#include <vector>
 #include <dmusic/PlayingContext.h>
 #include <dmusic/SoundFontPlayer.h>
 #include <dmusic/DlsPlayer.h>
+#include <dmusic/MemoryUsage.h>
 #include <dmusic/InstrumentPlayer.h>
 #include <dmusic/Tracks.h>
+#include <dmusic/Trace.h>
 #include <dmusic/dls/DownloadableSound.h>
 #include <cmath>
 #include <args.hxx>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
 #include "../../../src/dr_wav.h"
 
 using namespace DirectMusic;
 using namespace DirectMusic::DLS;
 
+struct RenderSettings {
+    int sampleRate;
+    int channels;
+    std::uint64_t length; //< In frames
+    std::uint32_t renderThreads; //< 0 to render on the calling thread only
+    std::uint64_t seed; //< Seed of the random choices of the music
+    std::uint32_t start; //< Music time the segment is played from
+    bool profile; //< Print the render statistics of the context at the end
+    bool memory; //< Print the memory held by the library at the end
+};
+
+static void printHistogram(const char* name, const HistogramSummary& histogram, double scale, const char* unit) {
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+        << " min " << std::setw(9) << histogram.min / scale
+        << " avg " << std::setw(9) << histogram.mean / scale
+        << " p99 " << std::setw(9) << histogram.p99 / scale
+        << " max " << std::setw(9) << histogram.max / scale << " " << unit << std::endl;
+}
+
+static void printRenderStats(const RenderStats& stats) {
+    std::cout << "Render statistics:" << std::endl
+        << "  " << stats.blocks << " blocks, " << stats.quanta << " quanta rendered, " << stats.silentQuanta << " skipped as silent" << std::endl
+        << "  " << stats.eventsDispatched << " events, " << stats.subBlockSplits << " splits, " << stats.patternGenerations << " patterns" << std::endl;
+    printHistogram("block time", stats.blockTime, 1000, "us");
+    printHistogram("quantum time", stats.quantumTime, 1000, "us");
+    printHistogram("channel time", stats.channelTime, 1000, "us");
+    printHistogram("active voices", stats.activeVoices, 1, "");
+    printHistogram("events/quantum", stats.eventsPerQuantum, 1, "");
+    printHistogram("splits/quantum", stats.splitsPerQuantum, 1, "");
+    printHistogram("queue depth", stats.queueDepth, 1, "");
+    for (const auto& channel : stats.channels) {
+        std::cout << "  channel " << std::setw(3) << channel.channel << ": " << std::setprecision(1)
+            << channel.totalNanoseconds / 1e6 << " ms in " << channel.renders << " renders, max "
+            << channel.maxNanoseconds / 1000.0 << " us" << std::endl;
+    }
+}
+
+static void printMemoryUsage(const char* title, const MemoryUsage& usage) {
+    std::cout << title << ": " << std::fixed << std::setprecision(1) << usage.total() / 1024.0 << " KiB" << std::endl
+        << "  collections    " << std::setw(10) << usage.collections / 1024.0 << " KiB" << std::endl
+        << "  styles         " << std::setw(10) << usage.styles / 1024.0 << " KiB" << std::endl
+        << "  segments       " << std::setw(10) << usage.segments / 1024.0 << " KiB" << std::endl
+        << "  synth banks    " << std::setw(10) << usage.synthBanks / 1024.0 << " KiB" << std::endl
+        << "  players        " << std::setw(10) << usage.players / 1024.0 << " KiB" << std::endl
+        << "  message queues " << std::setw(10) << usage.messageQueues / 1024.0 << " KiB" << std::endl;
+}
+
+// Renders `segmentFile` into the WAV file `outputFile` with a new playing context
+// loading its assets from `assets`. Returns an empty string or the error.
+static std::string renderSegment(const std::string& segmentFile, const std::string& outputFile,
+    const RenderSettings& settings, const std::shared_ptr<AssetStore>& assets, bool showProgress) {
+    // Every context has its own factory, so that the voice limits apply to each of them
+    PlayingContext ctx(settings.sampleRate, settings.channels, DlsPlayer::createFactory());
+    ctx.setAssetStore(assets);
+    if (settings.renderThreads > 0) {
+        ctx.setRenderThreads(settings.renderThreads);
+    }
+    ctx.setProfiling(settings.profile);
+    ctx.setSeed(settings.seed);
+
+    if (showProgress) std::cout << "Loading segment...";
+    auto segment = ctx.loadSegment(segmentFile);
+    if (segment == nullptr) {
+        return "Cannot load the segment";
+    }
+    if (showProgress) std::cout << " done.\nStart playback... ";
+    ctx.playSegment(*segment);
+    if (settings.start > 0) {
+        ctx.seek(settings.start);
+    }
+    if (showProgress) std::cout << " done.\nBegin rendering... \n";
+
+    drwav_data_format format;
+    format.container = drwav_container_riff;
+    format.format = DR_WAVE_FORMAT_PCM;
+    format.channels = settings.channels;
+    format.sampleRate = settings.sampleRate;
+    format.bitsPerSample = 16;
+
+    drwav* dr = drwav_open_file_write(outputFile.c_str(), &format);
+    if (dr == nullptr) {
+        return "Cannot open the output file";
+    }
+
+    // Audio is rendered one second at a time into one buffer while the
+    // other one is being written, so memory use doesn't depend on the length
+    const std::uint64_t length = settings.length;
+    const std::uint64_t blockFrames = settings.sampleRate;
+    std::vector<std::int16_t> buffers[2] = {
+        std::vector<std::int16_t>(blockFrames * settings.channels),
+        std::vector<std::int16_t>(blockFrames * settings.channels)
+    };
+    std::future<drwav_uint64> pendingWrite;
+    std::uint64_t written = 0;
+    int current = 0;
+
+    for (std::uint64_t i = 0; i < length; i += blockFrames) {
+        std::uint64_t frames = std::min(blockFrames, length - i);
+        ctx.renderBlock(buffers[current].data(), (std::uint32_t)(frames * settings.channels));
+
+        if (pendingWrite.valid()) {
+            written += pendingWrite.get();
+        }
+        const std::int16_t* block = buffers[current].data();
+        pendingWrite = std::async(std::launch::async, [dr, frames, block] {
+            return drwav_write_pcm_frames(dr, frames, block);
+        });
+        current ^= 1;
+
+        if (showProgress) std::cout << "\rProgress: " <<  ceil(((i + frames) / (float)length) * 100) << "%";
+    }
+
+    if (pendingWrite.valid()) {
+        written += pendingWrite.get();
+    }
+    drwav_close(dr);
+
+    if (written != length) {
+        return "Cannot write the output file";
+    }
+    if (settings.profile) {
+        std::cout << std::endl;
+        printRenderStats(ctx.getRenderStats());
+    }
+    if (settings.memory) {
+        std::vector<AssetMemoryUsage> assetUsages;
+        std::cout << std::endl;
+        printMemoryUsage("Memory used by the context", ctx.getMemoryUsage(&assetUsages));
+        for (const auto& asset : assetUsages) {
+            std::cout << "  " << (asset.type == AssetType::Collection ? "collection " : "style      ")
+                << asset.guid.toString() << " " << std::setw(10) << asset.bytes / 1024.0 << " KiB  " << asset.name << std::endl;
+        }
+        printMemoryUsage("Memory used by the process", getProcessMemoryUsage());
+    }
+    return "";
+}
+
+static bool endsWithSegmentExtension(const std::string& name) {
+    if (name.size() < 4) return false;
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".sgt";
+}
+
+// Lists the segment files (*.sgt) of a directory, or returns false if it isn't one
+static bool listDirectory(const std::string& path, std::vector<std::string>& files) {
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && endsWithSegmentExtension(data.cFileName)) {
+            files.push_back(path + "\\" + data.cFileName);
+        }
+    } while (FindNextFileA(handle, &data));
+    FindClose(handle);
+#else
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (endsWithSegmentExtension(entry->d_name)) {
+            files.push_back(path + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+#endif
+    std::sort(files.begin(), files.end());
+    return true;
+}
+
+// Lists the segments of a batch: the segment files of a directory,
+// or the lines of a text file
+static std::vector<std::string> listSegments(const std::string& path) {
+    std::vector<std::string> files;
+    if (listDirectory(path, files)) {
+        return files;
+    }
+
+    std::ifstream list(path);
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            files.push_back(line);
+        }
+    }
+    return files;
+}
+
+static std::string outputName(const std::string& segmentFile) {
+    std::size_t slash = segmentFile.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? segmentFile : segmentFile.substr(slash + 1);
+    std::size_t dot = name.find_last_of('.');
+    return (dot == std::string::npos ? name : name.substr(0, dot)) + ".wav";
+}
+
+// Renders every segment of a batch into `outputDirectory`, `jobs` at a time.
+// The contexts share one asset store, so that each style and instrument collection
+// is only loaded and converted once.
+static int renderBatch(const std::string& input, const std::string& outputDirectory,
+    const RenderSettings& settings, std::uint32_t jobs) {
+    std::vector<std::string> segments = listSegments(input);
+    if (segments.empty()) {
+        std::cerr << "dmrender: No segment to render in " << input << std::endl;
+        return 1;
+    }
+    jobs = std::max<std::uint32_t>(1, std::min<std::uint32_t>(jobs, (std::uint32_t)segments.size()));
+
+    std::cout << "Rendering " << segments.size() << " segments, " << jobs << " at a time\n";
+
+    auto assets = std::make_shared<AssetStore>();
+    std::atomic<std::size_t> next(0);
+    std::atomic<int> failures(0);
+    std::mutex outputMutex;
+    const double audioSeconds = settings.length / (double)settings.sampleRate;
+    auto start = std::chrono::steady_clock::now();
+
+    auto job = [&] {
+        for (std::size_t i = next++; i < segments.size(); i = next++) {
+            auto jobStart = std::chrono::steady_clock::now();
+            std::string error;
+            try {
+                error = renderSegment(segments[i], outputDirectory + "/" + outputName(segments[i]), settings, assets, false);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+
+            std::lock_guard<std::mutex> lock(outputMutex);
+            if (!error.empty()) {
+                failures++;
+                std::cerr << "dmrender: " << segments[i] << ": " << error << std::endl;
+            } else {
+                std::cout << segments[i] << ": " << std::fixed << std::setprecision(2) << audioSeconds << " s in "
+                    << seconds << " s (" << std::setprecision(1) << audioSeconds / seconds << "x realtime)" << std::endl;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::uint32_t i = 1; i < jobs; i++) {
+        threads.emplace_back(job);
+    }
+    job();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::size_t rendered = segments.size() - failures;
+    std::cout << "Rendered " << rendered << " of " << segments.size() << " segments in " << std::fixed
+        << std::setprecision(2) << total << " s (" << std::setprecision(1) << rendered * audioSeconds / total
+        << "x realtime overall)" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
     args::ArgumentParser parser("dmrender renders DirectMusic segments into audio files");
     args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
     args::ValueFlag<unsigned int> chunkLength(parser, "length", "The length in seconds of the audio to render", { 'l', "length" });
     args::ValueFlag<unsigned int> samplingRate(parser, "sampling rate", "The sampling rate to use", { 's', "sample" });
     args::ValueFlag<unsigned int> numChannels(parser, "channels", "The number of channels to use", { 'c', "channels" });
-    args::Positional<std::string> segmentName(parser, "segment", "The segment to render");
-    args::Positional<std::string> outputFile(parser, "output", "The output file");
+    args::ValueFlag<unsigned int> renderThreads(parser, "threads", "The number of threads rendering the performance channels", { 't', "threads" });
+    args::ValueFlag<unsigned long long> seed(parser, "seed", "The seed of the random choices of the music (patterns, variations, velocities)", { "seed" });
+    args::ValueFlag<unsigned int> startTime(parser, "pulses", "The music time to start the segment from, in pulses (768 per quarter note)", { "start" });
+    args::Flag batch(parser, "batch", "Render every segment of a directory, or listed in a text file, into an output directory", { 'b', "batch" });
+    args::ValueFlag<unsigned int> numJobs(parser, "jobs", "The number of segments rendered at once in batch mode", { 'j', "jobs" });
+    args::Flag profile(parser, "profile", "Print the render statistics at the end (ignored in batch mode)", { 'p', "profile" });
+    args::Flag memory(parser, "memory", "Print the memory held by the library at the end (ignored in batch mode)", { 'm', "memory" });
+    args::ValueFlag<std::string> traceFile(parser, "file", "Write a trace of the rendering to this file, in the Chrome trace event format", { "trace" });
+    args::Positional<std::string> segmentName(parser, "segment", "The segment to render (a directory or list file in batch mode)");
+    args::Positional<std::string> outputFile(parser, "output", "The output file (a directory in batch mode)");
 
     try {
         parser.ParseCLI(argc, argv);
@@ -50,41 +338,51 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    int sampleRate = samplingRate ? args::get(samplingRate) : 44100;
-    int channels = numChannels ? args::get(numChannels) : 1;
-    if(channels > 2) {
+    RenderSettings settings;
+    settings.sampleRate = samplingRate ? args::get(samplingRate) : 44100;
+    settings.channels = numChannels ? args::get(numChannels) : 1;
+    if(settings.channels > 2) {
         std::cerr << "dmrender: Invalid number of channels" << std::endl;
         return 1;
     }
-    std::uint64_t length = (chunkLength ? args::get(chunkLength) : 60) * sampleRate;
-
-    // Store soundfonts based on their name
-    PlayingContext ctx(sampleRate, channels, DlsPlayer::createFactory());
-    std::cout << "Loading segment...";
-    auto segment = ctx.loadSegment(args::get(segmentName));
-    std::cout << " done.\nStart playback... ";
-    ctx.playSegment(*segment);
-    std::cout << " done.\nBegin rendering... \n";
+    settings.length = (std::uint64_t)(chunkLength ? args::get(chunkLength) : 60) * settings.sampleRate;
+    settings.renderThreads = renderThreads ? args::get(renderThreads) : 0;
+    settings.seed = seed ? args::get(seed) : Random::DefaultSeed;
+    settings.start = startTime ? args::get(startTime) : 0;
+    settings.profile = profile && !batch;
+    settings.memory = memory && !batch;
 
-    std::int16_t* buffer = new std::int16_t[length];
-    for (std::uint64_t i = 0; i < length; i += sampleRate) {
-        ctx.renderBlock(buffer + i, sampleRate);
-        std::cout << "\rProgress: " <<  ceil((i / (float)length) * 100) << "%";
+    if (traceFile) {
+        if (!Tracer::isAvailable()) {
+            std::cerr << "dmrender: libdmusic was built without DMUSIC_TRACE, the trace will be empty" << std::endl;
+        }
+        Tracer::get().start(1 << 20);
     }
 
-    drwav_data_format format;
-    format.container = drwav_container_riff;
-    format.format = DR_WAVE_FORMAT_PCM;
-    format.channels = channels;
-    format.sampleRate = sampleRate;
-    format.bitsPerSample = 16;
-
-    drwav* dr = drwav_open_file_write(args::get(outputFile).c_str(), &format);
-    drwav_write_pcm_frames(dr, length, buffer);
-    drwav_close(dr);
-
-    delete[] buffer;
+    int result = 0;
+    if (batch) {
+        std::uint32_t jobs = numJobs ? args::get(numJobs) : std::thread::hardware_concurrency();
+        result = renderBatch(args::get(segmentName), args::get(outputFile), settings, jobs);
+    } else {
+        std::string error = renderSegment(args::get(segmentName), args::get(outputFile), settings, std::make_shared<AssetStore>(), true);
+        if (!error.empty()) {
+            std::cerr << "\ndmrender: " << error << std::endl;
+            result = 1;
+        } else {
+            std::cout << "\nRendering done.";
+        }
+    }
 
-    std::cout << "\nRendering done.";
-    return 0;
+    if (traceFile) {
+        Tracer::get().stop();
+        std::ofstream trace(args::get(traceFile));
+        Tracer::writeChromeTrace(trace, Tracer::get().takeEvents());
+        if (!trace) {
+            std::cerr << "dmrender: Cannot write " << args::get(traceFile) << std::endl;
+            result = 1;
+        } else if (Tracer::get().getDroppedCount() > 0) {
+            std::cerr << "dmrender: " << Tracer::get().getDroppedCount() << " trace events were dropped" << std::endl;
+        }
+    }
+    return result;
 }
@@ -0,0 +1,419 @@
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dmusic/AllocationCheck.h>
+#include <dmusic/AssetGenerator.h>
+#include <dmusic/PlayingContext.h>
+#include <dmusic/DlsPlayer.h>
+#include <dmusic/RenderAheadBuffer.h>
+#include <dmusic/InstrumentPlayer.h>
+#include <dmusic/dls/DownloadableSound.h>
+#include <args.hxx>
+
+using namespace DirectMusic;
+using namespace DirectMusic::DLS;
+
+// Every allocation of the process is counted, so that the benchmarks can
+// report how many each operation makes. A library built with the allocation
+// check replaces operator new itself, and counts them.
+#if DMUSIC_ALLOCATION_CHECK
+static std::uint64_t getAllocationCount() {
+    return AllocationCheck::getTotalCount();
+}
+#else
+static std::atomic<std::uint64_t> allocationCount(0);
+
+static std::uint64_t getAllocationCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+#endif
+
+/*
+ * The benchmarks run on the default generated collection, style and segment,
+ * so that they need no game assets and always measure the same thing: 8 parts
+ * of one measure, each playing a three-note chord on every sixteenth with its
+ * own instrument.
+ */
+static const std::uint32_t SampleRate = 44100;
+
+// Plays nothing, so that only the generation and dispatch of the messages is measured
+class NullPlayer : public InstrumentPlayer {
+public:
+    NullPlayer(DirectMusic::DLS::DownloadableSound& dls, std::uint32_t sampleRate, std::uint32_t channels)
+        : InstrumentPlayer(0, 0, 0, dls, sampleRate, channels, 1, 0) {}
+
+    virtual std::uint32_t renderBlock(std::int16_t * /*buffer*/, std::uint32_t count, bool /*mix*/) noexcept { return count; }
+    virtual bool isIdle() const noexcept { return true; }
+    virtual void noteOn(std::uint8_t /*note*/, std::uint8_t /*velocity*/) {}
+    virtual void noteOff(std::uint8_t /*note*/, std::uint8_t /*velocity*/) {}
+    virtual void allNotesOff() {}
+    virtual void channelPressure(std::uint8_t /*val*/) {}
+    virtual void polyAftertouch(std::uint8_t /*note*/, std::uint8_t /*val*/) {}
+    virtual void controlChange(DirectMusic::Midi::Control /*control*/, float /*val*/) {}
+    virtual void programChange(std::uint8_t /*program*/) {}
+    virtual void pitchBend(std::int16_t /*val*/) {}
+};
+
+struct Assets {
+    std::vector<std::uint8_t> collection, style, segment;
+
+    Assets(const StyleSettings& styleSettings = StyleSettings(), const SegmentSettings& segmentSettings = SegmentSettings())
+        : collection(AssetGenerator::generateCollection())
+        , style(AssetGenerator::generateStyle(styleSettings))
+        , segment(AssetGenerator::generateSegment(segmentSettings)) {}
+
+    std::shared_ptr<AssetStore> store() const {
+        return AssetGenerator::createStore({
+            { "generated.dls", collection }, { "generated.sty", style }, { "generated.sgt", segment }
+        });
+    }
+};
+
+struct Options {
+    std::string filter;
+    double minTime;
+    bool csv;
+};
+
+// Runs `op` until it has taken at least `minTime` seconds in total, running `setup`
+// (which is not measured) before each call. `seconds` is the length of the audio
+// an operation renders, if any.
+static void run(const Options& options, const std::string& name, double seconds,
+    const std::function<void()>& setup, const std::function<void()>& op) {
+    if (name.find(options.filter) == std::string::npos) {
+        return;
+    }
+
+    std::uint64_t ops = 0, allocations = 0;
+    std::chrono::steady_clock::duration elapsed(0);
+    const auto minDuration = std::chrono::duration<double>(options.minTime);
+    do {
+        if (setup) {
+            setup();
+        }
+        std::uint64_t allocationsBefore = getAllocationCount();
+        auto start = std::chrono::steady_clock::now();
+        op();
+        elapsed += std::chrono::steady_clock::now() - start;
+        allocations += getAllocationCount() - allocationsBefore;
+        ops++;
+    } while (elapsed < minDuration);
+
+    double nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+    double realtime = seconds > 0 ? seconds * 1e9 / nsPerOp : 0;
+    double allocationsPerOp = (double)allocations / ops;
+
+    if (options.csv) {
+        std::cout << name << "," << ops << "," << std::fixed << std::setprecision(1) << nsPerOp << ","
+            << realtime << "," << std::setprecision(2) << allocationsPerOp << std::endl;
+        return;
+    }
+
+    std::cout << std::left << std::setw(28) << name << std::right
+        << std::setw(10) << ops
+        << std::setw(16) << std::fixed << std::setprecision(1) << nsPerOp;
+    if (seconds > 0) {
+        std::cout << std::setw(12) << std::setprecision(1) << realtime << "x";
+    } else {
+        std::cout << std::setw(13) << "-";
+    }
+    std::cout << std::setw(12) << std::setprecision(2) << allocationsPerOp << std::endl;
+}
+
+static void benchParsing(const Options& options, const Assets& assets) {
+    run(options, "riff_parse/collection", 0, nullptr, [&] {
+        Riff::Chunk c(assets.collection.data());
+    });
+    run(options, "riff_parse/style", 0, nullptr, [&] {
+        Riff::Chunk c(assets.style.data());
+    });
+
+    Riff::Chunk collection(assets.collection.data());
+    run(options, "dls_load", 0, nullptr, [&] {
+        DownloadableSound dls(collection);
+    });
+
+    Riff::Chunk style(assets.style.data());
+    run(options, "style_load", 0, nullptr, [&] {
+        StyleForm form(style);
+    });
+}
+
+// Creating the first player of a collection converts it; a collection with a new id
+// each time keeps it from being found in the cache
+static void benchConversion(const Options& options) {
+    CollectionSettings settings;
+    settings.id = 1000;
+    std::unique_ptr<DownloadableSound> dls;
+    auto factory = DlsPlayer::createFactory();
+    run(options, "convert_collection", 0, [&] {
+        dls.reset(new DownloadableSound(Riff::Chunk(AssetGenerator::generateCollection(settings).data())));
+        settings.id++;
+    }, [&] {
+        factory(0, 0, 0, AssetGenerator::makeGuid(3), *dls, SampleRate, 2, 1, 0);
+    });
+}
+
+static void benchScheduling(const Options& options, const Assets& assets) {
+    DownloadableSound dummy;
+    PlayingContext ctx(SampleRate, 2, [&](std::uint8_t, std::uint8_t, std::uint8_t, const GUID&,
+        DownloadableSound&, std::uint32_t sampleRate, std::uint32_t channels, float, float) {
+        return std::make_shared<NullPlayer>(dummy, sampleRate, channels);
+    });
+    ctx.setAssetStore(assets.store());
+
+    auto segment = ctx.loadSegment("generated.sgt");
+    ctx.playSegment(*segment);
+
+    // One pattern, i.e. one measure at the style's tempo
+    const double seconds = 4 * 60 / StyleSettings().tempo;
+    std::vector<std::int16_t> buffer((std::size_t)(seconds * SampleRate) * 2);
+
+    // Every operation renders one of the measures of the segment, which is started over
+    // once they are all played, so that the result does not depend on the number of
+    // operations. The segment is played through once first, filling the message pool.
+    const std::uint32_t measures = SegmentSettings().measures;
+    std::uint32_t measure = 0;
+    auto nextMeasure = [&] {
+        if (measure == measures) {
+            ctx.seek(0);
+            measure = 0;
+        }
+        measure++;
+    };
+    for (std::uint32_t i = 0; i < measures; i++) {
+        nextMeasure();
+        ctx.renderBlock(buffer.data(), (std::uint32_t)buffer.size());
+    }
+
+    run(options, "pattern_events", seconds, nextMeasure, [&] {
+        ctx.renderBlock(buffer.data(), (std::uint32_t)buffer.size());
+    });
+}
+
+static void benchRendering(const Options& options, const Assets& assets) {
+    for (std::uint32_t channels = 1; channels <= 2; channels++) {
+        for (std::uint32_t frames : { 64, 256, 1024, 4096 }) {
+            PlayingContext ctx(SampleRate, channels, DlsPlayer::createFactory());
+            ctx.setAssetStore(assets.store());
+
+            auto segment = ctx.loadSegment("generated.sgt");
+            ctx.playSegment(*segment);
+
+            // Warms up until the players are created and their voices allocated
+            std::vector<std::int16_t> buffer(frames * channels);
+            for (std::uint32_t i = 0; i < SampleRate * 2 / frames; i++) {
+                ctx.renderBlock(buffer.data(), (std::uint32_t)buffer.size());
+            }
+
+            std::string name = "render/" + std::to_string(channels) + "ch/" + std::to_string(frames);
+            run(options, name, frames / (double)SampleRate, nullptr, [&] {
+                ctx.renderBlock(buffer.data(), (std::uint32_t)buffer.size());
+            });
+        }
+    }
+}
+
+// Plays a segment using every kind of message (chord-relative notes, curves, chord,
+// tempo and band changes) to its end, and checks that once it is playing, rendering
+// allocates no memory. Returns the exit code of the program.
+static int checkAllocations() {
+    StyleSettings styleSettings;
+    styleSettings.chordRelative = true;
+    styleSettings.curvesPerMeasure = 4;
+    SegmentSettings segmentSettings;
+    segmentSettings.chordChanges = 16;
+    segmentSettings.tempoChanges = 8;
+    segmentSettings.bandChanges = 4;
+    Assets assets(styleSettings, segmentSettings);
+
+    PlayingContext ctx(SampleRate, 2, DlsPlayer::createFactory());
+    ctx.setAssetStore(assets.store());
+    auto segment = ctx.loadSegment("generated.sgt");
+    ctx.playSegment(*segment);
+
+    // Warms up for two measures, so that the queues and the players' buffers are allocated
+    const std::uint32_t frames = 256;
+    std::vector<std::int16_t> buffer(frames * 2);
+    const std::uint32_t measureBlocks = (std::uint32_t)(4 * 60 / styleSettings.tempo * SampleRate / frames);
+    for (std::uint32_t i = 0; i < 2 * measureBlocks; i++) {
+        ctx.renderBlock(buffer.data(), (std::uint32_t)buffer.size());
+    }
+
+    std::uint64_t before = getAllocationCount();
+    AllocationCheck::start();
+    for (std::uint32_t i = 2 * measureBlocks; i < (segmentSettings.measures + 1) * measureBlocks; i++) {
+        ctx.renderBlock(buffer.data(), (std::uint32_t)buffer.size());
+    }
+    AllocationCheck::stop();
+
+    std::uint64_t allocations = AllocationCheck::isAvailable() ? AllocationCheck::getCount() : getAllocationCount() - before;
+    std::cout << allocations << " allocations while rendering" << std::endl;
+    if (!AllocationCheck::isAvailable()) {
+        if (allocations > 0) {
+            std::cout << "Build libdmusic with DMUSIC_ALLOCATION_CHECK to find where they are made" << std::endl;
+        }
+    }
+    for (const auto& site : AllocationCheck::getSites()) {
+        std::cout << site.count << " allocations (" << site.bytes << " bytes) from:" << std::endl;
+        for (std::size_t i = 0; i < site.frames.size() && i < 12; i++) {
+            std::cout << "    " << site.frames[i] << std::endl;
+        }
+    }
+    return allocations == 0 ? 0 : 1;
+}
+
+// Posts commands to a render-ahead buffer while it is full, and checks that each one
+// runs exactly `getLatency()` samples after what had been read when it was posted,
+// and that a throwing command is counted. Returns the exit code of the program.
+static int checkRenderAhead() {
+    PlayingContext ctx(SampleRate, 2, DlsPlayer::createFactory());
+    ctx.setAssetStore(Assets().store());
+    auto segment = ctx.loadSegment("generated.sgt");
+
+    // Blocks of 441 frames, so that what is read never falls on a quantum
+    RenderAheadBuffer buffer(ctx, 100);
+    std::vector<std::int16_t> block(441 * 2);
+    const auto blockTime = std::chrono::microseconds(1000000 * 441 / SampleRate);
+    std::uint64_t read = 0;
+
+    int failures = 0;
+    for (int i = 0; i < 4; i++) {
+        // Lets the buffer fill up
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        std::atomic<std::uint64_t> position(0);
+        std::atomic<bool> done(false);
+        const std::uint64_t expected = read + buffer.getLatency();
+        buffer.post([&, i](PlayingContext& context) {
+            position = buffer.getRenderedCount();
+            done = true;
+            if (i == 0) {
+                context.playSegment(*segment);
+            } else if (i == 3) {
+                throw std::runtime_error("Failing command");
+            }
+        });
+
+        // Read at about the pace of the audio until the command has run
+        for (int j = 0; !done && j < 1000; j++) {
+            buffer.read(block.data(), (std::uint32_t)block.size());
+            read += block.size();
+            std::this_thread::sleep_for(blockTime);
+        }
+        if (!done) {
+            throw std::runtime_error("The command never ran");
+        }
+
+        std::cout << "Command " << i << " ran at sample " << position << ", " << (std::int64_t)(position - expected)
+            << " samples after the latency" << std::endl;
+        if (position != expected) {
+            failures++;
+        }
+
+        // Catch up to where the command was posted for, plus some more
+        for (int j = 0; j < 4; j++) {
+            buffer.read(block.data(), (std::uint32_t)block.size());
+            read += block.size();
+            std::this_thread::sleep_for(blockTime);
+        }
+    }
+
+    // What was read is only known without underruns, which leave the read position behind
+    if (buffer.getUnderrunCount() > 0) {
+        throw std::runtime_error("The buffer underran, the machine is too busy for the check");
+    }
+
+    // The failing command is counted once it returned
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::cout << buffer.getFailedCommandCount() << " failed commands" << std::endl;
+    if (buffer.getFailedCommandCount() != 1) {
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    args::ArgumentParser parser("dmusic_bench measures the hot paths of libdmusic on generated content");
+    args::HelpFlag help(parser, "help", "Display this help menu", { 'h', "help" });
+    args::ValueFlag<std::string> filter(parser, "filter", "Only run the benchmarks whose name contains this text", { 'f', "filter" });
+    args::ValueFlag<double> minTime(parser, "seconds", "The minimum time spent in each benchmark", { 'm', "min-time" });
+    args::Flag csv(parser, "csv", "Print the results as comma separated values", { "csv" });
+    args::Flag allocations(parser, "check-allocations", "Check that rendering a playing segment allocates no memory, instead of running the benchmarks", { "check-allocations" });
+    args::Flag renderAhead(parser, "check-render-ahead", "Check that the commands posted to a render-ahead buffer run with its latency, instead of running the benchmarks", { "check-render-ahead" });
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (const args::Help&) {
+        std::cout << parser;
+        return 0;
+    } catch (const args::ParseError& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    } catch (const args::ValidationError& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
+    if (allocations || renderAhead) {
+        try {
+            return allocations ? checkAllocations() : checkRenderAhead();
+        } catch (const std::exception& e) {
+            std::cerr << "dmusic_bench: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    Options options;
+    options.filter = filter ? args::get(filter) : "";
+    options.minTime = minTime ? args::get(minTime) : 0.5;
+    options.csv = csv ? true : false;
+
+    if (options.csv) {
+        std::cout << "name,ops,ns_per_op,x_realtime,allocs_per_op" << std::endl;
+    } else {
+        std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(10) << "ops"
+            << std::setw(16) << "ns/op" << std::setw(13) << "realtime" << std::setw(12) << "allocs/op" << std::endl;
+    }
+
+    try {
+        Assets assets;
+        benchParsing(options, assets);
+        benchConversion(options);
+        benchScheduling(options, assets);
+        benchRendering(options, assets);
+    } catch (const std::exception& e) {
+        std::cerr << "dmusic_bench: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}